@@ -0,0 +1,413 @@
+//=========================================================================================================
+// bench.cpp - Measures the hot paths of smartlynq_static_ip and reports the results as JSON
+//
+// Build and run with "make bench".  Options are passed with BENCH_ARGS, for instance:
+//
+//     make -s bench BENCH_ARGS="--latency-ms 100 --devices 32" > bench.json
+//
+//     --exe <path>         The smartlynq_static_ip executable for the end-to-end benchmarks
+//     --vivado <path>      The fake Vivado (fake_vivado/vivado) to run the end-to-end benchmarks against.
+//                          Without it, a shell script stands in for Vivado
+//     --latency-ms <n>     How long the stub Vivado takes to program a device (default 50)
+//     --devices <n>        The number of devices in the end-to-end parallel run (default 16)
+//     --jobs <n>           The number of Vivado processes in the end-to-end parallel run (default 4)
+//     --min-time-ms <n>    The minimum time spent on each microbenchmark (default 200)
+//     --no-e2e             Skip the end-to-end benchmarks
+//=========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include "../config_file.h"
+#include "../tokenizer.h"
+#include "../template.h"
+#include "../process.h"
+using namespace std;
+using namespace std::chrono;
+
+// The result of one benchmark
+struct result_t {string name; int64_t iterations; double ns_per_op; double bytes_per_op;};
+
+// Every result so far
+static vector<result_t> results;
+
+// The options from the command line
+static string exe, fakeVivado;
+static int    latencyMs = 50, devices = 16, jobs = 4, minTimeMs = 200;
+static bool   e2e = true;
+
+// The scratch directory where the benchmarks keep their files
+static string scratch;
+
+
+//=========================================================================================================
+// measure() - Runs a function repeatedly for at least "minTimeMs", and records how long each call took
+//
+// Passed:  name         = The name of the benchmark
+//          bytes_per_op = The number of bytes that each call processes, or 0 if that doesn't apply
+//          fn           = The function to run
+//          min_runs     = Run the function at least this many times, no matter how long it takes
+//=========================================================================================================
+static void measure(const string& name, double bytes_per_op, function<void()> fn, int64_t min_runs = 1)
+{
+    int64_t iterations = 0;
+    double  seconds = 0;
+
+    // Run the function in ever larger batches until we've spent enough time
+    for (int64_t batch = 1; seconds * 1000 < minTimeMs || iterations < min_runs; batch *= 2)
+    {
+        auto start = steady_clock::now();
+        for (int64_t i=0; i<batch; ++i) fn();
+        seconds += duration<double>(steady_clock::now() - start).count();
+        iterations += batch;
+    }
+
+    results.push_back({name, iterations, seconds * 1e9 / iterations, bytes_per_op});
+    fprintf(stderr, "%-32s %14.1f ns/op\n", name.c_str(), seconds * 1e9 / iterations);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// write_file() - Writes a string to a file
+//=========================================================================================================
+static void write_file(const string& filename, const string& text)
+{
+    ofstream ofile(filename);
+    if (!ofile.is_open()) throw runtime_error("Can't create " + filename);
+    ofile << text;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// make_conf() - Returns the text of a configuration file that uses the stub Vivado in the scratch dir
+//=========================================================================================================
+static string make_conf()
+{
+    string text =
+        "vivado = \"" + scratch + "/vivado\"\n"
+        "tmp = \"" + scratch + "\"\n"
+        "command_line = \"%vivado% 2>&1 -nojournal -nolog -mode batch -source %tmp%/script.tcl\"\n"
+        "launch_timeout  = 120\n"
+        "connect_timeout = 60\n"
+        "update_timeout  = 600\n"
+        "reset_timeout   = 120\n"
+        "symbols =\n{\n    netmask 255.255.255.0\n}\n"
+        "config.ini =\n{\n"
+        "    set always-open-jtag 1\n"
+        "    set ip-address %static_ip%\n"
+        "    set ip-netmask %netmask%\n"
+        "    set ip-gateway %gateway_ip%\n"
+        "}\n"
+        "vivado_script =\n{\n"
+        "    open_hw_manager\n"
+        "    connect_hw_server -url %usb_ip%\n"
+        "    %unless_configured% update_hw_firmware %skip_update% -config_path %config_ini% -reset [current_hw_server]\n"
+        "}\n";
+
+    // Pad the file out with the sort of keys a station might add, so that lookups have company
+    for (int i=0; i<200; ++i) text += "station_key_" + to_string(i) + " = " + to_string(i * 7) + ", \"value " + to_string(i) + "\"\n";
+
+    return text;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// make_stub() - Installs the stub Vivado in the scratch directory.  It answers "-version" right away,
+//               and otherwise takes "latencyMs" to "program" a device
+//
+// If we were given the fake Vivado, the stub is a link to it, and the fake Vivado's firmware update takes
+// "latencyMs".  Otherwise the stub is a shell script that sleeps
+//=========================================================================================================
+static void make_stub()
+{
+    string filename = scratch + "/vivado";
+
+    if (!fakeVivado.empty())
+    {
+        write_file(scratch + "/fake_vivado.conf", "update_ms = " + to_string(latencyMs) + "\n");
+        setenv("FAKE_VIVADO_CONF", (scratch + "/fake_vivado.conf").c_str(), 1);
+        if (symlink(fakeVivado.c_str(), filename.c_str()) != 0) throw runtime_error("Can't create " + filename);
+        return;
+    }
+
+    char latency[32];
+    sprintf(latency, "%d.%03d", latencyMs / 1000, latencyMs % 1000);
+
+    write_file(filename,
+        "#!/bin/sh\n"
+        "if [ \"$1\" = \"-version\" ]; then echo \"Vivado Lab Edition v2021.1 (64-bit)\"; echo \"bench stub\"; exit 0; fi\n"
+        "echo \"****** Vivado Lab (bench stub)\"\n"
+        "sleep " + string(latency) + "\n"
+        "echo \"INFO: bench stub finished\"\n");
+
+    chmod(filename.c_str(), 0755);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// bench_tokenizer() - Measures CTokenizer on manifest lines and config values
+//=========================================================================================================
+static void bench_tokenizer()
+{
+    CTokenizer          tokenizer;
+    vector<string_view> views;
+
+    string manifest = "10.0.0.2   10.11.12.3";
+    string values   = " 12345, 0x1F, on, \"" + string(600, 'x') + " with spaces, and commas\"  '/opt/Xilinx/bin/vivado_lab'";
+
+    measure("tokenizer.parse_views.manifest", manifest.size(), [&]() {tokenizer.parse(manifest, &views);});
+    measure("tokenizer.parse_views.values",   values.size(),   [&]() {tokenizer.parse(values, &views);});
+    measure("tokenizer.parse_strings.values", values.size(),   [&]() {tokenizer.parse(values);});
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// bench_config() - Measures reading the configuration file and looking up its keys
+//=========================================================================================================
+static void bench_config()
+{
+    string filename = scratch + "/smartlynq_static_ip.conf";
+    string cache    = filename + ".cache";
+    struct stat sb;
+
+    stat(filename.c_str(), &sb);
+
+    // Parse the file from scratch every time
+    measure("config.read", sb.st_size, [&]()
+    {
+        CConfigFile cf;
+        cf.read(filename);
+    });
+
+    // Read the file through its binary cache
+    {
+        CConfigFile cf;
+        cf.set_cache_file(cache);
+        cf.read(filename);
+        cf.write_cache();
+    }
+    measure("config.read_cached", sb.st_size, [&]()
+    {
+        CConfigFile cf;
+        cf.set_cache_file(cache);
+        cf.read(filename);
+    });
+
+    // Look up keys in a file that has already been read
+    CConfigFile cf;
+    cf.read(filename);
+    string  text;
+    int32_t value;
+    vector<string> script;
+    measure("config.exists",             0, [&]() {cf.exists("station_key_150");});
+    measure("config.exists_missing",     0, [&]() {cf.exists("no_such_key");});
+    measure("config.get_string",         0, [&]() {cf.get("command_line", &text);});
+    measure("config.get_int",            0, [&]() {cf.get("update_timeout", &value);});
+    measure("config.get_typed_int",      0, [&]() {cf.get<int32_t>("update_timeout");});
+    measure("config.get_script_vector",  0, [&]() {cf.get_script_vector("vivado_script", &script);});
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// bench_template() - Measures rendering the Vivado script and config.ini templates
+//=========================================================================================================
+static void bench_template()
+{
+    CConfigFile    cf;
+    vector<string> lines;
+    symtab_t       symbols;
+    size_t         bytes = 0;
+
+    cf.read(scratch + "/smartlynq_static_ip.conf");
+
+    cf.get_script_vector("vivado_script", &lines);
+    vector<CTemplate> script = CTemplate::compile(lines);
+    cf.get_script_vector("config.ini", &lines);
+    vector<CTemplate> ini = CTemplate::compile(lines);
+
+    symbols["%usb_ip%"]            = "10.0.0.2";
+    symbols["%static_ip%"]         = "10.11.12.3";
+    symbols["%gateway_ip%"]        = "10.11.12.1";
+    symbols["%netmask%"]           = "255.255.255.0";
+    symbols["%skip_update%"]       = "";
+    symbols["%unless_configured%"] = "";
+    symbols["%config_ini%"]        = scratch + "/config.ini";
+
+    for (auto& s : CTemplate::render(script, symbols)) bytes += s.size();
+    for (auto& s : CTemplate::render(ini, symbols))    bytes += s.size();
+
+    measure("template.render", bytes, [&]()
+    {
+        CTemplate::render(script, symbols);
+        CTemplate::render(ini, symbols);
+    });
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// bench_write() - Measures writing a typical Vivado script to disk a line at a time, the way libsmartlynq
+//                 writes its temporary files
+//=========================================================================================================
+static void bench_write()
+{
+    vector<string> lines;
+    size_t         bytes = 0;
+
+    for (int i=0; i<64; ++i) lines.push_back("puts \"SMARTLYNQ_PHASE step_" + to_string(i) + "\"; set x_" + to_string(i) + " [expr {" + to_string(i) + " * 2}]");
+    for (auto& s : lines) bytes += s.size() + 1;
+
+    string filename = scratch + "/script.tcl";
+    measure("script.write", bytes, [&]()
+    {
+        ofstream ofile(filename);
+        for (auto& s : lines) ofile << s << "\n";
+    });
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// bench_e2e() - Runs smartlynq_static_ip against the stub Vivado, end to end
+//=========================================================================================================
+static void bench_e2e()
+{
+    CProcess       process;
+    vector<string> output;
+
+    // Build the manifest for the parallel run
+    string manifest;
+    for (int i=0; i<devices; ++i) manifest += "10.0." + to_string(i / 250) + "." + to_string(i % 250 + 2) + " 10.11.12." + to_string(i % 250 + 2) + "\n";
+    write_file(scratch + "/manifest.txt", manifest);
+
+    // This runs the executable in the scratch directory, and complains if it fails
+    auto run = [&](const string& args)
+    {
+        int status = process.run("cd '" + scratch + "' && '" + exe + "' " + args, &output);
+        if (status != 0)
+        {
+            for (auto& s : output) fprintf(stderr, "%s\n", s.c_str());
+            throw runtime_error("end-to-end run failed: " + args);
+        }
+    };
+
+    measure("e2e.single", 0, [&]() {run("10.0.0.2 10.11.12.3");}, 3);
+    measure("e2e.parallel", 0, [&]() {run("-parallel " + to_string(jobs) + " manifest.txt");}, 3);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// print_json() - Writes the results to stdout as JSON
+//=========================================================================================================
+static void print_json()
+{
+    printf("{\n");
+    printf("  \"suite\": \"smartlynq_static_ip\",\n");
+    printf("  \"vivado\": \"%s\",\n", fakeVivado.empty() ? "shell stub" : "fake_vivado");
+    printf("  \"latency_ms\": %d,\n", latencyMs);
+    printf("  \"devices\": %d,\n", devices);
+    printf("  \"jobs\": %d,\n", jobs);
+    printf("  \"results\": [\n");
+    for (size_t i=0; i<results.size(); ++i)
+    {
+        const result_t& r = results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f", r.name.c_str(), (long)r.iterations, r.ns_per_op);
+        if (r.bytes_per_op) printf(", \"mb_per_s\": %.1f", r.bytes_per_op * 1e3 / r.ns_per_op);
+        printf("}%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+//=========================================================================================================
+
+
+int main(int argc, char** argv)
+{
+    // Parse the command line
+    for (int i=1; i<argc; ++i)
+    {
+        string arg = argv[i];
+        bool   more = (i + 1 < argc);
+        if      (arg == "--exe"         && more) exe       = argv[++i];
+        else if (arg == "--vivado"      && more) fakeVivado = argv[++i];
+        else if (arg == "--latency-ms"  && more) latencyMs = atoi(argv[++i]);
+        else if (arg == "--devices"     && more) devices   = atoi(argv[++i]);
+        else if (arg == "--jobs"        && more) jobs      = atoi(argv[++i]);
+        else if (arg == "--min-time-ms" && more) minTimeMs = atoi(argv[++i]);
+        else if (arg == "--no-e2e")              e2e       = false;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    // The end-to-end benchmarks need an absolute path to the executable
+    if (e2e && exe.empty()) e2e = false;
+    if (e2e)
+    {
+        char* path = realpath(exe.c_str(), NULL);
+        if (path == NULL)
+        {
+            fprintf(stderr, "Can't find %s\n", exe.c_str());
+            return 1;
+        }
+        exe = path;
+        free(path);
+    }
+
+    // So does the fake Vivado
+    if (e2e && !fakeVivado.empty())
+    {
+        char* path = realpath(fakeVivado.c_str(), NULL);
+        if (path == NULL)
+        {
+            fprintf(stderr, "Can't find %s\n", fakeVivado.c_str());
+            return 1;
+        }
+        fakeVivado = path;
+        free(path);
+    }
+
+    try
+    {
+        // Create the scratch directory, the stub Vivado, and the configuration file
+        char dir[] = "/tmp/smartlynq_bench_XXXXXX";
+        if (mkdtemp(dir) == NULL) throw runtime_error("Can't create scratch directory");
+        scratch = dir;
+        make_stub();
+        write_file(scratch + "/smartlynq_static_ip.conf", make_conf());
+
+        // Run the benchmarks
+        bench_tokenizer();
+        bench_config();
+        bench_template();
+        bench_write();
+        if (e2e) bench_e2e();
+
+        // Clean up
+        system(("rm -rf '" + scratch + "'").c_str());
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    print_json();
+    return 0;
+}
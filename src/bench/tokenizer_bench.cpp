@@ -0,0 +1,135 @@
+//=========================================================================================================
+// tokenizer_bench.cpp - Compares the speed of CTokenizer against the original character-at-a-time
+//                       tokenizer on manifest-style and config-style input
+//
+// Build and run with "make tokenizer_bench"
+//=========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "../tokenizer.h"
+using namespace std;
+using namespace std::chrono;
+
+static bool is_eol(char c) {return c == 0 || c == 10 || c == 13;}
+static bool is_ws(char c) {return c == 32 || c == 9;}
+
+
+//=========================================================================================================
+// legacy_parse() - The original tokenizer, which copies each token one character at a time
+//=========================================================================================================
+static vector<string> legacy_parse(const string& input)
+{
+    vector<string> result;
+    string         token;
+    const char*    in = input.c_str();
+
+    while (!is_eol(*in))
+    {
+        token.clear();
+        while (is_ws(*in)) in++;
+        if (is_eol(*in)) break;
+        char in_quotes = 0;
+        if (*in == '"' || *in == '\'') in_quotes = *in++;
+        while (!is_eol(*in))
+        {
+            if (in_quotes)
+            {
+                if (*in == in_quotes)
+                {
+                    ++in;
+                    break;
+                }
+            }
+            else if (is_ws(*in) || *in == ',') break;
+            token += *in++;
+        }
+        result.push_back(token);
+        while (is_ws(*in)) ++in;
+        if (*in == ',') ++in;
+    }
+
+    return result;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// make_lines() - Builds a set of manifest-style or config-style input lines
+//=========================================================================================================
+static vector<string> make_lines(bool config, int count)
+{
+    vector<string> lines;
+    srand(1);
+
+    for (int i=0; i<count; ++i)
+    {
+        if (!config)
+        {
+            lines.push_back("10.0." + to_string(i / 250) + "." + to_string(i % 250) + "   10.11."
+                            + to_string(i / 250) + "." + to_string(i % 250));
+            continue;
+        }
+
+        // Config values: a mix of numbers, lists, and quoted strings, some longer than 512 bytes
+        string line = " " + to_string(rand()) + ", 0x" + to_string(rand() % 1000) + ", on, ";
+        line += "\"" + string(40 + rand() % 1200, 'x') + " with spaces, and commas\"";
+        line += "  '/opt/Xilinx/Vivado_Lab/2021.1/bin/vivado_lab'";
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// run() - Times each tokenizer on a set of lines, and makes sure they agree
+//=========================================================================================================
+static void run(const char* name, const vector<string>& lines, int passes)
+{
+    CTokenizer          tokenizer;
+    vector<string_view> views;
+    size_t              bytes = 0, check = 0;
+
+    for (auto& line : lines) bytes += line.size();
+
+    // Make sure the new tokenizer produces exactly what the old one did
+    for (auto& line : lines)
+    {
+        if (tokenizer.parse(line) != legacy_parse(line))
+        {
+            printf("%s: MISMATCH on \"%s\"\n", name, line.c_str());
+            exit(1);
+        }
+    }
+
+    // This times one tokenizer and reports its throughput
+    auto time = [&](const char* method, auto&& parse_line)
+    {
+        auto start = steady_clock::now();
+        for (int pass=0; pass<passes; ++pass) for (auto& line : lines) check += parse_line(line);
+        double seconds = duration<double>(steady_clock::now() - start).count();
+        printf("  %-8s %-22s %9.1f ns/line %8.1f MB/s\n", name, method,
+               seconds * 1e9 / ((double)passes * lines.size()), (double)passes * bytes / seconds / 1e6);
+    };
+
+    time("legacy (copying)",  [&](const string& s) {return legacy_parse(s).size();});
+    time("CTokenizer strings", [&](const string& s) {return tokenizer.parse(s).size();});
+    time("CTokenizer views",   [&](const string& s) {tokenizer.parse(s, &views); return views.size();});
+
+    if (check == 0) printf("no tokens?\n");
+}
+//=========================================================================================================
+
+
+int main(int argc, char** argv)
+{
+    int passes = (argc > 1) ? atoi(argv[1]) : 20;
+
+    run("manifest", make_lines(false, 50000), passes);
+    run("config",   make_lines(true,  20000), passes);
+    return 0;
+}
@@ -2,34 +2,96 @@
 // config_file.cpp - Implements a parser for configuration/settings files
 //==========================================================================================================
 #include <fstream>
+#include <sstream>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <charconv>
 #include "config_file.h"
 #include "tokenizer.h"
 
 using namespace std;
 
-static double s_to_d(const string& s)  {return strtod(s.c_str(), NULL   );}
+//==========================================================================================================
+// to_double() - Converts a string to a double
+//
+// Returns: 'true' if the entire string was a number
+//==========================================================================================================
+static bool to_double(string_view s, double* p_result)
+{
+    *p_result = 0;
+    if (!s.empty() && s[0] == '+') s.remove_prefix(1);
+    auto rc = from_chars(s.data(), s.data() + s.size(), *p_result);
+    return !s.empty() && rc.ec == errc() && rc.ptr == s.data() + s.size();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// s_to_d() - Converts a string to a double.  A string that isn't a number converts to 0
+//==========================================================================================================
+static double s_to_d(string_view s)
+{
+    double result;
+    to_double(s, &result);
+    return result;
+}
+//==========================================================================================================
 
-static int s_to_i(const string& s)
+
+//==========================================================================================================
+// to_int() - Converts a string to an integer.  Underscores are ignored, a leading "0x" means hex, and
+//            a leading "0" means octal
+//
+// Returns: 'true' if the entire string was a number that fits in an int32_t.  Otherwise, *p_result
+//          is left alone
+//==========================================================================================================
+static bool to_int(string_view s, int32_t* p_result)
 {
-    char buffer[100], *out = buffer;
-    int remaining = sizeof(buffer) - 1;
-    const char* in = s.c_str();
-    while (*in && remaining)
+    char buffer[100] = {}, *out = buffer;
+    long result = 0;
+    int  base = 10;
+
+    // Copy the number, leaving out any underscores
+    for (char c : s) if (c != '_' && out < buffer + sizeof buffer) *out++ = c;
+    const char *in = buffer, *end = out;
+
+    // Take note of the sign
+    bool negative = (in < end && *in == '-');
+    if (in < end && (*in == '-' || *in == '+')) ++in;
+
+    // Figure out the base from the prefix
+    if (end - in > 1 && in[0] == '0' && (in[1] == 'x' || in[1] == 'X'))
     {
-        if (*in != '_')
-        {
-            *out++ = *in;
-            --remaining;
-        }
-        ++in;
+        base = 16;
+        in += 2;
     }
-    *out = 0;
-    return strtol(buffer, NULL, 0);
+    else if (end - in > 1 && in[0] == '0') base = 8;
+
+    // Convert the digits, and make sure the number fits before narrowing it
+    auto rc = from_chars(in, end, result, base);
+    if (in == end || rc.ec != errc() || rc.ptr != end) return false;
+    if (negative) result = -result;
+    if (result < INT32_MIN || result > INT32_MAX) return false;
+    *p_result = result;
+    return true;
 }
+//==========================================================================================================
 
-static CTokenizer tokenizer;
+
+//==========================================================================================================
+// s_to_i() - Converts a string to an integer.  A string that isn't a number converts to 0
+//==========================================================================================================
+static int s_to_i(string_view s)
+{
+    int32_t result = 0;
+    to_int(s, &result);
+    return result;
+}
+//==========================================================================================================
 
 //==========================================================================================================
 // make_lower() - Converts a std::string to lower-case
@@ -47,36 +109,57 @@ static void make_lower(string& s)
 
 
 //==========================================================================================================
-// parse_bool() - Returns true if the indicated string is a non-zero number or the string "true"
+// to_lower() - Returns the lower-case version of an ASCII character
+//==========================================================================================================
+static char to_lower(char c) {return (c >= 'A' && c <= 'Z') ? (c | 32) : c;}
 //==========================================================================================================
-static bool parse_bool(const char* in)
+
+
+//==========================================================================================================
+// same_name() - Compares two strings without regard to case
+//==========================================================================================================
+static bool same_name(string_view a, string_view b)
 {
-    // A non-zero numeric value always means 'true'
-    if (*in >= '1' && *in <= '9') return true;
+    if (a.size() != b.size()) return false;
+    for (size_t i=0; i<a.size(); ++i) if (to_lower(a[i]) != to_lower(b[i])) return false;
+    return true;
+}
+//==========================================================================================================
+
 
-    // Get a lower-case version of the input string
-    string s = in;
-    make_lower(s);
+//==========================================================================================================
+// hash_name() - Returns a hash of a string that doesn't depend on case
+//==========================================================================================================
+static uint64_t hash_name(string_view s)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (char c : s) hash = (hash ^ (unsigned char)to_lower(c)) * 0x100000001B3ULL;
+    return hash;
+}
+//==========================================================================================================
 
-    // The word "true" always means 'true'
-    if (s == "true") return true;
 
-    // The word "on" always means 'true'
-    if (s == "on") return true;
+//==========================================================================================================
+// parse_bool() - Returns true if the indicated string is a non-zero number or the string "true"
+//==========================================================================================================
+static bool parse_bool(string_view s)
+{
+    // A non-zero numeric value always means 'true'
+    if (!s.empty() && s[0] >= '1' && s[0] <= '9') return true;
 
-    // Anything else means 'false'
-    return false;
+    // The words "true" and "on" always mean 'true'.  Anything else means 'false'
+    return same_name(s, "true") || same_name(s, "on");
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// decode() - Converts a std::string into some other type
+// decode() - Converts a string into some other type
 //==========================================================================================================
-static void decode(const string& s, int32_t *p_result) {*p_result = (int32_t)s_to_i(s);}
-static void decode(const string& s, double  *p_result) {*p_result = s_to_d(s);}
-static void decode(const string& s, string  *p_result) {*p_result = s;}
-static void decode(const string& s, bool    *p_result) {*p_result = parse_bool(s.c_str());}
+static void decode(string_view s, int32_t *p_result) {*p_result = (int32_t)s_to_i(s);}
+static void decode(string_view s, double  *p_result) {*p_result = s_to_d(s);}
+static void decode(string_view s, string  *p_result) {*p_result = s;}
+static void decode(string_view s, bool    *p_result) {*p_result = parse_bool(s);}
 //==========================================================================================================
 
 
@@ -90,7 +173,7 @@ static void decode(const string& s, bool    *p_result) {*p_result = parse_bool(s
 //==========================================================================================================
 static string parse_to_delimeter(const char* in, char delimeter)
 {
-    char token[512], *out = token;
+    string token;
 
     // Skip past any leading spaces
     while (*in == ' ') ++in;
@@ -105,12 +188,9 @@ static string parse_to_delimeter(const char* in, char delimeter)
         if (c >= 'A' && c <= 'Z') c |= 32;
 
         // Append the character to the output string
-        *out++ = c;
+        token += (char)c;
     }
 
-    // nul-terminate the output string
-    *out = 0;
-
     // Hand the caller the token
     return token;
 }
@@ -118,44 +198,112 @@ static string parse_to_delimeter(const char* in, char delimeter)
 
 
 
+//==========================================================================================================
+// fnv1a() - Returns the 64-bit FNV-1a hash of a string
+//==========================================================================================================
+static uint64_t fnv1a(const string& s)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char c : s) hash = (hash ^ c) * 0x100000001B3ULL;
+    return hash;
+}
+//==========================================================================================================
+
+
 //==========================================================================================================
 // Call this to read the config file.  Returns 'true' on success, 'false' if file not found
 //
 // On Exit: m_specs = a container that maps a key-string to a vector of strings.
 //                    That vector of strings is either individual tokens, or in the case of a script
 //                    spec is a vector of untokenized lines
+//
+// If there is a cache file that was made from this exact config file, m_specs is loaded from the cache
+// instead of parsing the config file.  Otherwise, the config file is parsed, and "write_cache()" can be
+// called to rewrite the cache
 //==========================================================================================================
 bool CConfigFile::read(string filename, bool msg_on_fail)
 {
-    char     line[1000], *p;
-    strvec_t values;
-    string   base_key_name, scoped_key_name;
-    
-    // We are not currently parsing a script
-    bool in_script = false;
-
-    // This will contain the current [section_name] being parsed
-    string parsing_section;
+    struct stat sb;
+    identity_t  identity;
+    string      text;
 
     // Open the input file
-    FILE* ifile = fopen(filename.c_str(), "r");
+    ifstream ifile(filename, ios::binary);
 
     // If the input file couldn't be opened, complain about it
-    if (ifile == NULL)
+    if (!ifile.is_open() || stat(filename.c_str(), &sb) != 0)
     {
         if (msg_on_fail) printf("Failed to open file \"%s\"\n", filename.c_str());
         return false; 
     }       
 
-    // Loop through every line of the input file...
-    while (fgets(line, sizeof line, ifile))
+    // This is what identifies this exact config file.  The hash of its contents is only worked out
+    // once we need it (0 = not yet)
+    identity.size       = sb.st_size;
+    identity.mtime_sec  = sb.st_mtim.tv_sec;
+    identity.mtime_nsec = sb.st_mtim.tv_nsec;
+    identity.hash       = 0;
+
+    // If the cache was made from this exact config file, we don't need to parse it
+    if (!m_cache_file.empty() && load_cache(filename, ifile, identity, text)) return true;
+
+    // Read in the entire file, unless checking the cache already did
+    if (identity.hash == 0)
     {
+        stringstream buffer;
+        buffer << ifile.rdbuf();
+        text = buffer.str();
+        identity.size = text.size();
+        identity.hash = fnv1a(text);
+    }
+
+    // Parse the config file
+    parse(text);
+
+    // And remember what we parsed, in case the caller wants it cached for next time
+    m_parsed_file     = filename;
+    m_parsed_identity = identity;
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parse() - Parses the text of a config file into m_specs.  Lines may be of any length
+//==========================================================================================================
+void CConfigFile::parse(const string& text)
+{
+    string   line;
+    strvec_t values;
+    vector<string_view> tokens;
+    CTokenizer tokenizer;
+    string   base_key_name, key_section;
+    size_t   start = 0;
+    const char* p;
+
+    // We are not currently parsing a script
+    bool in_script = false;
+
+    // This will contain the current [section_name] being parsed
+    string parsing_section;
+
+    // Loop through every line of the input text...
+    while (start < text.size())
+    {
+        // Fetch the next line
+        size_t eol = text.find('\n', start);
+        if (eol == string::npos) eol = text.size();
+        line.assign(text, start, eol - start);
+        start = eol + 1;
+
         // Chomp any end of line characters off the end of the line
-        p = strchr(line, 10); if (p) *p = 0;
-        p = strchr(line, 13); if (p) *p = 0;
-        
+        size_t cr = line.find('\r');
+        if (cr != string::npos) line.erase(cr);
+
         // Find the first non-space character in the line
-        p = line;
+        p = line.c_str();
         while (*p == ' ') ++p;
 
         // If the line is blank or is a comment, ignore it
@@ -179,7 +327,7 @@ bool CConfigFile::read(string filename, bool msg_on_fail)
         // If this is the end of a script, save the list of lines into our specs
         if (*p == '}')
         {
-            if (in_script) m_specs[scoped_key_name] = values;
+            if (in_script) add_spec(key_section, base_key_name, values);
             in_script = false;
             continue;            
         }
@@ -194,153 +342,658 @@ bool CConfigFile::read(string filename, bool msg_on_fail)
         // Fetch the base name of this key 
         base_key_name = parse_to_delimeter(p, '=');
 
-        // Create the fully scoped name of this key
-        scoped_key_name = parsing_section + "::" + base_key_name;
+        // This key belongs to the section we're parsing
+        key_section = parsing_section;
 
         // We start out without a list of values for this key
-        values.clear();
+        tokens.clear();
 
         // Find the equal sign on this line
         p = strchr(p, '=');
 
-        // If it exists, parse the rest of the line after an '=' into a vector of string tokens    
-        if (p) values = tokenizer.parse(p+1);
+        // If it exists, parse the rest of the line after an '=' into a vector of tokens    
+        if (p) tokenizer.parse(p+1, &tokens);
 
         // Add this configuration spec to our master list of config specs
-        m_specs[scoped_key_name] = values;
-       
+        add_spec(key_section, base_key_name, tokens);
     }
+}
+//==========================================================================================================
 
-    // We're done with the input file
-    fclose(ifile);
 
-    // Tell the caller that all is well
+//==========================================================================================================
+// The cache file is a binary image of m_specs.  It is mapped into memory, and its strings are used right
+// where they lie rather than being copied.  All integers are native-endian, and all offsets are from the
+// start of the file:
+//
+//     cache_header_t
+//     The name of the config file                   (header.path_length bytes, padded to a multiple of 4)
+//     cache_spec_t  for each spec                   (header.spec_count of them)
+//     cache_string_t for each value of every spec   (header.value_count of them)
+//     The text of every key and value               (header.pool_size bytes)
+//==========================================================================================================
+static const char CACHE_MAGIC[8] = {'S','L','Q','C','O','N','F','2'};
+
+// The tables that follow the name of the config file are aligned on this boundary
+static uint64_t align4(uint64_t n) {return (n + 3) & ~3ULL;}
+
+struct cache_header_t
+{
+    char     magic[8];
+    uint64_t size;
+    int64_t  mtime_sec, mtime_nsec;
+    uint64_t hash;
+    uint32_t path_length, spec_count, value_count, pool_size;
+};
+
+struct cache_string_t {uint32_t offset, length;};
+
+struct cache_spec_t
+{
+    cache_string_t section, key;
+    uint32_t       first_value, value_count;
+};
+//==========================================================================================================
+
+
+//==========================================================================================================
+// load_cache() - Loads m_specs from the cache file
+//
+// Passed:  filename = The name of the config file
+//          ifile    = The config file, open and not yet read
+//          identity = The identity of the config file, without its hash
+//          text     = Receives the contents of the config file, if they had to be read
+//
+// Returns: 'true' if m_specs was loaded.  'false' if the cache doesn't exist, is damaged, or was made
+//          from a different config file
+//
+// The cache's name, size and modification time are checked first.  Only if they match is the config file
+// read and hashed (filling in "text" and identity.hash) to make sure that its contents haven't changed.
+//
+// The cache stays mapped for the life of this object, and the names and values of the specs are views of
+// its string pool.  The cache is only ever replaced by renaming a new file over it, so the mapping can't
+// change underneath us
+//==========================================================================================================
+bool CConfigFile::load_cache(const string& filename, ifstream& ifile, identity_t& identity, string& text)
+{
+    struct stat sb;
+
+    // Open the cache file and map it into memory
+    int fd = open(m_cache_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    if (fstat(fd, &sb) != 0 || sb.st_size < (off_t)sizeof(cache_header_t))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = sb.st_size;
+    void*  image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return false;
+
+    // From here on, the image is unmapped when the last view of it goes away
+    shared_ptr<const char> mapping((const char*)image, [size](const char* p) {munmap((void*)p, size);});
+
+    // Get handy pointers to the pieces of the image
+    const char*           base   = mapping.get();
+    const cache_header_t& header = *(const cache_header_t*)base;
+    const char*           path   = base + sizeof(header);
+    size_t specs_at  = sizeof(header) + align4(header.path_length);
+    size_t values_at = specs_at  + (uint64_t)header.spec_count  * sizeof(cache_spec_t);
+    size_t pool_at   = values_at + (uint64_t)header.value_count * sizeof(cache_string_t);
+
+    // This checks that a string lies entirely within the string pool
+    auto valid = [&](const cache_string_t& s) {return (uint64_t)s.offset + s.length <= header.pool_size;};
+
+    // The cache is only good if it is intact, and was made from a config file with this name, size and
+    // modification time.  That's cheap to check, so check it before looking at the config file's contents
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0
+    ||  header.size       != identity.size
+    ||  header.mtime_sec  != identity.mtime_sec
+    ||  header.mtime_nsec != identity.mtime_nsec
+    ||  pool_at + (uint64_t)header.pool_size != size
+    ||  sizeof(header) + (uint64_t)header.path_length > size
+    ||  filename.compare(0, string::npos, path, header.path_length) != 0) return false;
+
+    // The config file looks the same, so make sure that its contents really are
+    stringstream buffer;
+    buffer << ifile.rdbuf();
+    text = buffer.str();
+    identity.size = text.size();
+    identity.hash = fnv1a(text);
+    if (header.size != identity.size || header.hash != identity.hash) return false;
+
+    const cache_spec_t*   spec  = (const cache_spec_t*)(base + specs_at);
+    const cache_string_t* value = (const cache_string_t*)(base + values_at);
+    const char*           pool  = base + pool_at;
+
+    // This fetches a string from the string pool
+    auto view = [&](const cache_string_t& s) {return string_view(pool + s.offset, s.length);};
+
+    // Make sure that every spec and every string lies within the image
+    for (uint32_t i=0; i<header.spec_count; ++i)
+    {
+        if (!valid(spec[i].section) || !valid(spec[i].key)
+        ||  (uint64_t)spec[i].first_value + spec[i].value_count > header.value_count) return false;
+    }
+    for (uint32_t i=0; i<header.value_count; ++i) if (!valid(value[i])) return false;
+
+    // Build the name and spec indexes straight over the string pool.  There's nothing to parse or copy
+    for (uint32_t i=0; i<header.spec_count; ++i)
+    {
+        values_t& values = spec_values(intern_stored(view(spec[i].section)), intern_stored(view(spec[i].key)));
+        values.clear();
+        values.reserve(spec[i].value_count);
+        for (uint32_t j=0; j<spec[i].value_count; ++j) values.push_back(view(value[spec[i].first_value + j]));
+    }
+
+    // The views we just made must outlive the image
+    m_images.push_back(mapping);
     return true;
 }
 //==========================================================================================================
 
 
-
 //==========================================================================================================
-// set_current_section() - Sets the section-name to look for keys in
+// write_cache() - Writes the cache file, if "read()" had to parse the config file because the cache was
+//                 missing or out of date
 //==========================================================================================================
-void  CConfigFile::set_current_section(string section)
+void CConfigFile::write_cache()
 {
-    m_current_section = section;
-    make_lower(m_current_section);
+    if (m_cache_file.empty() || m_parsed_file.empty()) return;
+    save_cache(m_parsed_file, m_parsed_identity);
+    m_parsed_file.clear();
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// dump_specs() - Displays the m_specs map in human-readable form for debugging
+// save_cache() - Saves m_specs to the cache file
+//
+// Passed:  filename = The name of the config file
+//          identity = The identity of the config file
+//
+// The cache is written to a temporary file that is then renamed, so a reader never sees a partial cache.
+// If the cache can't be written, that's not an error; the config file will just be parsed next time
 //==========================================================================================================
-void CConfigFile::dump_specs()
+void CConfigFile::save_cache(const string& filename, const identity_t& identity)
 {
-    map<string, strvec_t>::iterator it;
+    cache_header_t         header;
+    vector<cache_spec_t>   specs;
+    vector<cache_string_t> values;
+    string                 pool;
 
-    // Loop through every entry in our map....
-    for (it=m_specs.begin(); it != m_specs.end(); ++it)
+    // This adds a string to the string pool
+    auto add = [&](string_view s) -> cache_string_t
     {
-        // Get a convenient reference to string-vector in this entry
-        strvec_t& v = it->second;
+        cache_string_t result = {(uint32_t)pool.size(), (uint32_t)s.size()};
+        pool += s;
+        return result;
+    };
 
-        // Display this item's key
-        printf("Key \"%s\"\n", it->first.c_str());
-        
-        // Display every value associated with this item
-        for (int i=0; i<v.size(); ++i) printf("   \"%s\"\n", v[i].c_str());
+    // Build the tables that describe each spec and its values
+    for (auto& it : m_specs)
+    {
+        cache_spec_t spec;
+        spec.section     = add(m_names[it.section]);
+        spec.key         = add(m_names[it.key]);
+        spec.first_value = values.size();
+        spec.value_count = it.values.size();
+        for (auto& v : it.values) values.push_back(add(v));
+        specs.push_back(spec);
     }
+
+    // Fill in the header
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC);
+    header.size        = identity.size;
+    header.mtime_sec   = identity.mtime_sec;
+    header.mtime_nsec  = identity.mtime_nsec;
+    header.hash        = identity.hash;
+    header.path_length = filename.size();
+    header.spec_count  = specs.size();
+    header.value_count = values.size();
+    header.pool_size   = pool.size();
+
+    // Write the cache to a temporary file
+    string temp = m_cache_file + "." + to_string(getpid());
+    ofstream ofile(temp, ios::binary | ios::trunc);
+    if (!ofile.is_open()) return;
+    ofile.write((const char*)&header, sizeof header);
+    ofile.write(filename.data(), filename.size());
+    ofile.write("\0\0\0", align4(filename.size()) - filename.size());
+    ofile.write((const char*)specs.data(),  specs.size()  * sizeof(cache_spec_t));
+    ofile.write((const char*)values.data(), values.size() * sizeof(cache_string_t));
+    ofile.write(pool.data(), pool.size());
+    ofile.close();
+
+    // And put it in place
+    if (ofile.fail() || rename(temp.c_str(), m_cache_file.c_str()) != 0) unlink(temp.c_str());
 }
 //==========================================================================================================
 
 
 
 //==========================================================================================================
-// lookup() - Like "exists()", but can throw a runtime_error exception if the key is not found
+// Constructor
 //==========================================================================================================
-bool CConfigFile::lookup(string key, strvec_t *p_result)
+CConfigFile::CConfigFile()
 {
-    // Find out if this key exists
-    bool key_exists = exists(key, p_result);
+    m_throw_on_fail = true;
+    m_block_next    = NULL;
+    m_block_free    = 0;
 
-    // If it exists, we're done
-    if (key_exists) return true;
+    // Name ID 0 is always the global section
+    m_current_section = intern("");
+}
+//==========================================================================================================
 
-    // If it doesn't exist and this should throw an error, do so
-    if (m_throw_on_fail) throw runtime_error("config key '"+key+"' not found");
 
-    // Otherwise, just report the failure via the return value
-    return false;
+//==========================================================================================================
+// store() - Stores a copy of a string where it will never move, and returns a view of the copy
+//
+// Strings are packed into large blocks of memory.  A block is never reallocated or freed until this
+// object is destroyed, so every view that we hand out stays valid
+//==========================================================================================================
+string_view CConfigFile::store(string_view s)
+{
+    const size_t BLOCK_SIZE = 64 * 1024;
+
+    // An empty string doesn't need any storage
+    if (s.empty()) return string_view();
+
+    // If the newest block doesn't have room for this string, allocate a new block
+    if (s.size() > m_block_free)
+    {
+        size_t size = max(BLOCK_SIZE, s.size());
+        m_blocks.emplace_back(new char[size]);
+        m_block_next = m_blocks.back().get();
+        m_block_free = size;
+    }
+
+    // Copy the string into the block
+    memcpy(m_block_next, s.data(), s.size());
+    string_view result(m_block_next, s.size());
+    m_block_next += s.size();
+    m_block_free -= s.size();
+
+    // Hand the caller a view of the copy
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// name_id() - Returns the ID of a name that has already been interned, or NO_NAME.  Case doesn't matter
+//==========================================================================================================
+CConfigFile::name_id_t CConfigFile::name_id(string_view name) const
+{
+    size_t mask = m_name_index.size() - 1;
+
+    // Probe the hash index until we find the name or an empty slot
+    for (size_t slot = hash_name(name) & mask; m_name_index[slot]; slot = (slot + 1) & mask)
+    {
+        name_id_t id = m_name_index[slot] - 1;
+        if (same_name(m_names[id], name)) return id;
+    }
+
+    // If we get here, this name has never been interned
+    return NO_NAME;
 }
 //==========================================================================================================
 
 
+//==========================================================================================================
+// intern() - Returns the ID of a section or key name, adding it to our list of names if needed
+//==========================================================================================================
+CConfigFile::name_id_t CConfigFile::intern(string_view name)
+{
+    // If the name has already been interned, hand the caller its ID
+    if (!m_name_index.empty())
+    {
+        name_id_t id = name_id(name);
+        if (id != NO_NAME) return id;
+    }
+
+    // Names are always stored in lower-case
+    string lower(name);
+    make_lower(lower);
 
+    // Store the name and hand the caller its ID
+    return intern_stored(store(lower));
+}
 //==========================================================================================================
-// exists() - Checks to see if a given key exists in our spec-map and optionally retrieves the values
-//
-// Passed: key      = Key to look up.   Can optionally be fully scoped
-//         p_result = A pointer to the strvec where the specified key's values should be stored
+
+
+//==========================================================================================================
+// intern_stored() - Like "intern()", but for a lower-case name that is already in storage that will never
+//                   move, so that it can be used without being copied
+//==========================================================================================================
+CConfigFile::name_id_t CConfigFile::intern_stored(string_view name)
+{
+    // If the name has already been interned, hand the caller its ID
+    if (!m_name_index.empty())
+    {
+        name_id_t id = name_id(name);
+        if (id != NO_NAME) return id;
+    }
+
+    // Add the name to our list of names, and to the hash index
+    m_names.push_back(name);
+    rebuild_name_index();
+
+    // Hand the caller the ID of the new name
+    return m_names.size() - 1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// rebuild_name_index() - Makes sure the name index has room for every name, and that every name is in it
 //
-// Returns: true if that key exists in our map, otherwise false
+// The index is kept no more than half full.  If it's still big enough, only the newest name is added
+//==========================================================================================================
+void CConfigFile::rebuild_name_index()
+{
+    size_t count = m_names.size();
+    size_t first = count - 1;
+
+    // If the index is getting full, double its size and add every name to it
+    if (count * 2 > m_name_index.size())
+    {
+        m_name_index.assign(max<size_t>(64, m_name_index.size() * 2), 0);
+        first = 0;
+    }
+
+    // Add the names to the index
+    size_t mask = m_name_index.size() - 1;
+    for (size_t id = first; id < count; ++id)
+    {
+        size_t slot = hash_name(m_names[id]) & mask;
+        while (m_name_index[slot]) slot = (slot + 1) & mask;
+        m_name_index[slot] = id + 1;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// spec_slot() - Returns the hash index slot where the search for a section/key pair begins
+//==========================================================================================================
+static size_t spec_slot(uint32_t section, uint32_t key, size_t mask)
+{
+    uint64_t pair = ((uint64_t)section << 32) | key;
+    return (pair * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// spec_index() - Returns the index into m_specs of the spec with this section and key, or -1
+//==========================================================================================================
+int CConfigFile::spec_index(name_id_t section, name_id_t key) const
+{
+    if (m_spec_index.empty() || section == NO_NAME || key == NO_NAME) return -1;
+
+    size_t mask = m_spec_index.size() - 1;
+    for (size_t slot = spec_slot(section, key, mask); m_spec_index[slot]; slot = (slot + 1) & mask)
+    {
+        const spec_t& spec = m_specs[m_spec_index[slot] - 1];
+        if (spec.section == section && spec.key == key) return m_spec_index[slot] - 1;
+    }
+
+    return -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// rebuild_spec_index() - Makes sure the spec index has room for every spec, and that every spec is in it
+//==========================================================================================================
+void CConfigFile::rebuild_spec_index()
+{
+    size_t count = m_specs.size();
+    size_t first = count - 1;
+
+    // If the index is getting full, double its size and add every spec to it
+    if (count * 2 > m_spec_index.size())
+    {
+        m_spec_index.assign(max<size_t>(64, m_spec_index.size() * 2), 0);
+        first = 0;
+    }
+
+    // Add the specs to the index
+    size_t mask = m_spec_index.size() - 1;
+    for (size_t i = first; i < count; ++i)
+    {
+        size_t slot = spec_slot(m_specs[i].section, m_specs[i].key, mask);
+        while (m_spec_index[slot]) slot = (slot + 1) & mask;
+        m_spec_index[slot] = i + 1;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// add_spec() - Adds a spec, replacing any existing spec with the same section and key
 //
-// This routine will never throw an exception.   If you need a version that throws an exception when
-// the key isn't found, try "lookup"
+// Passed:  section = The name of the section the spec belongs to ("" for the global section)
+//          key     = The name of the spec
+//          values  = The values of the spec.  These are copied into our own storage
 //==========================================================================================================
-bool CConfigFile::exists(string key, strvec_t *p_result)
+template <class T>
+void CConfigFile::add_spec(string_view section, string_view key, const vector<T>& values)
 {
-    // An iterator to our specs-map
-    map<string, strvec_t>::iterator it;
+    values_t& v = spec_values(intern(section), intern(key));
 
-    // Convert the key to lower-case
-    make_lower(key);
+    // Store the values
+    v.clear();
+    v.reserve(values.size());
+    for (auto& s : values) v.push_back(store(s));
+}
+//==========================================================================================================
 
-    // If the caller gave us a pointer to a result vector, clear it
-    if (p_result) p_result->clear();
 
-    // If the caller gave us a fully-scoped name...
-    if (key.find("::") != string::npos)
+//==========================================================================================================
+// spec_values() - Returns the values of the spec with this section and key, creating the spec (with no
+//                 values) if it doesn't exist yet
+//==========================================================================================================
+CConfigFile::values_t& CConfigFile::spec_values(name_id_t section, name_id_t key)
+{
+    // Find the existing spec with this name, or create a new one
+    int index = spec_index(section, key);
+    if (index < 0)
     {
-        // Do we have a key by that name?
-        it = m_specs.find(key);
-        
-        // If we have the specified key...
-        if (it != m_specs.end())
-        {
-            // If the caller wants the associated values, hand them to him
-            if (p_result) *p_result = it->second;
-        
-            // Tell the caller that his key existed
-            return true;
-        }
+        m_specs.push_back({section, key, {}});
+        rebuild_spec_index();
+        index = m_specs.size() - 1;
+    }
 
-        // If we get here, the fully-scoped key wasn't found in our map
-        return false;
+    return m_specs[index].values;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// fetch() - Fetches the value of a key that is described by a schema, making sure it has the right type
+//
+// Passed:  key      = The name of the key
+//          required = If true, the key must exist
+//          p_result = Where to store the value.  If the key doesn't exist, this is left alone
+//
+// Returns: 'true' if the key exists
+//
+// Throws a runtime_error if the key is required and doesn't exist, or if its value is the wrong type
+//==========================================================================================================
+const CConfigFile::values_t* CConfigFile::fetch_values(string_view key, bool required, const char* type)
+{
+    // Find the key
+    const values_t* values = find(key);
+
+    // If it doesn't exist, that's only a problem if it's required
+    if (values == NULL)
+    {
+        if (required) throw runtime_error("config key '"+string(key)+"' not found");
+        return NULL;
     }
 
-    // Does the current section have a key by that name?
-    it = m_specs.find(m_current_section + "::" + key);
-        
-    // If that fully-scoped key exists, tell the caller
-    if (it != m_specs.end())
+    // A key that isn't a script must have exactly one value
+    if (type && values->size() != 1)
     {
-        if (p_result) *p_result = it->second;
-        return true;
+        throw runtime_error("config key '"+string(key)+"' must be a single " + type);
     }
 
-    // Does the global section have a key by that name?
-    it = m_specs.find("::" + key);
+    // Hand the caller the values of the key
+    return values;
+}
+
+bool CConfigFile::fetch(string_view key, bool required, int32_t* p_result)
+{
+    const values_t* values = fetch_values(key, required, "integer");
+    if (values == NULL) return false;
+    if (!to_int((*values)[0], p_result)) throw runtime_error("config key '"+string(key)+"' must be a 32-bit integer");
+    return true;
+}
+
+bool CConfigFile::fetch(string_view key, bool required, double* p_result)
+{
+    const values_t* values = fetch_values(key, required, "number");
+    if (values == NULL) return false;
+    if (!to_double((*values)[0], p_result)) throw runtime_error("config key '"+string(key)+"' must be a number");
+    return true;
+}
+
+bool CConfigFile::fetch(string_view key, bool required, bool* p_result)
+{
+    int32_t value;
+    const values_t* values = fetch_values(key, required, "boolean");
+    if (values == NULL) return false;
+    string_view s = (*values)[0];
+    if (same_name(s, "true") || same_name(s, "on"))
+        *p_result = true;
+    else if (same_name(s, "false") || same_name(s, "off"))
+        *p_result = false;
+    else if (to_int(s, &value))
+        *p_result = (value != 0);
+    else
+        throw runtime_error("config key '"+string(key)+"' must be true, false, on, off, or a number");
+    return true;
+}
+
+bool CConfigFile::fetch(string_view key, bool required, string* p_result)
+{
+    const values_t* values = fetch_values(key, required, "string");
+    if (values == NULL) return false;
+    *p_result = (*values)[0];
+    return true;
+}
+
+bool CConfigFile::fetch(string_view key, bool required, vector<string>* p_result)
+{
+    const values_t* values = fetch_values(key, required, NULL);
+    if (values == NULL) return false;
+    p_result->assign(values->begin(), values->end());
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// set_current_section() - Sets the section-name to look for keys in
+//==========================================================================================================
+void  CConfigFile::set_current_section(string section)
+{
+    m_current_section = intern(section);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// dump_specs() - Displays the m_specs in human-readable form for debugging
+//==========================================================================================================
+void CConfigFile::dump_specs()
+{
+    // Loop through every spec....
+    for (auto& spec : m_specs)
+    {
+        // Display this item's key
+        string_view section = m_names[spec.section], key = m_names[spec.key];
+        printf("Key \"%.*s::%.*s\"\n", (int)section.size(), section.data(), (int)key.size(), key.data());
         
-    // If that globally-scoped key exists, tell the caller
-    if (it != m_specs.end())
+        // Display every value associated with this item
+        for (auto& v : spec.values) printf("   \"%.*s\"\n", (int)v.size(), v.data());
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find() - Fetches the values of the spec with this section and key
+//
+// Returns: A pointer to the values, or NULL if there is no such spec
+//==========================================================================================================
+const CConfigFile::values_t* CConfigFile::find(name_id_t section, name_id_t key) const
+{
+    int index = spec_index(section, key);
+    return (index < 0) ? NULL : &m_specs[index].values;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find() - Fetches the values of the spec with this key in the current section, or if there isn't one,
+//          in the global section
+//
+// Returns: A pointer to the values, or NULL if there is no such spec
+//==========================================================================================================
+const CConfigFile::values_t* CConfigFile::find(name_id_t key) const
+{
+    const values_t* result = find(m_current_section, key);
+    return result ? result : find(0, key);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find() - Fetches the values of the spec with this key, which can optionally be fully scoped
+//
+// Returns: A pointer to the values, or NULL if there is no such spec
+//
+// This routine will never throw an exception.   If you need a version that throws an exception when
+// the key isn't found, try "lookup"
+//==========================================================================================================
+const CConfigFile::values_t* CConfigFile::find(string_view key) const
+{
+    // If the caller gave us a fully-scoped name, look in exactly that section
+    size_t colons = key.find("::");
+    if (colons != string_view::npos)
     {
-        if (p_result) *p_result = it->second;
-        return true;
+        return find(name_id(key.substr(0, colons)), name_id(key.substr(colons + 2)));
     }
 
-    // Tell the caller that we couldn't find that key in our specs
-    return false;
+    // Otherwise, look in the current section and then in the global section
+    name_id_t id = name_id(key);
+    return (id == NO_NAME) ? NULL : find(id);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// lookup() - Like "find()", but can throw a runtime_error exception if the key is not found
+//==========================================================================================================
+const CConfigFile::values_t* CConfigFile::lookup(string_view key)
+{
+    // Find out if this key exists
+    const values_t* values = find(key);
+
+    // If it exists, we're done
+    if (values) return values;
+
+    // If it doesn't exist and this should throw an error, do so
+    if (m_throw_on_fail) throw runtime_error("config key '"+string(key)+"' not found");
+
+    // Otherwise, just report the failure via the return value
+    return NULL;
 }
 //==========================================================================================================
 
@@ -353,7 +1006,6 @@ bool CConfigFile::exists(string key, strvec_t *p_result)
 bool CConfigFile::get(string key, string fmt, void* p1, void* p2, void* p3, void* p4, void* p5
                                             , void* p6, void* p7, void* p8, void* p9)
 {
-    strvec_t  values;
     char      format = 'i';
     const int field_count = 9;
 
@@ -367,7 +1019,8 @@ bool CConfigFile::get(string key, string fmt, void* p1, void* p2, void* p3, void
     int format_index = -1;
 
     // Fetch the values assocated with this key
-    if (!lookup(key, &values)) return false;
+    const values_t* values = lookup(key);
+    if (values == NULL) return false;
 
     // Loop through each value associated with this key
     for (int i=0; i<field_count; ++i)
@@ -382,7 +1035,7 @@ bool CConfigFile::get(string key, string fmt, void* p1, void* p2, void* p3, void
         if (++format_index < format_count) format = fmt[format_index];
 
         // Fetch the next value for this key, being sure to not run off the end of the vector
-        string value = (i >= values.size()) ? "" : values[i].c_str();
+        string_view value = (i >= values->size()) ? string_view() : (*values)[i];
 
         // Parse this value into the appropriate data type in the caller's output field 
         switch(format)
@@ -446,121 +1099,43 @@ bool CConfigFile::get(string key, bool* p1, bool* p2, bool* p3, bool* p4, bool*
 
 
 //==========================================================================================================
-// get() - Fetches a vector of values associated with the specified key
+// decode_all() - Decodes every value of a spec into a vector of some other type
 //
-// If key doesn't exist in our map, these either return false, or throw a std::runtime_error
+// If key doesn't exist in our map, this either returns false, or throws a std::runtime_error
 //==========================================================================================================
-bool CConfigFile::get(string key, vector<double> *p_result)
+template <class T> static bool decode_all(const CConfigFile::values_t* values, vector<T>* p_result)
 {
-    double      value;
-    strvec_t    values;
-
     // Clear the caller's result vector
     p_result->clear();
 
-    // Fetch the values assocated with this key
-    if (!lookup(key, &values)) return false;
+    // If there are no values, tell the caller
+    if (values == NULL) return false;
 
-    // For each string value that is associated with this key...
-    for (int i=0; i<values.size(); ++i)
+    // Decode each value into a native value and append it to the caller's result vector
+    p_result->reserve(values->size());
+    for (auto& s : *values)
     {
-        // Get a handy reference to this entry
-        string& s = values[i];
-
-        // Decode the string into a native value
+        T value;
         decode(s, &value);
-
-        // Add append that value to the caller's result vector
         p_result->push_back(value);
     }
 
     // Tell the caller that all is well
     return true;
 }
+//==========================================================================================================
 
-bool CConfigFile::get(string key, vector<int32_t> *p_result)
-{
-    int32_t      value;
-    strvec_t    values;
-
-    // Clear the caller's result vector
-    p_result->clear();
-
-    // Fetch the values assocated with this key
-    if (!lookup(key, &values)) return false;
-
-    // For each string value that is associated with this key...
-    for (int i=0; i<values.size(); ++i)
-    {
-        // Get a handy reference to this entry
-        string& s = values[i];
-
-        // Decode the string into a native value
-        decode(s, &value);
-
-        // Add append that value to the caller's result vector
-        p_result->push_back(value);
-    }
-
-    // Tell the caller that all is well
-    return true;
-}
-
-bool CConfigFile::get(string key, vector<string> *p_result)
-{
-    string      value;
-    strvec_t    values;
-
-    // Clear the caller's result vector
-    p_result->clear();
-
-    // Fetch the values assocated with this key
-    if (!lookup(key, &values)) return false;
-
-    // For each string value that is associated with this key...
-    for (int i=0; i<values.size(); ++i)
-    {
-        // Get a handy reference to this entry
-        string& s = values[i];
-
-        // Decode the string into a native value
-        decode(s, &value);
-
-        // Add append that value to the caller's result vector
-        p_result->push_back(value);
-    }
-
-    // Tell the caller that all is well
-    return true;
-}
-
-bool CConfigFile::get(string key, vector<bool> *p_result)
-{
-    bool        value;
-    strvec_t    values;
-
-    // Clear the caller's result vector
-    p_result->clear();
-
-    // Fetch the values assocated with this key
-    if (!lookup(key, &values)) return false;
-
-    // For each string value that is associated with this key...
-    for (int i=0; i<values.size(); ++i)
-    {
-        // Get a handy reference to this entry
-        string& s = values[i];
-
-        // Decode the string into a native value
-        decode(s, &value);
 
-        // Add append that value to the caller's result vector
-        p_result->push_back(value);
-    }
 
-    // Tell the caller that all is well
-    return true;
-}
+//==========================================================================================================
+// get() - Fetches a vector of values associated with the specified key
+//
+// If key doesn't exist in our map, these either return false, or throw a std::runtime_error
+//==========================================================================================================
+bool CConfigFile::get(string key, vector<double>  *p_result) {return decode_all(lookup(key), p_result);}
+bool CConfigFile::get(string key, vector<int32_t> *p_result) {return decode_all(lookup(key), p_result);}
+bool CConfigFile::get(string key, vector<string>  *p_result) {return decode_all(lookup(key), p_result);}
+bool CConfigFile::get(string key, vector<bool>    *p_result) {return decode_all(lookup(key), p_result);}
 //==========================================================================================================
 
 
@@ -571,16 +1146,15 @@ bool CConfigFile::get(string key, vector<bool> *p_result)
 //==========================================================================================================
 bool CConfigFile::get(string key, CConfigScript* p_script)
 {
-    strvec_t script_lines;
-
     // Make the caller's script empty for the moment
     p_script->make_empty();
 
     // Fetch the values assocated with this key
-    if (!lookup(key, &script_lines)) return false;
+    const values_t* script_lines = lookup(key);
+    if (script_lines == NULL) return false;
 
-    // Fill in the caller's script
-    *p_script = script_lines;
+    // Fill in the caller's script.  This is where the script is split into tokens
+    p_script->assign(*script_lines);
 
     // Tell the caller that all is well
     return true;
@@ -595,16 +1169,15 @@ bool CConfigFile::get(string key, CConfigScript* p_script)
 //==========================================================================================================
 bool CConfigFile::get_script_vector(string key, vector<string>* p_script)
 {
-    strvec_t script_lines;
-
     // Make the caller's script empty for the moment
     p_script->clear();
 
     // Fetch the values assocated with this key
-    if (!lookup(key, &script_lines)) return false;
+    const values_t* script_lines = lookup(key);
+    if (script_lines == NULL) return false;
 
     // Fill in the caller's script
-    *p_script = script_lines;
+    p_script->assign(script_lines->begin(), script_lines->end());
 
     // Tell the caller that all is well
     return true;
@@ -620,13 +1193,95 @@ bool CConfigFile::get_script_vector(string key, vector<string>* p_script)
 //==========================================================================================================
 void CConfigScript::make_empty()
 {
-    m_script.clear();
+    m_text.clear();
+    m_lines.clear();
     m_tokens.clear();
-    m_line_index = m_token_index = 0;
+    rewind();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// assign() - Replaces the script with these lines, and splits each line into tokens
+//==========================================================================================================
+void CConfigScript::assign(const vector<string_view>& lines)
+{
+    vector<string_view> tokens;
+    CTokenizer          tokenizer;
+    size_t              length = 0;
+
+    // Throw away the old script
+    make_empty();
+
+    // Store the text of every line in a single string that won't be resized again
+    for (auto& line : lines) length += line.size();
+    m_text.reserve(length);
+    for (auto& line : lines) m_text.append(line);
+
+    // Split each line into tokens, remembering where each token lies in the text
+    uint32_t offset = 0;
+    m_lines.reserve(lines.size());
+    for (auto& line : lines)
+    {
+        string_view text(m_text.data() + offset, line.size());
+        tokenizer.parse(text, &tokens);
+        m_lines.push_back({offset, (uint32_t)line.size(), (uint32_t)m_tokens.size(), (uint32_t)tokens.size()});
+        for (auto& token : tokens)
+        {
+            m_tokens.push_back({(uint32_t)(token.data() - m_text.data()), (uint32_t)token.size()});
+        }
+        offset += line.size();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// operator=() - Replaces the script with the lines in a string vector
+//==========================================================================================================
+void CConfigScript::operator=(const vector<string>& rhs)
+{
+    assign(vector<string_view>(rhs.begin(), rhs.end()));
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find_token() - Returns the token record for a token on a line, or NULL if there is no such token
+//==========================================================================================================
+const CConfigScript::token_t* CConfigScript::find_token(int line, int index) const
+{
+    if (line < 0 || line >= m_lines.size()) return NULL;
+    if (index < 0 || index >= m_lines[line].token_count) return NULL;
+    return &m_tokens[m_lines[line].first_token + index];
 }
 //==========================================================================================================
 
 
+//==========================================================================================================
+// token_int() - Returns the integer value of a token
+//
+// The value isn't cached in the token, so that a script can be read from several threads at once
+//==========================================================================================================
+int32_t CConfigScript::token_int(const token_t& token) const
+{
+    int32_t value;
+    decode(token_text(token), &value);
+    return value;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// token_float() - Returns the floating-point value of a token
+//==========================================================================================================
+double CConfigScript::token_float(const token_t& token) const
+{
+    double value;
+    decode(token_text(token), &value);
+    return value;
+}
+//==========================================================================================================
 
 
 //==========================================================================================================
@@ -635,20 +1290,20 @@ void CConfigScript::make_empty()
 bool CConfigScript::get_next_line(int *p_token_count, string *p_text)
 {
     // If we're out of script lines, tell the caller
-    if (m_line_index >= m_script.size())
+    if (m_line_index >= m_lines.size())
     {
         if (p_text) *p_text = "";
         return false;
     }
 
-    // If the caller wants the script line, fill in the caller's field
-    if (p_text) *p_text = m_script[m_line_index];
+    // This is the line we're going to fetch tokens from
+    line_t line = (*this)[m_current_line = m_line_index++];
 
-    // Parse this line into tokens
-    m_tokens = tokenizer.parse(m_script[m_line_index++]);
+    // If the caller wants the script line, fill in the caller's field
+    if (p_text) *p_text = line.text();
 
     // If the caller wants to know how many tokens there are, fill in their field
-    if (p_token_count) *p_token_count = m_tokens.size();
+    if (p_token_count) *p_token_count = line.token_count();
 
     // The next call to "get_next_<token|int|float>" will start at the first token
     m_token_index = 0;
@@ -664,11 +1319,13 @@ bool CConfigScript::get_next_line(int *p_token_count, string *p_text)
 //==========================================================================================================
 string CConfigScript::get_next_token(bool force_lowercase)
 {
-    // If there are no more tokens, return an empty string
-    if (m_token_index >= m_tokens.size()) return "";
+    // Fetch the next token.  If there are no more tokens, return an empty string
+    const token_t* p_token = find_token(m_current_line, m_token_index);
+    if (p_token == NULL) return "";
+    ++m_token_index;
 
     // Fetch the result string
-    string token = m_tokens[m_token_index++];
+    string token(token_text(*p_token));
 
     // If this caller wants this token in all lowercase, make it so
     if (force_lowercase) make_lower(token);
@@ -685,19 +1342,13 @@ string CConfigScript::get_next_token(bool force_lowercase)
 //==========================================================================================================
 int32_t CConfigScript::get_next_int()
 {
-    int32_t result;
-
-    // If there are no more tokens, return an empty string
-    if (m_token_index >= m_tokens.size()) return 0;
-
-    // Fetch the result string
-    string token = m_tokens[m_token_index++];
+    // Fetch the next token.  If there are no more tokens, return 0
+    const token_t* p_token = find_token(m_current_line, m_token_index);
+    if (p_token == NULL) return 0;
+    ++m_token_index;
 
-    // Decode the token into an integer
-    decode(token, &result);
-
-    // Hand the result to the caller
-    return result;
+    // Hand the caller the value of the token
+    return token_int(*p_token);
 }
 //==========================================================================================================
 
@@ -708,20 +1359,48 @@ int32_t CConfigScript::get_next_int()
 //==========================================================================================================
 double CConfigScript::get_next_float()
 {
-    double result;
+    // Fetch the next token.  If there are no more tokens, return 0
+    const token_t* p_token = find_token(m_current_line, m_token_index);
+    if (p_token == NULL) return 0;
+    ++m_token_index;
 
-    // If there are no more tokens, return an empty string
-    if (m_token_index >= m_tokens.size()) return 0;
+    // Hand the caller the value of the token
+    return token_float(*p_token);
+}
+//==========================================================================================================
 
-    // Fetch the result string
-    string token = m_tokens[m_token_index++];
 
-    // Decode the token into an double
-    decode(token, &result);
+//==========================================================================================================
+// CConfigScript::line_t - A view of one line of a script
+//==========================================================================================================
+string_view CConfigScript::line_t::text() const
+{
+    if (m_index < 0 || m_index >= m_script->m_lines.size()) return string_view();
+    const line_rec_t& line = m_script->m_lines[m_index];
+    return string_view(m_script->m_text).substr(line.offset, line.length);
+}
 
-    // Hand the result to the caller
-    return result;
+int CConfigScript::line_t::token_count() const
+{
+    if (m_index < 0 || m_index >= m_script->m_lines.size()) return 0;
+    return m_script->m_lines[m_index].token_count;
+}
+
+string_view CConfigScript::line_t::token(int index) const
+{
+    const token_t* p_token = m_script->find_token(m_index, index);
+    return p_token ? m_script->token_text(*p_token) : string_view();
 }
-//==========================================================================================================
 
+int32_t CConfigScript::line_t::get_int(int index) const
+{
+    const token_t* p_token = m_script->find_token(m_index, index);
+    return p_token ? m_script->token_int(*p_token) : 0;
+}
 
+double CConfigScript::line_t::get_float(int index) const
+{
+    const token_t* p_token = m_script->find_token(m_index, index);
+    return p_token ? m_script->token_float(*p_token) : 0;
+}
+//==========================================================================================================
@@ -5,18 +5,66 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include <string_view>
+#include <fstream>
 #include <stdexcept>
-#include <map>
+#include <memory>
+#include <deque>
 
 //----------------------------------------------------------------------------------------------------------
 // CConfigScript() - Provides a convenient interface for parsing script-specs in a config-file
+//
+// A script is split into tokens exactly once, when it is assigned.  After that, lines and tokens can be
+// fetched in order with "get_next_line()" and friends, or at random with "operator[]", or with a
+// range-based for loop.  Reading a script never changes it, so one script can be read by several threads.
 //----------------------------------------------------------------------------------------------------------
 class CConfigScript
 {
 public:
 
+    // A line_t is a view of one line of a script.  It is valid for as long as the script is unchanged
+    class line_t
+    {
+    public:
+
+        // The full text of the line
+        std::string_view text() const;
+
+        // The number of tokens on the line
+        int              token_count() const;
+
+        // These fetch a token from the line.  A token that doesn't exist is "" or 0
+        std::string_view token(int index) const;
+        int32_t          get_int(int index) const;
+        double           get_float(int index) const;
+
+    protected:
+        friend class CConfigScript;
+        line_t(const CConfigScript* script, int index) {m_script = script; m_index = index;}
+        const CConfigScript* m_script;
+        int                  m_index;
+    };
+
+    // An iterator over the lines of the script, so that a script can be used in a range-based for loop
+    class iterator
+    {
+    public:
+        line_t    operator*() const {return line_t(m_script, m_index);}
+        iterator& operator++() {++m_index; return *this;}
+        bool      operator!=(const iterator& rhs) const {return m_index != rhs.m_index;}
+
+    protected:
+        friend class CConfigScript;
+        iterator(const CConfigScript* script, int index) {m_script = script; m_index = index;}
+        const CConfigScript* m_script;
+        int                  m_index;
+    };
+
+    // Default constructor
+    CConfigScript() {make_empty();}
+
     // After reset "get_next_line()" fetches the first line of the script
-    void        rewind() {m_line_index = 0;}
+    void        rewind() {m_line_index = 0; m_current_line = -1; m_token_index = 0;}
 
     // Call this to begin processing the next line of the script
     bool        get_next_line(int *p_token_count = NULL, std::string *p_text = NULL);
@@ -25,47 +73,157 @@ public:
     int32_t     get_next_int();
     double      get_next_float();
 
+    // Random access to the lines of the script.  A line that doesn't exist is empty
+    int         size() const {return m_lines.size();}
+    line_t      operator[](int index) const {return line_t(this, index);}
+
+    // Range-based iteration over the lines of the script
+    iterator    begin() const {return iterator(this, 0);}
+    iterator    end()   const {return iterator(this, size());}
+
     // Call this to erase the script
     void        make_empty();
 
+    // Call this to replace the script with these lines
+    void        assign(const std::vector<std::string_view>& lines);
+
     // Overloading the '=' operator so we can assign a string vector
-    void        operator=(const std::vector<std::string> rhs) {m_script = rhs; rewind();}
+    void        operator=(const std::vector<std::string>& rhs);
 
 protected:
 
+    // A line is a range of m_text, and a range of m_tokens
+    struct line_rec_t {uint32_t offset, length, first_token, token_count;};
+
+    // A token is a range of m_text
+    struct token_t {uint32_t offset, length;};
+
+    // Returns the token record for a token on a line, or NULL if there is no such token
+    const token_t*  find_token(int line, int index) const;
+
+    // Returns the text of a token
+    std::string_view token_text(const token_t& token) const {return std::string_view(m_text).substr(token.offset, token.length);}
+
+    // Returns the numeric value of a token
+    int32_t     token_int(const token_t& token) const;
+    double      token_float(const token_t& token) const;
+
     // This is index of the next line to be fetched via "get_next_line()"
     int         m_line_index;
 
-    // This is the index of the next token to be fetched
+    // This is the index of the line that "get_next_line()" most recently fetched, or -1
+    int         m_current_line;
+
+    // This is the index of the next token to be fetched from the current line
     int         m_token_index;
 
-    // These are the lines of the script
-    std::vector<std::string> m_script, m_tokens;
+    // The text of every line of the script, one after another
+    std::string m_text;
+
+    // The lines of the script, and the tokens of every line
+    std::vector<line_rec_t> m_lines;
+    std::vector<token_t>    m_tokens;
 };
 //----------------------------------------------------------------------------------------------------------
 
 
 
+//----------------------------------------------------------------------------------------------------------
+// CConfigKey - Describes one key of a configuration file: its name, whether it must exist, and the
+//              member of the application's settings struct "S" that its value is stored in.  The type
+//              of the key is the type of that member.
+//
+// An application declares its keys as a constexpr array of these, and hands it to CConfigFile::load().
+// Every key is checked when the file is loaded, so a missing or mistyped key is reported right away
+//----------------------------------------------------------------------------------------------------------
+template <class S> struct CConfigKey
+{
+    enum presence_t {OPTIONAL, REQUIRED};
+    enum type_t     {INT, FLOAT, BOOL, STRING, SCRIPT};
+
+    constexpr CConfigKey(const char* n, presence_t p, int32_t S::* m)     : name(n), required(p), type(INT),    m_int(m)    {}
+    constexpr CConfigKey(const char* n, presence_t p, double S::* m)      : name(n), required(p), type(FLOAT),  m_float(m)  {}
+    constexpr CConfigKey(const char* n, presence_t p, bool S::* m)        : name(n), required(p), type(BOOL),   m_bool(m)   {}
+    constexpr CConfigKey(const char* n, presence_t p, std::string S::* m) : name(n), required(p), type(STRING), m_string(m) {}
+    constexpr CConfigKey(const char* n, presence_t p, std::vector<std::string> S::* m)
+                                                                          : name(n), required(p), type(SCRIPT), m_script(m) {}
+
+    const char* name;
+    bool        required;
+    type_t      type;
+
+    // The member of S that this key is stored in.  Which one is valid depends on "type"
+    union
+    {
+        int32_t                  S::* m_int;
+        double                   S::* m_float;
+        bool                     S::* m_bool;
+        std::string              S::* m_string;
+        std::vector<std::string> S::* m_script;
+    };
+};
+//----------------------------------------------------------------------------------------------------------
+
+
 //----------------------------------------------------------------------------------------------------------
 // CConfigFile - Provides a convenient interface for reading configuration files
+//
+// Every string in the config file is stored exactly once, in storage that never moves.  Section and key
+// names are interned into small integer IDs, and specs are found through a hash index on those IDs, so
+// looking up a spec never allocates or copies anything.
 //----------------------------------------------------------------------------------------------------------
 class CConfigFile
 {
 
 public:
     
+    // The values of a spec, as views of storage that belongs to this object
+    typedef std::vector<std::string_view> values_t;
+
+    // An interned section or key name
+    typedef uint32_t name_id_t;
+    static const name_id_t NO_NAME = 0xFFFFFFFF;
+
     // Default constructor
-    CConfigFile() {m_throw_on_fail = true;}
+    CConfigFile();
 
     // Call this to read the config file.  Returns 'true' on success, 'false' if file not found
     bool    read(std::string filename, bool msg_on_fail = true);
 
+    // Call this before "read()" to keep the parsed config file in a binary cache file, so that as long
+    // as the config file doesn't change, it can be loaded without being parsed.  Empty means "no cache"
+    void    set_cache_file(std::string filename) {m_cache_file = filename;}
+
+    // Call this after "read()" to write the cache file, if "read()" had to parse the config file
+    void    write_cache();
+
     // Call this to set the name of section to use for name scoping
     void    set_current_section(std::string section);
 
     // Call this to determine whether an exception is thrown when trying to fetch an unknown key
     void    throw_on_fail(bool flag = true) {m_throw_on_fail = flag;}
 
+    // Call this to fetch the ID of a section or key name.  A spec can be found by ID without any
+    // string handling at all.  IDs never change for the life of this object
+    name_id_t intern(std::string_view name);
+
+    // Call these to fetch the values of a spec without copying them.  Returns NULL if the spec doesn't
+    // exist.  A key name may be fully scoped ("section::key"), otherwise the current section is searched,
+    // then the global section.  The values remain valid until the next call to "read()"
+    const values_t* find(std::string_view key) const;
+    const values_t* find(name_id_t key) const;
+    const values_t* find(name_id_t section, name_id_t key) const;
+
+    // Call this to fetch every key described by a schema into a settings struct.  Keys that don't
+    // exist are left at whatever value the struct already has.
+    // Throws runtime_error if a required key is missing, or if a key has the wrong type
+    template <class S, size_t N> void load(const CConfigKey<S> (&schema)[N], S* p_settings);
+
+    // Call this to fetch the value of a key as a specific type: int32_t, double, bool, std::string,
+    // or std::vector<std::string> for a script.
+    // Throws runtime_error if the key is missing, or if it has the wrong type
+    template <class T> T get(std::string_view key) {T value{}; fetch(key, true, &value); return value;}
+
     // Call this to fetch a variable-type configuration spec.
     // Can throw exception runtime_error
     bool    get(std::string key, std::string fmt, void* p1=NULL, void* p2=NULL, void* p3=NULL
@@ -111,7 +269,7 @@ public:
     bool    get_script_vector(std::string, std::vector<std::string>*);
 
     // Tells the caller whether or not the specified spec-name exists
-    bool    exists(std::string key) {return exists(key, NULL);}
+    bool    exists(std::string_view key) const {return find(key) != NULL;}
 
     // Dumps out the m_specs in a human-readable form.  This is strictly for testing
     void    dump_specs();
@@ -124,20 +282,97 @@ protected:
     // A strvec_t is a vector of strings
     typedef std::vector< std::string > strvec_t;
 
-    // Call this to fetch the values-vector associated with a key.  Can throw exception!
-    bool    lookup(std::string key, strvec_t *p_result);
+    // A spec is a section name, a key name, and the values associated with them
+    struct spec_t {name_id_t section, key; values_t values;};
 
-    // Call this to fetch the values-vector associated with a key.  Won't throw excption
-    bool    exists(std::string, strvec_t *p_result);
+    // This identifies the exact contents of a config file
+    struct identity_t {uint64_t size; int64_t mtime_sec; int64_t mtime_nsec; uint64_t hash;};
 
-    // The section name to look for specs in
-    std::string m_current_section;
+    // Parses the text of a config file into m_specs
+    void    parse(const std::string& text);
 
-    // Our configuration specs are a map of string vectors
-    std::map<std::string, strvec_t> m_specs;
-};
-//----------------------------------------------------------------------------------------------------------
+    // Loads m_specs from the cache file.  Returns 'false' if the cache doesn't match the config file
+    bool    load_cache(const std::string& filename, std::ifstream& ifile, identity_t& identity, std::string& text);
+
+    // Saves m_specs to the cache file
+    void    save_cache(const std::string& filename, const identity_t& identity);
+
+    // The name of the binary cache file, or empty if there isn't one
+    std::string m_cache_file;
+
+    // The config file that "read()" parsed and its identity, until "write_cache()" has cached it
+    std::string m_parsed_file;
+    identity_t  m_parsed_identity;
+
+    // Call this to fetch the values associated with a key.  Can throw exception!
+    const values_t* lookup(std::string_view key);
+
+    // These fetch the value of a key as a specific type.  They return 'false' if the key doesn't exist
+    // and isn't required.  Can throw exception runtime_error
+    const values_t* fetch_values(std::string_view key, bool required, const char* type);
+    bool    fetch(std::string_view key, bool required, int32_t* p_result);
+    bool    fetch(std::string_view key, bool required, double* p_result);
+    bool    fetch(std::string_view key, bool required, bool* p_result);
+    bool    fetch(std::string_view key, bool required, std::string* p_result);
+    bool    fetch(std::string_view key, bool required, std::vector<std::string>* p_result);
+
+    // Stores a copy of a string where it will never move, and returns a view of the copy
+    std::string_view store(std::string_view s);
+
+    // Returns the ID of a name that has already been interned, or NO_NAME
+    name_id_t name_id(std::string_view name) const;
+
+    // Interns a lower-case name that is already in storage that never moves, without copying it
+    name_id_t intern_stored(std::string_view name);
+
+    // Adds a spec, replacing any existing spec with the same section and key
+    template <class T> void add_spec(std::string_view section, std::string_view key, const std::vector<T>& values);
 
+    // Returns the values of a spec, creating the spec if need be
+    values_t& spec_values(name_id_t section, name_id_t key);
 
+    // Rebuilds the hash indexes after they have grown
+    void    rebuild_name_index();
+    void    rebuild_spec_index();
 
+    // Returns the index into m_specs of the spec with this section and key, or -1
+    int     spec_index(name_id_t section, name_id_t key) const;
 
+    // The blocks of storage that hold every string, and how much room is left in the newest one
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char*   m_block_next;
+    size_t  m_block_free;
+
+    // The cache files that are mapped into memory.  Names and values loaded from a cache are views of these
+    std::vector<std::shared_ptr<const char>> m_images;
+
+    // Every interned name, indexed by name ID, and an open-addressed hash index of them (0 = empty slot)
+    std::vector<std::string_view> m_names;
+    std::vector<uint32_t> m_name_index;
+
+    // Every spec, and an open-addressed hash index of them by section and key (0 = empty slot).
+    // A deque never moves its elements, so pointers to values stay valid as specs are added
+    std::deque<spec_t>    m_specs;
+    std::vector<uint32_t> m_spec_index;
+
+    // The section that keys are looked up in before the global section
+    name_id_t m_current_section;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//==========================================================================================================
+// load() - Fetches every key described by a schema into a settings struct
+//==========================================================================================================
+template <class S, size_t N> void CConfigFile::load(const CConfigKey<S> (&schema)[N], S* p_settings)
+{
+    for (const CConfigKey<S>& key : schema) switch (key.type)
+    {
+        case key.INT:    fetch(key.name, key.required, &(p_settings->*key.m_int));    break;
+        case key.FLOAT:  fetch(key.name, key.required, &(p_settings->*key.m_float));  break;
+        case key.BOOL:   fetch(key.name, key.required, &(p_settings->*key.m_bool));   break;
+        case key.STRING: fetch(key.name, key.required, &(p_settings->*key.m_string)); break;
+        case key.SCRIPT: fetch(key.name, key.required, &(p_settings->*key.m_script)); break;
+    }
+}
+//==========================================================================================================
@@ -0,0 +1,432 @@
+//==========================================================================================================
+// discovery.cpp - Implements a finder for the SmartLynqs that are attached to this host over USB
+//==========================================================================================================
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+#include <net/if.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include "discovery.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// The largest number of connection attempts that may be in progress at once
+static const int MAX_IN_FLIGHT = 512;
+
+
+//==========================================================================================================
+// discover() - Finds the SmartLynqs whose hw_server answers
+//
+// Returns: The SmartLynqs that answered, in order of IP address
+//==========================================================================================================
+vector<discovered_t> CDiscovery::discover()
+{
+    m_index.clear();
+    m_interfaces.clear();
+    m_candidates.clear();
+
+    // Find the interfaces and the addresses on them that might be SmartLynqs
+    find_interfaces();
+    find_candidates();
+
+    // And find out which of them are
+    return probe();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// dump() - Asks the kernel for one of its routing tables
+//
+// Passed:  type       = The netlink message type of the request (e.g., RTM_GETLINK)
+//          request    = The request that follows the netlink message header
+//          size       = The size of the request
+//          on_message = Called with each netlink message of the reply
+//
+// Can throw runtime_error
+//==========================================================================================================
+template <class F> void CDiscovery::dump(int type, const void* request, size_t size, F on_message)
+{
+    char buffer[32768];
+
+    // Create a socket for talking to the kernel's routing subsystem
+    int sd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sd < 0) throw runtime_error("Can't open a netlink socket");
+
+    // Build the request: a netlink header that asks for the whole table, followed by the request itself
+    nlmsghdr header = {};
+    header.nlmsg_len   = NLMSG_LENGTH(size);
+    header.nlmsg_type  = type;
+    header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    header.nlmsg_seq   = 1;
+    memcpy(buffer, &header, sizeof header);
+    memcpy(NLMSG_DATA((nlmsghdr*)buffer), request, size);
+
+    // Send the request to the kernel
+    if (send(sd, buffer, header.nlmsg_len, 0) < 0)
+    {
+        close(sd);
+        throw runtime_error("Can't send a netlink request");
+    }
+
+    // Read replies until the kernel tells us the table is done
+    while (true)
+    {
+        ssize_t length = recv(sd, buffer, sizeof buffer, 0);
+        if (length < 0 && errno == EINTR) continue;
+        if (length <= 0)
+        {
+            close(sd);
+            throw runtime_error("Can't read a netlink reply");
+        }
+
+        for (nlmsghdr* msg = (nlmsghdr*)buffer; NLMSG_OK(msg, length); msg = NLMSG_NEXT(msg, length))
+        {
+            if (msg->nlmsg_type == NLMSG_DONE)
+            {
+                close(sd);
+                return;
+            }
+            if (msg->nlmsg_type == NLMSG_ERROR)
+            {
+                close(sd);
+                throw runtime_error("The kernel refused a netlink request");
+            }
+            on_message(msg);
+        }
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// is_usb() - Returns 'true' if a network interface is on the USB bus, according to sysfs.  This is only
+//            needed for kernels that don't say which bus an interface is on
+//==========================================================================================================
+bool CDiscovery::is_usb(const string& name)
+{
+    char target[PATH_MAX];
+    string path = "/sys/class/net/" + name + "/device/subsystem";
+
+    ssize_t length = readlink(path.c_str(), target, sizeof target - 1);
+    if (length <= 0) return false;
+    target[length] = 0;
+
+    const char* bus = strrchr(target, '/');
+    return bus && strcmp(bus, "/usb") == 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find_interfaces() - Finds the network interfaces that are up, and that are either on the USB bus or
+//                     named by the user
+//
+// On Exit: m_index      = The interfaces to search, by interface index
+//          m_interfaces = Their names
+//==========================================================================================================
+void CDiscovery::find_interfaces()
+{
+    ifinfomsg request = {};
+    request.ifi_family = AF_UNSPEC;
+
+    dump(RTM_GETLINK, &request, sizeof request, [&](nlmsghdr* msg)
+    {
+        ifinfomsg* info   = (ifinfomsg*)NLMSG_DATA(msg);
+        int        length = IFLA_PAYLOAD(msg);
+        string     name, bus;
+
+        // Fetch the name of the interface, and the bus its device is on (if the kernel will tell us)
+        for (rtattr* attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+        {
+            if (attr->rta_type == IFLA_IFNAME)              name = (const char*)RTA_DATA(attr);
+            if (attr->rta_type == IFLA_PARENT_DEV_BUS_NAME) bus  = (const char*)RTA_DATA(attr);
+        }
+
+        // An interface that's down can't reach anything
+        if (!(info->ifi_flags & IFF_UP)) return;
+
+        // If the user named the interfaces, those are the ones we want.  Otherwise, we want USB interfaces
+        if (!m_names.empty())
+        {
+            if (find(m_names.begin(), m_names.end(), name) == m_names.end()) return;
+        }
+        else if (bus.empty() ? !is_usb(name) : bus != "usb") return;
+
+        m_index[info->ifi_index] = name;
+        m_interfaces.push_back(name);
+    });
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find_candidates() - Finds the addresses on our interfaces that might be SmartLynqs
+//
+// On Exit: m_candidates = Every candidate address, and the interface it is reached through
+//==========================================================================================================
+void CDiscovery::find_candidates()
+{
+    // Our own addresses aren't candidates
+    vector<uint32_t> ours;
+
+    // Each interface's point-to-point peer, and on small subnets, every host address in the subnet
+    ifaddrmsg addrRequest = {};
+    addrRequest.ifa_family = AF_INET;
+    dump(RTM_GETADDR, &addrRequest, sizeof addrRequest, [&](nlmsghdr* msg)
+    {
+        ifaddrmsg* info   = (ifaddrmsg*)NLMSG_DATA(msg);
+        int        length = IFA_PAYLOAD(msg);
+        uint32_t   local = 0, address = 0;
+
+        // If this address isn't on one of our interfaces, we don't care about it
+        auto it = m_index.find(info->ifa_index);
+        if (it == m_index.end()) return;
+
+        for (rtattr* attr = IFA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+        {
+            if (attr->rta_type == IFA_LOCAL)   local   = ntohl(*(uint32_t*)RTA_DATA(attr));
+            if (attr->rta_type == IFA_ADDRESS) address = ntohl(*(uint32_t*)RTA_DATA(attr));
+        }
+        if (local == 0) local = address;
+        ours.push_back(local);
+
+        // On a point-to-point link, "address" is the far end
+        if (address != local)
+        {
+            m_candidates[address] = it->second;
+            return;
+        }
+
+        // If the subnet is small enough, every address in it is a candidate
+        int prefix = info->ifa_prefixlen;
+        if (prefix < 24 || prefix > 31) return;
+        uint32_t mask  = 0xFFFFFFFF << (32 - prefix);
+        uint32_t first = local & mask, last = first | ~mask;
+        if (prefix < 31) {++first; --last;}
+        for (uint32_t ip = first; ip <= last; ++ip) m_candidates[ip] = it->second;
+    });
+
+    // The neighbors the kernel has heard from on our interfaces
+    ndmsg neighRequest = {};
+    neighRequest.ndm_family = AF_INET;
+    dump(RTM_GETNEIGH, &neighRequest, sizeof neighRequest, [&](nlmsghdr* msg)
+    {
+        ndmsg* info   = (ndmsg*)NLMSG_DATA(msg);
+        int    length = RTM_PAYLOAD(msg);
+
+        // If this neighbor isn't on one of our interfaces, or is known to be unreachable, skip it
+        auto it = m_index.find(info->ndm_ifindex);
+        if (it == m_index.end() || (info->ndm_state & (NUD_FAILED | NUD_INCOMPLETE | NUD_NOARP))) return;
+
+        for (rtattr* attr = RTM_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length))
+        {
+            if (attr->rta_type == NDA_DST) m_candidates[ntohl(*(uint32_t*)RTA_DATA(attr))] = it->second;
+        }
+    });
+
+    // We aren't a SmartLynq
+    for (auto ip : ours) m_candidates.erase(ip);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// probe() - Tries to connect to hw_server at every candidate address at once
+//
+// Returns: The candidates that accepted a connection within the timeout, in order of IP address
+//
+// Every connection attempt is non-blocking, and a single epoll loop waits for all of them.  Each attempt
+// gets "m_timeout" milliseconds from the time it starts
+//==========================================================================================================
+vector<discovered_t> CDiscovery::probe()
+{
+    struct attempt_t {uint32_t ip; steady_clock::time_point start;};
+
+    map<int, attempt_t>    inFlight;
+    map<uint32_t, double>  answered;
+    epoll_event            events[64];
+    auto                   next = m_candidates.begin();
+
+    // This gives up on a connection attempt
+    auto finish = [&](int sd)
+    {
+        close(sd);
+        inFlight.erase(sd);
+    };
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) throw runtime_error("Can't create an epoll instance");
+
+    while (next != m_candidates.end() || !inFlight.empty())
+    {
+        // Start as many connection attempts as we're allowed to have in progress
+        while (next != m_candidates.end() && inFlight.size() < MAX_IN_FLIGHT)
+        {
+            uint32_t ip = (next++)->first;
+
+            int sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sd < 0)
+            {
+                close(epfd);
+                throw runtime_error("Can't create a socket");
+            }
+
+            sockaddr_in addr = {};
+            addr.sin_family      = AF_INET;
+            addr.sin_port        = htons(m_port);
+            addr.sin_addr.s_addr = htonl(ip);
+
+            auto start = steady_clock::now();
+            int  rc    = connect(sd, (sockaddr*)&addr, sizeof addr);
+
+            // If the connection was made or refused on the spot, we already know the answer
+            if (rc == 0) answered[ip] = duration<double, milli>(steady_clock::now() - start).count();
+            if (rc == 0 || errno != EINPROGRESS)
+            {
+                close(sd);
+                continue;
+            }
+
+            // Otherwise, wait for the socket to become writable
+            epoll_event event = {};
+            event.events  = EPOLLOUT;
+            event.data.fd = sd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, sd, &event);
+            inFlight[sd] = {ip, start};
+        }
+
+        // If nothing is in progress, we're done
+        if (inFlight.empty()) continue;
+
+        // Wait no longer than it takes for the oldest attempt to run out of time
+        auto oldest = steady_clock::now();
+        for (auto& pair : inFlight) oldest = min(oldest, pair.second.start);
+        auto wait = duration_cast<milliseconds>(oldest + milliseconds(m_timeout) - steady_clock::now()).count();
+        int  count = epoll_wait(epfd, events, 64, max<long>(wait, 0) + 1);
+        if (count < 0 && errno != EINTR) break;
+
+        // Each socket that became writable has either connected, or failed to
+        for (int i=0; i<count; ++i)
+        {
+            int       sd    = events[i].data.fd;
+            int       error = 0;
+            socklen_t size  = sizeof error;
+            getsockopt(sd, SOL_SOCKET, SO_ERROR, &error, &size);
+            if (error == 0)
+            {
+                attempt_t& attempt = inFlight[sd];
+                answered[attempt.ip] = duration<double, milli>(steady_clock::now() - attempt.start).count();
+            }
+            finish(sd);
+        }
+
+        // Give up on any attempt that has run out of time
+        auto now = steady_clock::now();
+        for (auto it = inFlight.begin(); it != inFlight.end(); )
+        {
+            int sd = (it++)->first;
+            if (now - inFlight[sd].start >= milliseconds(m_timeout)) finish(sd);
+        }
+    }
+
+    close(epfd);
+
+    // Hand the caller the SmartLynqs that answered, in order of IP address
+    vector<discovered_t> result;
+    for (auto& pair : answered)
+    {
+        in_addr addr = {htonl(pair.first)};
+        result.push_back({inet_ntoa(addr), m_candidates[pair.first], pair.second});
+    }
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Starts listening for network interfaces and IPv4 addresses that come and go
+//==========================================================================================================
+void CLinkMonitor::open()
+{
+    // If we're already listening, there's nothing to do
+    if (m_sd >= 0) return;
+
+    // Create a socket for listening to the kernel's routing subsystem
+    m_sd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (m_sd < 0) throw runtime_error("Can't open a netlink socket");
+
+    // We want to hear about links and IPv4 addresses.  Neighbors come and go whenever we probe, so they
+    // would only wake us up for nothing
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+    if (bind(m_sd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        close();
+        throw runtime_error("Can't listen for netlink announcements");
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Stops listening
+//==========================================================================================================
+void CLinkMonitor::close()
+{
+    if (m_sd >= 0) ::close(m_sd);
+    m_sd = -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// wait() - Waits for an interface or address to come or go
+//
+// Passed:  milliseconds = The longest we should wait
+//
+// Returns: 'true' if an interface or address came or went, 'false' if time ran out
+//==========================================================================================================
+bool CLinkMonitor::wait(int milliseconds)
+{
+    char   buffer[32768];
+    bool   changed = false;
+    pollfd pfd = {m_sd, POLLIN, 0};
+
+    // Wait for the first announcement to arrive
+    if (poll(&pfd, 1, milliseconds) <= 0) return false;
+
+    // Then consume every announcement that's waiting.  If the socket overflowed, we lost announcements,
+    // so something must have changed
+    while (true)
+    {
+        ssize_t length = recv(m_sd, buffer, sizeof buffer, 0);
+        if (length <= 0) return changed || (length < 0 && errno == ENOBUFS);
+
+        for (nlmsghdr* msg = (nlmsghdr*)buffer; NLMSG_OK(msg, length); msg = NLMSG_NEXT(msg, length))
+        {
+            switch (msg->nlmsg_type)
+            {
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    changed = true;
+            }
+        }
+    }
+}
+//==========================================================================================================
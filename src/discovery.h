@@ -0,0 +1,123 @@
+//==========================================================================================================
+// discovery.h - Defines a finder for the SmartLynqs that are attached to this host over USB
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+//----------------------------------------------------------------------------------------------------------
+// discovered_t - Describes a SmartLynq whose hw_server answered
+//----------------------------------------------------------------------------------------------------------
+struct discovered_t
+{
+    // The IP address of the SmartLynq's IP-over-USB interface
+    std::string usb_ip;
+
+    // The name of our network interface that the SmartLynq is attached to
+    std::string interface;
+
+    // How many milliseconds it took for hw_server to accept a connection
+    double      ms;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// CDiscovery - Finds SmartLynqs by asking the kernel (via netlink) for this host's IP-over-USB interfaces
+//              and the addresses of their peers, then probing hw_server on every one of those addresses
+//              at the same time
+//
+// The candidates on an interface are its point-to-point peer (if it has one), the neighbors the kernel
+// knows about, and, on subnets of 254 hosts or fewer, every other address in the subnet
+//----------------------------------------------------------------------------------------------------------
+class CDiscovery
+{
+public:
+
+    // Default constructor
+    CDiscovery() {m_port = 3121; m_timeout = 250;}
+
+    // Call this to search only the named interfaces.  By default, every interface on the USB bus is searched
+    void    set_interfaces(const std::vector<std::string>& names) {m_names = names;}
+
+    // Call this to set the TCP port that hw_server listens on
+    void    set_port(int port) {m_port = port;}
+
+    // Call this to set the number of milliseconds to wait for hw_server to answer
+    void    set_timeout(int milliseconds) {m_timeout = milliseconds;}
+
+    // Call this to find the SmartLynqs.  They are returned in order of IP address
+    // Can throw exception runtime_error
+    std::vector<discovered_t> discover();
+
+    // After "discover()", this is the names of the interfaces that were searched
+    const std::vector<std::string>& interfaces() {return m_interfaces;}
+
+protected:
+
+    // Asks the kernel for a table, and hands each message of the reply to "on_message"
+    template <class F> void dump(int type, const void* request, size_t size, F on_message);
+
+    // Finds the interfaces to search
+    void    find_interfaces();
+
+    // Finds the addresses on those interfaces that might be SmartLynqs
+    void    find_candidates();
+
+    // Tries to connect to hw_server at every candidate address at once
+    std::vector<discovered_t> probe();
+
+    // Returns 'true' if the named interface is on the USB bus, according to sysfs
+    static bool is_usb(const std::string& name);
+
+    // The interfaces the user asked us to search.  Empty means "every USB interface"
+    std::vector<std::string> m_names;
+
+    // The TCP port that hw_server listens on, and how long we wait for it to answer
+    int     m_port, m_timeout;
+
+    // The interfaces we're searching, by interface index
+    std::map<int, std::string> m_index;
+
+    // The names of the interfaces we're searching
+    std::vector<std::string> m_interfaces;
+
+    // The candidate addresses (in host byte order, so they sort), and the interface each is reached through
+    std::map<uint32_t, std::string> m_candidates;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// CLinkMonitor - Listens for the kernel's netlink announcements that a network interface or an IPv4
+//                address has come or gone, which is what happens when a SmartLynq is plugged in
+//----------------------------------------------------------------------------------------------------------
+class CLinkMonitor
+{
+public:
+
+    // Default constructor
+    CLinkMonitor() {m_sd = -1;}
+
+    // Destructor stops listening
+    ~CLinkMonitor() {close();}
+
+    // Call this to start listening
+    // Can throw exception runtime_error
+    void    open();
+
+    // Call this to stop listening
+    void    close();
+
+    // Waits up to "milliseconds" for an announcement.  Returns 'true' if any interface or address came or
+    // went.  Every announcement that is waiting is consumed
+    bool    wait(int milliseconds);
+
+protected:
+
+    // The netlink socket that the announcements arrive on
+    int     m_sd;
+};
+//----------------------------------------------------------------------------------------------------------
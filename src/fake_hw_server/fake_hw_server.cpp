@@ -0,0 +1,517 @@
+//==========================================================================================================
+// fake_hw_server.cpp - Simulates the hw_server of every SmartLynq in a manifest
+//
+// Usage: fake_hw_server [-port <port>] [-conf <file>] [-quiet] <MANIFEST_FILE>
+//
+// For every "<USB_IP> <STATIC_IP>" line in the manifest, this listens on <USB_IP>:3121 (and, depending on
+// the configuration, <STATIC_IP>:3121) the way a SmartLynq's hw_server does.  The addresses must be
+// loopback addresses (127.x.x.x), all of which belong to this machine under Linux.  That lets discovery,
+// reachability and verification code be tested at scale without any hardware.
+//
+// A connection is greeted with a TCF "Locator Hello" message after a configurable delay.  A SmartLynq
+// resets when a client sends it "reset", or when this program receives SIGUSR1 (which resets them all).
+// While a SmartLynq reboots, nothing is listening on its addresses.
+//
+// The behavior is configured in the same file as the fake Vivado: the file named by -conf, or by
+// $FAKE_VIVADO_CONF.  See fake_vivado/fake_vivado.conf for the details
+//==========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <stdexcept>
+#include "manifest.h"
+#include "config_file.h"
+
+using namespace std;
+
+// The greeting that hw_server sends when a connection is opened: a TCF "Locator Hello" event
+static const char GREETING[] = "E\0Locator\0Hello\0[\"ZeroCopy\"]\0\3\1";
+
+//----------------------------------------------------------------------------------------------------------
+// behavior_t - How the hw_server of a simulated SmartLynq behaves
+//----------------------------------------------------------------------------------------------------------
+struct behavior_t
+{
+    // Milliseconds between a connection arriving and hw_server greeting it, and how long a reset
+    // keeps the SmartLynq off the network.  Both have a random amount of up to "jitter_ms" added
+    int32_t accept_delay_ms = 0, reboot_ms = 0, jitter_ms = 0;
+
+    // "up" (the default), "down" (nothing listens), or "silent" (connections are accepted, but never
+    // greeted)
+    string  hw_server = "up";
+
+    // When hw_server listens on the static IP address: "never", "always", or "after_reset" (the default)
+    string  static_ip_up = "after_reset";
+
+    // How connections are dropped during a reset: "close" (the default) or "rst"
+    string  reset_drop = "close";
+};
+
+typedef CConfigKey<behavior_t> behavior_key_t;
+constexpr behavior_key_t behaviorSchema[] =
+{
+    {"accept_delay_ms", behavior_key_t::OPTIONAL, &behavior_t::accept_delay_ms },
+    {"reboot_ms",       behavior_key_t::OPTIONAL, &behavior_t::reboot_ms       },
+    {"jitter_ms",       behavior_key_t::OPTIONAL, &behavior_t::jitter_ms       },
+    {"hw_server",       behavior_key_t::OPTIONAL, &behavior_t::hw_server       },
+    {"static_ip_up",    behavior_key_t::OPTIONAL, &behavior_t::static_ip_up    },
+    {"reset_drop",      behavior_key_t::OPTIONAL, &behavior_t::reset_drop      },
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// A simulated SmartLynq, a listening socket, and a client connection
+//----------------------------------------------------------------------------------------------------------
+struct smartlynq_t
+{
+    string      usb_ip, static_ip;
+    behavior_t  behavior;
+
+    // The listening sockets for the USB and static IP addresses.  -1 = not listening
+    int         usb_fd = -1, static_fd = -1;
+
+    // True once the SmartLynq has been reset, and true while it's rebooting
+    bool        was_reset = false, rebooting = false;
+
+    // Incremented on every reset, so that stale timers can be recognized
+    int         generation = 0;
+};
+
+struct connection_t
+{
+    int         fd = -1;
+    int         smartlynq;
+
+    // A number that is unique to this connection, so that stale timers can be recognized
+    int         serial;
+    string      input;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// event_t - Something that has to happen at a specific time
+//----------------------------------------------------------------------------------------------------------
+struct event_t
+{
+    enum kind_t {GREET, REBOOTED};
+
+    int64_t when;
+    kind_t  kind;
+    int     index;
+
+    // The generation of the SmartLynq, or the serial number of the connection, that this is for
+    int     generation;
+
+    bool operator>(const event_t& rhs) const {return when > rhs.when;}
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+// Tells what each file descriptor in the epoll set is
+enum fd_kind_t {FD_UNUSED, FD_LISTENER, FD_CONNECTION, FD_SIGNAL};
+struct fd_info_t {fd_kind_t kind = FD_UNUSED; int index;};
+
+CConfigFile            cf;
+vector<smartlynq_t>    smartlynqs;
+vector<connection_t>   connections;
+vector<fd_info_t>      fdInfo;
+priority_queue<event_t, vector<event_t>, greater<event_t>> events;
+int                    epfd, port = 3121, nextSerial = 0;
+bool                   quiet = false;
+
+
+//==========================================================================================================
+// now_ms() - Returns the current time in milliseconds
+//==========================================================================================================
+int64_t now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// report() - Reports what's happening, unless we've been told to be quiet
+//==========================================================================================================
+void report(const smartlynq_t& smartlynq, const char* what)
+{
+    if (quiet) return;
+    printf("%s %s\n", smartlynq.usb_ip.c_str(), what);
+    fflush(stdout);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// jitter() - Returns a time with a random amount of jitter added
+//==========================================================================================================
+int64_t jitter(int ms, const behavior_t& behavior)
+{
+    if (behavior.jitter_ms > 0) ms += rand() % (behavior.jitter_ms + 1);
+    return ms;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// watch() / unwatch() - Add and remove a file descriptor from the epoll set
+//==========================================================================================================
+void watch(int fd, fd_kind_t kind, int index)
+{
+    epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) throw runtime_error("epoll_ctl failed: " + string(strerror(errno)));
+    if (fd >= (int)fdInfo.size()) fdInfo.resize(fd + 1);
+    fdInfo[fd] = {kind, index};
+}
+
+void unwatch(int& fd)
+{
+    if (fd < 0) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    fdInfo[fd].kind = FD_UNUSED;
+    close(fd);
+    fd = -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// listen_on() - Opens a listening socket on the specified IP address and our port
+//
+// Returns: The file descriptor of the socket
+//==========================================================================================================
+int listen_on(const string& ip, int index)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw runtime_error("Can't create a socket: " + string(strerror(errno)));
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+    if (bind(fd, (sockaddr*)&addr, sizeof addr) < 0 || listen(fd, 128) < 0)
+    {
+        string error = strerror(errno);
+        close(fd);
+        throw runtime_error("Can't listen on " + ip + ":" + to_string(port) + ": " + error);
+    }
+
+    watch(fd, FD_LISTENER, index);
+    return fd;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// bring_up() - Starts listening on the addresses of a SmartLynq, as appropriate for its behavior
+//==========================================================================================================
+void bring_up(int index)
+{
+    smartlynq_t& smartlynq = smartlynqs[index];
+    const behavior_t& behavior = smartlynq.behavior;
+
+    smartlynq.rebooting = false;
+    if (behavior.hw_server == "down") return;
+
+    smartlynq.usb_fd = listen_on(smartlynq.usb_ip, index);
+
+    bool static_up = behavior.static_ip_up == "always" || (behavior.static_ip_up == "after_reset" && smartlynq.was_reset);
+    if (static_up) smartlynq.static_fd = listen_on(smartlynq.static_ip, index);
+
+    report(smartlynq, static_up ? "up (usb and static)" : "up");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reset() - Resets a SmartLynq: drops its connections, and takes it off the network while it reboots
+//==========================================================================================================
+void reset(int index)
+{
+    smartlynq_t& smartlynq = smartlynqs[index];
+    if (smartlynq.rebooting) return;
+
+    // Drop every connection to this SmartLynq
+    for (auto& connection : connections)
+    {
+        if (connection.fd < 0 || connection.smartlynq != index) continue;
+        if (smartlynq.behavior.reset_drop == "rst")
+        {
+            linger abort = {1, 0};
+            setsockopt(connection.fd, SOL_SOCKET, SO_LINGER, &abort, sizeof abort);
+        }
+        unwatch(connection.fd);
+    }
+
+    // Stop listening, and come back once the SmartLynq has rebooted
+    unwatch(smartlynq.usb_fd);
+    unwatch(smartlynq.static_fd);
+    smartlynq.was_reset = true;
+    smartlynq.rebooting = true;
+    ++smartlynq.generation;
+    events.push({now_ms() + jitter(smartlynq.behavior.reboot_ms, smartlynq.behavior), event_t::REBOOTED, index, smartlynq.generation});
+    report(smartlynq, "reset");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// accept_connections() - Accepts every pending connection on a listening socket
+//==========================================================================================================
+void accept_connections(int listen_fd, int index)
+{
+    smartlynq_t& smartlynq = smartlynqs[index];
+
+    while (true)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        // Find a free connection slot
+        size_t slot = 0;
+        while (slot < connections.size() && connections[slot].fd >= 0) ++slot;
+        if (slot == connections.size()) connections.emplace_back();
+
+        connection_t& connection = connections[slot];
+        connection.fd         = fd;
+        connection.smartlynq  = index;
+        connection.serial     = ++nextSerial;
+        connection.input.clear();
+        watch(fd, FD_CONNECTION, slot);
+
+        // Greet the client, eventually
+        if (smartlynq.behavior.hw_server != "silent")
+        {
+            events.push({now_ms() + jitter(smartlynq.behavior.accept_delay_ms, smartlynq.behavior), event_t::GREET, (int)slot, connection.serial});
+        }
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read_connection() - Reads whatever a client has sent.  A client that sends "reset" resets the SmartLynq
+//==========================================================================================================
+void read_connection(int slot)
+{
+    connection_t& connection = connections[slot];
+    char buffer[4096];
+    bool hung_up = false;
+
+    while (!hung_up)
+    {
+        ssize_t count = read(connection.fd, buffer, sizeof buffer);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // A client may send "reset" and hang up right away
+        if (count <= 0)
+        {
+            hung_up = true;
+            break;
+        }
+
+        // Keep only enough input to recognize a command
+        connection.input.append(buffer, count);
+        if (connection.input.size() > 256) connection.input.erase(0, connection.input.size() - 256);
+    }
+
+    bool reset_requested = connection.input.find("reset") != string::npos;
+    int  index = connection.smartlynq;
+    if (reset_requested) connection.input.clear();
+
+    // If the client hung up, so do we
+    if (hung_up) unwatch(connection.fd);
+    if (reset_requested) reset(index);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_event() - Handles an event whose time has come
+//==========================================================================================================
+void run_event(const event_t& event)
+{
+    if (event.kind == event_t::REBOOTED)
+    {
+        smartlynq_t& smartlynq = smartlynqs[event.index];
+        if (event.generation == smartlynq.generation) bring_up(event.index);
+        return;
+    }
+
+    // Greet a connection, if it's still the one the event was for
+    connection_t& connection = connections[event.index];
+    if (connection.fd < 0 || connection.serial != event.generation) return;
+    if (write(connection.fd, GREETING, sizeof GREETING - 1) < 0) unwatch(connection.fd);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read_config() - Reads the configuration and fetches each SmartLynq's behavior
+//==========================================================================================================
+void read_config(string filename)
+{
+    if (filename.empty() && getenv("FAKE_VIVADO_CONF")) filename = getenv("FAKE_VIVADO_CONF");
+    if (!filename.empty() && !cf.read(filename, false)) throw runtime_error("Can't read " + filename);
+
+    for (auto& smartlynq : smartlynqs)
+    {
+        if (!filename.empty())
+        {
+            cf.set_current_section(smartlynq.usb_ip);
+            cf.load(behaviorSchema, &smartlynq.behavior);
+        }
+
+        const behavior_t& b = smartlynq.behavior;
+        if (b.hw_server != "up" && b.hw_server != "down" && b.hw_server != "silent")
+            throw runtime_error("hw_server must be up, down, or silent");
+        if (b.static_ip_up != "never" && b.static_ip_up != "always" && b.static_ip_up != "after_reset")
+            throw runtime_error("static_ip_up must be never, always, or after_reset");
+        if (b.reset_drop != "close" && b.reset_drop != "rst")
+            throw runtime_error("reset_drop must be close or rst");
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// raise_fd_limit() - Allows us as many file descriptors as the system will let us have
+//==========================================================================================================
+void raise_fd_limit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// execute() - Sets up the listeners and runs the event loop until we're told to stop
+//==========================================================================================================
+void execute(int argc, char** argv)
+{
+    string conf, manifestFile;
+    CManifest manifest;
+
+    // Parse the command line
+    for (int i=1; i<argc; ++i)
+    {
+        string arg = argv[i];
+        if      (arg == "-port" && i + 1 < argc) port = atoi(argv[++i]);
+        else if (arg == "-conf" && i + 1 < argc) conf = argv[++i];
+        else if (arg == "-quiet")                quiet = true;
+        else if (arg[0] != '-' && manifestFile.empty()) manifestFile = arg;
+        else throw runtime_error("Usage: fake_hw_server [-port <port>] [-conf <file>] [-quiet] <MANIFEST_FILE>");
+    }
+    if (manifestFile.empty()) throw runtime_error("Usage: fake_hw_server [-port <port>] [-conf <file>] [-quiet] <MANIFEST_FILE>");
+
+    // Read the manifest
+    if (!manifest.read(manifestFile)) exit(1);
+    for (auto& device : manifest.devices())
+    {
+        smartlynqs.emplace_back();
+        smartlynqs.back().usb_ip    = device.usb_ip;
+        smartlynqs.back().static_ip = device.static_ip;
+    }
+
+    read_config(conf);
+    raise_fd_limit();
+    srand(getpid() ^ time(NULL));
+
+    // SIGUSR1 resets every SmartLynq, and SIGINT or SIGTERM stops us
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    int sigfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    watch(sigfd, FD_SIGNAL, 0);
+
+    // Bring every SmartLynq up
+    for (size_t i=0; i<smartlynqs.size(); ++i) bring_up(i);
+    if (!quiet) printf("Simulating %d SmartLynq hw_servers on port %d\n", (int)smartlynqs.size(), port);
+    fflush(stdout);
+
+    // Run the event loop
+    epoll_event ready[256];
+    while (true)
+    {
+        // Run every event whose time has come
+        int64_t now = now_ms();
+        while (!events.empty() && events.top().when <= now)
+        {
+            event_t event = events.top();
+            events.pop();
+            run_event(event);
+        }
+
+        // Wait for something to happen, or for the next event
+        int timeout = events.empty() ? -1 : (int)(events.top().when - now);
+        int count = epoll_wait(epfd, ready, 256, timeout);
+
+        for (int i=0; i<count; ++i)
+        {
+            int fd = ready[i].data.fd;
+            if (fd >= (int)fdInfo.size()) continue;
+            fd_info_t info = fdInfo[fd];
+
+            if (info.kind == FD_LISTENER)   accept_connections(fd, info.index);
+            if (info.kind == FD_CONNECTION) read_connection(info.index);
+            if (info.kind == FD_SIGNAL)
+            {
+                signalfd_siginfo si;
+                while (read(sigfd, &si, sizeof si) == sizeof si)
+                {
+                    if (si.ssi_signo != SIGUSR1) return;
+                    for (size_t n=0; n<smartlynqs.size(); ++n) reset(n);
+                }
+            }
+        }
+    }
+}
+//==========================================================================================================
+
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        execute(argc, argv);
+    }
+    catch (const runtime_error& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,719 @@
+//==========================================================================================================
+// fake_vivado.cpp - A stand-in for Vivado that pretends to program SmartLynqs
+//
+// This accepts the same command line as Vivado, and runs the TCL scripts that smartlynq_static_ip
+// generates.  It only recognises the lines that smartlynq_static_ip writes, and stops with an error at
+// anything else (see script_matcher.h).  The hardware commands ("open_hw_manager", "connect_hw_server", "update_hw_firmware", etc.)
+// simulate a SmartLynq, with configurable latency, output volume, failures, hangs and crashes.  This lets
+// batch, parallel and watchdog behavior be tested at scale without any hardware.
+//
+// The behavior is configured in the file named by $FAKE_VIVADO_CONF, or in "fake_vivado.conf" in the
+// same directory as this executable.  See the example fake_vivado.conf for the details.
+//==========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <chrono>
+#include "script_matcher.h"
+#include "config_file.h"
+#include "tokenizer.h"
+
+using namespace std;
+typedef CScriptMatcher::args_t args_t;
+
+// The version that we claim to be
+static const char* VERSION_BANNER = "Vivado Lab Edition v2021.1 (64-bit)";
+static const char* BUILD_BANNER   = "SW Build 3247384 on Thu Jun 10 19:36:07 MDT 2021";
+
+//----------------------------------------------------------------------------------------------------------
+// behavior_t - How a simulated SmartLynq (or, for the "launch" phase, Vivado itself) behaves
+//----------------------------------------------------------------------------------------------------------
+struct behavior_t
+{
+    // Milliseconds spent in each phase, plus a random amount up to "jitter_ms"
+    int32_t launch_ms = 0, connect_ms = 0, update_ms = 0, reset_ms = 0, jitter_ms = 0;
+
+    // The number of lines of progress output that a firmware update prints
+    int32_t output_lines = 10;
+
+    // The phase (launch, connect, update or reset) that fails, hangs, or crashes.  Empty means "none"
+    string  fail, hang, crash;
+
+    // The percentage of runs in which "fail", "hang" and "crash" actually happen
+    int32_t fault_percent = 100;
+
+    // The firmware version the SmartLynq starts out with, and its serial number
+    string  firmware = "1.0", serial;
+};
+
+typedef CConfigKey<behavior_t> behavior_key_t;
+constexpr behavior_key_t behaviorSchema[] =
+{
+    {"launch_ms",       behavior_key_t::OPTIONAL, &behavior_t::launch_ms     },
+    {"connect_ms",      behavior_key_t::OPTIONAL, &behavior_t::connect_ms    },
+    {"update_ms",       behavior_key_t::OPTIONAL, &behavior_t::update_ms     },
+    {"reset_ms",        behavior_key_t::OPTIONAL, &behavior_t::reset_ms      },
+    {"jitter_ms",       behavior_key_t::OPTIONAL, &behavior_t::jitter_ms     },
+    {"output_lines",    behavior_key_t::OPTIONAL, &behavior_t::output_lines  },
+    {"fail",            behavior_key_t::OPTIONAL, &behavior_t::fail          },
+    {"hang",            behavior_key_t::OPTIONAL, &behavior_t::hang          },
+    {"crash",           behavior_key_t::OPTIONAL, &behavior_t::crash         },
+    {"fault_percent",   behavior_key_t::OPTIONAL, &behavior_t::fault_percent },
+    {"firmware",        behavior_key_t::OPTIONAL, &behavior_t::firmware      },
+    {"serial",          behavior_key_t::OPTIONAL, &behavior_t::serial        },
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// device_t - The state of a simulated SmartLynq that we're connected to
+//----------------------------------------------------------------------------------------------------------
+struct device_t
+{
+    string      ip, server;
+    behavior_t  behavior;
+
+    // The firmware version it's running and its configuration, as a TCL dict
+    string      firmware, config;
+};
+//----------------------------------------------------------------------------------------------------------
+
+// Our configuration file, and the global settings in it
+CConfigFile cf;
+string      bundledFirmware = "2.0";
+string      stateDir;
+int32_t     hwServerPort = 0;
+
+// How a SmartLynq reboots after "update_hw_firmware -reset": "background" or "blocking"
+string      rebootModel = "background";
+
+// True once "open_hw_manager" has been called
+bool        hwManagerOpen = false;
+
+// The devices we're connected to, and the name of the current hw_server
+map<string, device_t> devices;
+string      currentServer;
+
+// The device that has a reset pending, if any
+string      pendingReset;
+
+// The devices that are rebooting, and when each one started
+map<string, chrono::steady_clock::time_point> rebooting;
+
+// The most recent error message that was printed, so we don't print it twice
+string      lastError;
+
+
+//==========================================================================================================
+// sleep_ms() - Sleeps for the specified number of milliseconds, plus some random jitter
+//==========================================================================================================
+void sleep_ms(int ms, const behavior_t& behavior)
+{
+    if (behavior.jitter_ms > 0) ms += rand() % (behavior.jitter_ms + 1);
+    if (ms > 0) usleep(ms * 1000);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// loadBehavior() - Fetches the behavior of the SmartLynq at the specified IP address
+//
+// Settings in the [<ip>] section take precedence over those in the global section
+//==========================================================================================================
+behavior_t loadBehavior(const string& ip)
+{
+    behavior_t behavior;
+    behavior.serial = "FAKE-" + ip;
+    cf.set_current_section(ip);
+    cf.load(behaviorSchema, &behavior);
+    cf.set_current_section("");
+    return behavior;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// faultPhase() - Returns true if the fault described by "setting" should happen in the specified phase
+//==========================================================================================================
+bool faultPhase(const string& setting, const string& phase, const behavior_t& behavior)
+{
+    if (setting != phase) return false;
+    return (rand() % 100) < behavior.fault_percent;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// runPhase() - Simulates one phase of the programming process
+//
+// Passed:  tcl      = The script matcher
+//          phase    = "launch", "connect", "update" or "reset"
+//          ms       = How long the phase takes
+//          behavior = The behavior of the device
+//
+// Returns: A TCL completion code
+//==========================================================================================================
+int runPhase(CScriptMatcher& tcl, const string& phase, int ms, const behavior_t& behavior)
+{
+    sleep_ms(ms, behavior);
+
+    // If we're supposed to crash in this phase, do so
+    if (faultPhase(behavior.crash, phase, behavior))
+    {
+        printf("Abnormal program termination (11)\n");
+        fflush(stdout);
+        _exit(139);
+    }
+
+    // If we're supposed to hang in this phase, hang until somebody kills us
+    if (faultPhase(behavior.hang, phase, behavior))
+    {
+        fflush(stdout);
+        while (true) pause();
+    }
+
+    // If we're supposed to fail in this phase, report an error
+    if (faultPhase(behavior.fail, phase, behavior))
+    {
+        lastError = "[Labtoolstcl 44-513] HW Target shutdown. Closing target: " + behavior.serial
+                  + " (simulated failure during " + phase + ")";
+        printf("ERROR: %s\n", lastError.c_str());
+        fflush(stdout);
+        return tcl.error(lastError);
+    }
+
+    return CScriptMatcher::TCL_OK;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// saveState() / loadState() - Save and restore a device's firmware version and configuration in
+//                             "state_dir", so that they persist from one run to the next
+//==========================================================================================================
+void saveState(const device_t& device)
+{
+    if (stateDir.empty()) return;
+    ofstream ofile(stateDir + "/" + device.ip + ".state");
+    ofile << device.firmware << "\n" << device.config << "\n";
+}
+
+void loadState(device_t& device)
+{
+    if (stateDir.empty()) return;
+    ifstream ifile(stateDir + "/" + device.ip + ".state");
+    string firmware, config;
+    if (!getline(ifile, firmware)) return;
+    getline(ifile, config);
+    device.firmware = firmware;
+    device.config   = config;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// talkToHwServer() - Connects to the fake hw_server of a SmartLynq, and optionally sends it a message
+//
+// Returns: 'true' if the hw_server accepted the connection within a second
+//==========================================================================================================
+bool talkToHwServer(const string& ip, const string& message = "")
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(hwServerPort);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) return false;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    // Start the connection, and give it a second to complete
+    bool connected = connect(fd, (sockaddr*)&addr, sizeof addr) == 0;
+    if (!connected && errno == EINPROGRESS)
+    {
+        int error = 0;
+        socklen_t length = sizeof error;
+        pollfd pfd = {fd, POLLOUT, 0};
+        connected = poll(&pfd, 1, 1000) == 1
+                 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+    }
+
+    if (connected && !message.empty()) connected = write(fd, message.c_str(), message.size()) == (ssize_t)message.size();
+    close(fd);
+    return connected;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// startReset() - If a SmartLynq has a reset pending, starts it rebooting
+//
+// "update_hw_firmware -reset" doesn't reset the SmartLynq right away: the reset happens when Vivado moves
+// on from the hw_server, either by letting go of it or by connecting to another one.  That way the reset
+// happens after "update_hw_firmware" has returned, which is where smartlynq_static_ip expects it
+//
+// If we're working with the fake hw_server, it's told to reboot the SmartLynq
+//==========================================================================================================
+void startReset()
+{
+    if (pendingReset.empty()) return;
+    device_t& device = devices[pendingReset];
+    pendingReset.clear();
+
+    if (hwServerPort) talkToHwServer(device.ip, "reset\n");
+    rebooting[device.ip] = chrono::steady_clock::now();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// finishReset() - If a SmartLynq is rebooting, waits for the reboot to finish
+//
+// Passed:  tcl = The script matcher
+//          ip  = The USB IP address of the SmartLynq
+//
+// With the "background" reboot model, the SmartLynq reboots on its own, so if it started rebooting a
+// while ago, only the rest of its "reset_ms" is waited out.  With the "blocking" model, the whole of
+// "reset_ms" is always waited out
+//==========================================================================================================
+int finishReset(CScriptMatcher& tcl, const string& ip)
+{
+    startReset();
+    auto it = rebooting.find(ip);
+    if (it == rebooting.end()) return CScriptMatcher::TCL_OK;
+    device_t& device = devices[ip];
+    int elapsed = (rebootModel == "blocking") ? 0
+                : chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - it->second).count();
+    rebooting.erase(it);
+
+    printf("INFO: [Labtoolstcl 44-720] Waiting for %s to reboot\n", device.server.c_str());
+    fflush(stdout);
+    return runPhase(tcl, "reset", max(device.behavior.reset_ms - elapsed, 0), device.behavior);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// finishResets() - Waits for every SmartLynq that is rebooting to finish
+//==========================================================================================================
+int finishResets(CScriptMatcher& tcl)
+{
+    startReset();
+    while (!rebooting.empty())
+    {
+        int rc = finishReset(tcl, rebooting.begin()->first);
+        if (rc != CScriptMatcher::TCL_OK) return rc;
+    }
+    return CScriptMatcher::TCL_OK;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// findServer() - Finds the device behind a hw_server object
+//==========================================================================================================
+device_t* findServer(CScriptMatcher& tcl, const string& server)
+{
+    for (auto& pair : devices) if (pair.second.server == server) return &pair.second;
+    tcl.error("[Common 17-161] Invalid option value '" + server + "' specified for 'objects'.");
+    return nullptr;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// The hardware commands
+//==========================================================================================================
+
+int cmd_open_hw_manager(CScriptMatcher& tcl, const args_t& argv)
+{
+    hwManagerOpen = true;
+    return tcl.set_result("");
+}
+
+
+int cmd_close_hw_manager(CScriptMatcher& tcl, const args_t& argv)
+{
+    int rc = finishResets(tcl);
+    hwManagerOpen = false;
+    currentServer.clear();
+    if (rc == CScriptMatcher::TCL_OK) tcl.set_result("");
+    return rc;
+}
+
+
+int cmd_disconnect_hw_server(CScriptMatcher& tcl, const args_t& argv)
+{
+    // With no hw_server named, it's the current one.  If there isn't one, there's nothing to let go of
+    // but the SmartLynqs that are rebooting
+    string server = (argv.size() > 1) ? argv[1] : currentServer;
+    if (server.empty())
+    {
+        int rc = finishResets(tcl);
+        if (rc == CScriptMatcher::TCL_OK) tcl.set_result("");
+        return rc;
+    }
+    device_t* device = findServer(tcl, server);
+    if (device == nullptr) return CScriptMatcher::TCL_ERROR;
+
+    int rc = finishReset(tcl, device->ip);
+    if (server == currentServer) currentServer.clear();
+    if (rc == CScriptMatcher::TCL_OK) tcl.set_result("");
+    return rc;
+}
+
+
+int cmd_connect_hw_server(CScriptMatcher& tcl, const args_t& argv)
+{
+    string url = "localhost:3121";
+
+    // Fetch the "-url" option
+    for (size_t i=1; i<argv.size(); ++i)
+    {
+        if (argv[i] == "-url" && i + 1 < argv.size()) url = argv[++i];
+    }
+
+    // We have to have a hardware manager
+    if (!hwManagerOpen) return tcl.error("[Labtoolstcl 44-307] No hardware manager is open. Use open_hw_manager.");
+
+    // If a previous SmartLynq has a reset pending, it starts rebooting now.  If reboots block Vivado,
+    // we're stuck until every SmartLynq that is rebooting has finished
+    int rc;
+    if (rebootModel == "blocking" && (rc = finishResets(tcl)) != CScriptMatcher::TCL_OK) return rc;
+    startReset();
+
+    // Split the URL into a host name and a port
+    string ip = url.substr(0, url.find(':'));
+    string server = ip + ":" + ((url.find(':') == string::npos) ? "3121" : url.substr(url.find(':') + 1));
+
+    // Set up the device, the first time we see it
+    if (devices.find(ip) == devices.end())
+    {
+        device_t& device = devices[ip];
+        device.ip       = ip;
+        device.server   = server;
+        device.behavior = loadBehavior(ip);
+        device.firmware = device.behavior.firmware;
+        loadState(device);
+    }
+    device_t& device = devices[ip];
+
+    // If this SmartLynq is still rebooting, it can't be connected to until it's done
+    if ((rc = finishReset(tcl, ip)) != CScriptMatcher::TCL_OK) return rc;
+
+    printf("INFO: [Labtools 27-2285] Connecting to hw_server url TCP:%s\n", server.c_str());
+    fflush(stdout);
+
+    if ((rc = runPhase(tcl, "connect", device.behavior.connect_ms, device.behavior)) != CScriptMatcher::TCL_OK) return rc;
+
+    // If we're working with the fake hw_server, the SmartLynq has to be reachable
+    if (hwServerPort && !talkToHwServer(ip))
+    {
+        lastError = "[Labtools 27-3733] Error during cs_server initialization: Failed to connect to hw_server at "
+                  + ip + ":" + to_string(hwServerPort);
+        printf("ERROR: %s\n", lastError.c_str());
+        fflush(stdout);
+        return tcl.error(lastError);
+    }
+
+    printf("INFO: [Labtools 27-3415] Connecting to cs_server url TCP:%s\n", server.c_str());
+    fflush(stdout);
+
+    currentServer = server;
+    return tcl.set_result(server);
+}
+
+
+int cmd_current_hw_server(CScriptMatcher& tcl, const args_t& argv)
+{
+    if (currentServer.empty()) return tcl.error("[Labtoolstcl 44-199] No matching hw_server was found.");
+    return tcl.set_result(currentServer);
+}
+
+
+int cmd_get_hw_servers(CScriptMatcher& tcl, const args_t& argv)
+{
+    args_t servers;
+    for (auto& pair : devices) servers.push_back(pair.second.server);
+    return tcl.set_result(CScriptMatcher::make_list(servers));
+}
+
+
+int cmd_get_property(CScriptMatcher& tcl, const args_t& argv)
+{
+    if (argv.size() != 3) return tcl.wrong_args("get_property name object");
+
+    device_t* device = findServer(tcl, argv[2]);
+    if (device == nullptr) return CScriptMatcher::TCL_ERROR;
+
+    string name = argv[1];
+    for (auto& c : name) c = toupper(c);
+
+    if (name == "FIRMWARE_VERSION") return tcl.set_result(device->firmware);
+    if (name == "SERIAL_NUMBER")    return tcl.set_result(device->behavior.serial);
+    if (name == "NAME")             return tcl.set_result(device->server);
+    if (name == "CONFIG")           return tcl.set_result(device->config);
+    return tcl.error("[Common 17-58] '" + argv[1] + "' is not a valid property name.");
+}
+
+
+int cmd_update_hw_firmware(CScriptMatcher& tcl, const args_t& argv)
+{
+    bool   skip_update = false, reset = false;
+    string config_path, server;
+
+    // Parse the options
+    for (size_t i=1; i<argv.size(); ++i)
+    {
+        if      (argv[i] == "-skip_update") skip_update = true;
+        else if (argv[i] == "-reset")       reset = true;
+        else if (argv[i] == "-config_path" && i + 1 < argv.size()) config_path = argv[++i];
+        else if (argv[i][0] == '-') return tcl.error("[Common 17-170] Unknown option '" + argv[i] + "'");
+        else server = argv[i];
+    }
+
+    device_t* device = findServer(tcl, server);
+    if (device == nullptr) return CScriptMatcher::TCL_ERROR;
+    const behavior_t& behavior = device->behavior;
+
+    // Read the config.ini file.  It's a series of "set <key> <value>" lines, where the value is the rest
+    // of the line
+    args_t config;
+    if (!config_path.empty())
+    {
+        ifstream ifile(config_path);
+        if (!ifile.is_open()) return tcl.error("[Labtoolstcl 44-1005] Unable to read config file '" + config_path + "'");
+        CTokenizer tokenizer;
+        string     line;
+        while (getline(ifile, line))
+        {
+            vector<string> words = tokenizer.parse(line);
+            if (words.size() < 2 || words[0] != "set") continue;
+            string value;
+            for (size_t i = 2; i < words.size(); ++i) value += (i > 2 ? " " : "") + words[i];
+            config.push_back(words[1]);
+            config.push_back(value);
+        }
+    }
+
+    // Update the firmware, printing progress along the way.  A skipped update takes no time at all
+    int lines = skip_update ? 0 : max(behavior.output_lines, 0);
+    for (int i=1; i<=lines; ++i)
+    {
+        usleep(behavior.update_ms * 1000 / lines);
+        printf("INFO: [Labtoolstcl 44-1012] Updating firmware of %s: %d%% complete\n",
+               device->server.c_str(), i * 100 / lines);
+        fflush(stdout);
+    }
+
+    int ms = (skip_update || lines) ? 0 : behavior.update_ms;
+    int rc = runPhase(tcl, "update", ms, behavior);
+    if (rc != CScriptMatcher::TCL_OK) return rc;
+
+    // The SmartLynq now has the bundled firmware and the new configuration
+    if (!skip_update) device->firmware = bundledFirmware;
+    if (!config_path.empty()) device->config = CScriptMatcher::make_list(config);
+    saveState(*device);
+
+    printf("INFO: [Labtoolstcl 44-1013] Firmware of %s is version %s\n", device->server.c_str(), device->firmware.c_str());
+    fflush(stdout);
+
+    // The reset happens when we let go of the hw_server
+    if (reset) pendingReset = device->ip;
+    return tcl.set_result("");
+}
+
+
+int cmd_exit(CScriptMatcher& tcl, const args_t& argv)
+{
+    finishResets(tcl);
+    time_t now = time(NULL);
+    char   timestamp[64];
+    strftime(timestamp, sizeof timestamp, "%a %b %e %H:%M:%S %Y", localtime(&now));
+    printf("INFO: [Common 17-206] Exiting Vivado at %s...\n", timestamp);
+    fflush(stdout);
+    exit(argv.size() > 1 ? atoi(argv[1].c_str()) : 0);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readConfig() - Reads our configuration file, if there is one
+//==========================================================================================================
+void readConfig()
+{
+    string filename;
+
+    // If $FAKE_VIVADO_CONF names a file, that's our config file
+    const char* env = getenv("FAKE_VIVADO_CONF");
+    if (env && *env) filename = env;
+
+    // Otherwise, look for "fake_vivado.conf" next to our executable
+    else
+    {
+        char path[PATH_MAX];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length < 0) return;
+        path[length] = 0;
+        char* slash = strrchr(path, '/');
+        if (slash) *slash = 0;
+        filename = string(path) + "/fake_vivado.conf";
+        if (access(filename.c_str(), R_OK) != 0) return;
+    }
+
+    // Read the file, and fetch the global settings
+    if (!cf.read(filename, false)) throw runtime_error("Can't read " + filename);
+    if (cf.find("bundled_firmware")) bundledFirmware = cf.get<string>("bundled_firmware");
+    if (cf.find("state_dir"))        stateDir        = cf.get<string>("state_dir");
+    if (cf.find("hw_server_port"))   hwServerPort    = cf.get<int32_t>("hw_server_port");
+    if (cf.find("reboot"))           rebootModel     = cf.get<string>("reboot");
+    if (rebootModel != "background" && rebootModel != "blocking")
+        throw runtime_error("reboot must be \"background\" or \"blocking\"");
+
+    // Make sure the behavior settings are all valid
+    loadBehavior("");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// runBatch() - Runs a script file, like "vivado -mode batch -source <file>"
+//==========================================================================================================
+int runBatch(CScriptMatcher& tcl, const string& filename)
+{
+    int rc = tcl.run_file(filename);
+
+    if (rc == CScriptMatcher::TCL_ERROR)
+    {
+        if (tcl.result() != lastError) printf("ERROR: %s\n", tcl.result().c_str());
+        printf("\n    while executing\n\"source %s\"\n", filename.c_str());
+        printf("INFO: [Common 17-206] Exiting Vivado...\n");
+        fflush(stdout);
+        return 1;
+    }
+
+    args_t exit_command = {"exit"};
+    return cmd_exit(tcl, exit_command);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// runInteractive() - Reads commands from stdin, like "vivado -mode tcl"
+//==========================================================================================================
+int runInteractive(CScriptMatcher& tcl)
+{
+    string line;
+
+    printf("Vivado%% ");
+    fflush(stdout);
+
+    while (getline(cin, line))
+    {
+        // Nothing is reported until the command is complete
+        int rc = tcl.run_line(line);
+        if (!tcl.at_top_level()) continue;
+
+        if (rc == CScriptMatcher::TCL_ERROR && tcl.result() != lastError) printf("ERROR: %s\n", tcl.result().c_str());
+        else if (!tcl.result().empty()) printf("%s\n", tcl.result().c_str());
+        printf("Vivado%% ");
+        fflush(stdout);
+    }
+
+    args_t exit_command = {"exit"};
+    return cmd_exit(tcl, exit_command);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// main() - Parses the command line, and runs either a script file or an interactive session
+//==========================================================================================================
+int main(int argc, char** argv)
+{
+    string mode = "gui", source;
+
+    // Parse the command line
+    for (int i=1; i<argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "-help" || arg == "-version")
+        {
+            printf("%s (fake)\n%s\n", VERSION_BANNER, BUILD_BANNER);
+            return 0;
+        }
+        if      (arg == "-mode"   && i + 1 < argc) mode = argv[++i];
+        else if (arg == "-source" && i + 1 < argc) source = argv[++i];
+        else if ((arg == "-log" || arg == "-journal" || arg == "-tempDir") && i + 1 < argc) ++i;
+        else if (arg == "-nojournal" || arg == "-nolog" || arg == "-notrace") continue;
+        else
+        {
+            printf("ERROR: [Common 17-170] Unknown option '%s', please type 'vivado -help' for usage info.\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    // Only batch and tcl modes make sense without a display
+    if (mode != "batch" && mode != "tcl")
+    {
+        printf("ERROR: [Common 17-69] Command failed: this Vivado only supports -mode batch and -mode tcl\n");
+        return 1;
+    }
+
+    if (mode == "batch" && source.empty())
+    {
+        printf("ERROR: [Common 17-69] Command failed: -mode batch requires -source\n");
+        return 1;
+    }
+
+    // Read our configuration
+    try
+    {
+        readConfig();
+    }
+    catch (const runtime_error& e)
+    {
+        printf("ERROR: fake_vivado: %s\n", e.what());
+        return 1;
+    }
+
+    srand(getpid() ^ time(NULL));
+
+    printf("\n****** %s\n  **** %s\n    ** Copyright 1986-2021 Xilinx, Inc. All Rights Reserved.\n\n",
+           VERSION_BANNER, BUILD_BANNER);
+    fflush(stdout);
+
+    // Register the hardware commands
+    CScriptMatcher tcl;
+    tcl.add_command("open_hw_manager",      cmd_open_hw_manager);
+    tcl.add_command("close_hw_manager",     cmd_close_hw_manager);
+    tcl.add_command("connect_hw_server",    cmd_connect_hw_server);
+    tcl.add_command("disconnect_hw_server", cmd_disconnect_hw_server);
+    tcl.add_command("current_hw_server",    cmd_current_hw_server);
+    tcl.add_command("get_hw_servers",       cmd_get_hw_servers);
+    tcl.add_command("refresh_hw_server",    [](CScriptMatcher& tcl, const args_t&) {return tcl.set_result("");});
+    tcl.add_command("get_property",         cmd_get_property);
+    tcl.add_command("update_hw_firmware",   cmd_update_hw_firmware);
+    tcl.add_command("exit",                 cmd_exit);
+
+    // Simulate the time it takes Vivado to start up
+    behavior_t global = loadBehavior("");
+    if (runPhase(tcl, "launch", global.launch_ms, global) != CScriptMatcher::TCL_OK)
+    {
+        printf("INFO: [Common 17-206] Exiting Vivado...\n");
+        return 1;
+    }
+
+    return (mode == "batch") ? runBatch(tcl, source) : runInteractive(tcl);
+}
+//==========================================================================================================
@@ -0,0 +1,677 @@
+//==========================================================================================================
+// script_matcher.cpp - Implements a line matcher that runs the scripts smartlynq_static_ip generates
+//==========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <regex>
+#include <chrono>
+#include "script_matcher.h"
+
+using namespace std;
+typedef CScriptMatcher::args_t args_t;
+
+// The lines that open and close blocks
+static const string CATCH_OPEN   = "if {[catch {";
+static const string CATCH_FAILED = "} msg]} {";
+static const string CATCH_ELSE   = "} else {";
+static const string BLOCK_CLOSE  = "}";
+static const string PHASES_OPEN  = "if {![info exists ::smartlynq_phases]} {";
+static const string STDIN_CLOSE  = "} msg]} {puts \"ERROR: [string map [list \\n { }] $msg]\"; exit 1}";
+static const regex  PROC_OPEN    (R"re(^proc (\w+) \{[^}]*\} \{$)re");
+static const regex  COMMAND_OPEN (R"re(^smartlynq_command (\d+) \{$)re");
+static const regex  WORKER_OPEN  (R"re(^puts \{\}; set rc \[catch \{(.*)$)re");
+static const regex  WORKER_CLOSE (R"re(^(.*)\} msg\]; catch \{close_hw_manager\}; )re"
+                                  R"re(if \{\$rc\} \{puts "(.*)FAILED \[string map \[list \\n \{ \}\] \$msg\]"\} )re"
+                                  R"re(else \{puts "(.*)OK"\}$)re");
+
+// The commands that aren't hardware commands
+static const regex  CATCH        (R"re(^catch \{(.*)\}$)re");
+static const regex  TRACE        (R"re(^trace add execution (\w+) +(enter|leave) \{apply \{args \{puts "([^"$\[\\]*)"\}\}\}$)re");
+static const regex  PUTS         (R"re(^puts (?:\{([^{}]*)\}|"([^"$\[\\]*)")$)re");
+static const regex  PUTS_MESSAGE (R"re(^puts "([^"$\[\\]*)\[string map \[list \\n \{ \}\] \$msg\]"$)re");
+static const regex  SOURCE       (R"re(^source (?:\{([^{}]*)\}|([^\s{}]+))$)re");
+static const regex  COMMAND      (R"re(^smartlynq_command (\d+) \{(.*)\}$)re");
+static const regex  HOLD         (R"re(^smartlynq_hold (\S+)$)re");
+static const regex  RELEASE      (R"re(^smartlynq_release (\d+)$)re");
+static const regex  UNLESS       (R"re(^smartlynq_unless_configured \[smartlynq_configured \[current_hw_server\] \{(.*?)\}\] (.*)$)re");
+static const regex  CONTINUATION (R"re(\\\n[ \t]*)re");
+static const string SKIP_UPDATE  = "{*}[smartlynq_skip_update [current_hw_server]]";
+static const string SERVER       = "[current_hw_server]";
+
+// The settings that each helper is defined with, and the lines of its definition that they're found in
+static const map<string, vector<pair<string, regex>>> HELPERS =
+{
+    {"smartlynq_skip_update",
+    {
+        {"serial_query",   regex(R"re(\[catch \{(.*)\} serial\])re")},
+        {"current",        regex(R"re(\[dict exists \{(.*)\} \$serial\])re")},
+        {"firmware_query", regex(R"re(\[catch \{(.*)\} version\])re")},
+        {"version",        regex(R"re(\$version eq \{(.*)\}\} \{return -skip_update\})re")},
+        {"tag",            regex(R"re(puts "(\S+) \$serial \$version")re")},
+    }},
+    {"smartlynq_configured",        {{"config_query", regex(R"re(\[catch \{(.*)\} current\])re")}}},
+    {"smartlynq_unless_configured", {{"tag", regex(R"re(puts "(\S+)")re")}}},
+    {"smartlynq_command",           {{"tag", regex(R"re(puts "(\S+) \$index)re")}}},
+    {"smartlynq_hold",              {}},
+    {"smartlynq_drop",              {}},
+    {"smartlynq_release",           {{"tag", regex(R"re(puts "(\S+) \[lindex \$held 0\]")re")}}},
+};
+
+
+//==========================================================================================================
+// unrecognised() - Ends the program because the script contains TCL that we don't recognise
+//==========================================================================================================
+[[noreturn]] static void unrecognised(const string& text)
+{
+    printf("ERROR: fake_vivado doesn't recognise this TCL: %s\n", text.c_str());
+    fflush(stdout);
+    exit(2);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// trim() - Returns a line without its leading and trailing whitespace
+//==========================================================================================================
+static string trim(const string& line)
+{
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == string::npos) return "";
+    return line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// one_line() - Returns an error message with its newlines turned into spaces, as the scripts print it
+//==========================================================================================================
+static string one_line(string message)
+{
+    for (char& c : message) if (c == '\n') c = ' ';
+    return message;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// braces_balanced() - Tells whether every '{' in some TCL has been closed, and it doesn't end with a
+//                     backslash that continues the line
+//==========================================================================================================
+static bool braces_balanced(const string& text)
+{
+    int depth = 0;
+    for (size_t i=0; i<text.size(); ++i)
+    {
+        if (text[i] == '\\' && ++i == text.size()) return false;
+        else if (text[i] == '{') ++depth;
+        else if (text[i] == '}') --depth;
+    }
+    return depth <= 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// split_list() - Splits a TCL list into its elements
+//
+// Returns: 'false' if the list is malformed
+//==========================================================================================================
+static bool split_list(const string& list, args_t* p_result)
+{
+    size_t pos = 0, n = list.size();
+    auto space = [&](size_t i) {return i >= n || strchr(" \t\r\n", list[i]);};
+    p_result->clear();
+
+    while (true)
+    {
+        while (pos < n && space(pos)) ++pos;
+        if (pos >= n) return true;
+
+        // An element in braces is taken literally.  Otherwise, backslashes protect the next character
+        string element;
+        if (list[pos] == '{')
+        {
+            int depth = 1;
+            for (++pos; pos < n; ++pos)
+            {
+                if (list[pos] == '\\' && pos + 1 < n) element += list[pos++];
+                else if (list[pos] == '{') ++depth;
+                else if (list[pos] == '}' && --depth == 0) break;
+                element += list[pos];
+            }
+            if (pos++ >= n || !space(pos)) return false;
+        }
+        else while (!space(pos))
+        {
+            if (list[pos] == '\\' && pos + 1 < n) ++pos;
+            element += list[pos++];
+        }
+        p_result->push_back(element);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// quote() - Quotes a string so that it is a single element of a TCL list
+//==========================================================================================================
+static string quote(const string& item)
+{
+    if (item.empty()) return "{}";
+    if (item.find_first_of(" \t\r\n;$[]\\\"{}") == string::npos && item[0] != '#') return item;
+
+    // If the element has no braces or backslashes, braces around it will do
+    if (item.find_first_of("{}\\") == string::npos) return "{" + item + "}";
+
+    // Otherwise, every special character gets a backslash
+    string result;
+    for (char c : item)
+    {
+        if (strchr(" \t\r\n;$[]\\\"{}", c)) result += '\\';
+        result += c;
+    }
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// make_list() - Builds a TCL list out of a vector of elements
+//==========================================================================================================
+string CScriptMatcher::make_list(const args_t& items)
+{
+    string result;
+    for (auto& item : items) result += (result.empty() ? "" : " ") + quote(item);
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open_block() - Opens a block of lines
+//
+// Passed:  kind = What kind of block it is
+//          name = The name of the proc, or the number of the command, that the block holds
+//==========================================================================================================
+void CScriptMatcher::open_block(block_t::kind_t kind, const string& name)
+{
+    block_t block;
+    block.kind    = kind;
+    block.name    = name;
+    block.skipped = (kind == block_t::PHASES && m_phases);
+    m_blocks.push_back(block);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// active() - Tells whether the lines in the innermost block are being run, rather than skipped
+//==========================================================================================================
+bool CScriptMatcher::active() const
+{
+    for (auto& block : m_blocks)
+    {
+        if (block.kind == block_t::PHASES && block.skipped) return false;
+        if (block.kind == block_t::CATCH && block.failed != (block.part == block_t::FAILED)) return false;
+    }
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// fail() - Reports an error in the innermost block
+//
+// The innermost "catch" whose body is running catches the error, and the rest of its body is skipped.
+// If there isn't one, every open block is abandoned and the error is returned
+//==========================================================================================================
+int CScriptMatcher::fail(const string& message)
+{
+    for (auto it = m_blocks.rbegin(); it != m_blocks.rend(); ++it)
+    {
+        if (it->kind != block_t::CATCH || it->part != block_t::BODY) continue;
+        it->failed  = true;
+        it->message = message;
+        return TCL_OK;
+    }
+
+    m_blocks.clear();
+    return error(message);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close_catch() - Closes the innermost block, which must be the body of a "catch"
+//==========================================================================================================
+CScriptMatcher::block_t CScriptMatcher::close_catch()
+{
+    if (m_blocks.empty() || m_blocks.back().kind != block_t::CATCH || m_blocks.back().part != block_t::BODY)
+        unrecognised("end of a \"catch\" that wasn't started");
+    block_t block = m_blocks.back();
+    m_blocks.pop_back();
+    return block;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_line() - Runs a line of a script
+//
+// Passed:  line = A line of the script
+//
+// Returns: TCL_ERROR if a command failed outside of any "catch"
+//==========================================================================================================
+int CScriptMatcher::run_line(const string& line)
+{
+    string text = trim(line);
+    smatch match;
+
+    // A proc or a command that spans lines is collected until the brace that closes it
+    if (!m_blocks.empty() && (m_blocks.back().kind == block_t::PROC || m_blocks.back().kind == block_t::COMMAND))
+    {
+        block_t& block = m_blocks.back();
+        if (text != BLOCK_CLOSE || !braces_balanced(block.text))
+        {
+            block.text += line + "\n";
+            return TCL_OK;
+        }
+
+        block_t closed = block;
+        m_blocks.pop_back();
+        if (!active()) return TCL_OK;
+        if (closed.kind == block_t::PROC) define(closed.name, closed.text);
+        else if (command(closed.name, closed.text) != TCL_OK) return fail(m_result);
+        return set_result("");
+    }
+
+    // The lines that open a block
+    if (text == CATCH_OPEN)
+        open_block(block_t::CATCH);
+    else if (text == PHASES_OPEN)
+        open_block(block_t::PHASES);
+    else if (regex_match(text, match, PROC_OPEN))
+        open_block(block_t::PROC, match[1]);
+    else if (regex_match(text, match, COMMAND_OPEN))
+        open_block(block_t::COMMAND, match[1]);
+
+    // The Vivado worker's wrapper starts with a blank line.  Its body may start on the same line
+    else if (regex_match(text, match, WORKER_OPEN))
+    {
+        string rest = match[1];
+        if (active()) printf("\n");
+        open_block(block_t::CATCH);
+        if (!rest.empty()) return run_line(rest);
+    }
+
+    // The branches of a batch device's "catch"
+    else if (text == CATCH_FAILED)
+    {
+        block_t block = close_catch();
+        block.part = block_t::FAILED;
+        m_blocks.push_back(block);
+    }
+    else if (text == CATCH_ELSE)
+    {
+        if (m_blocks.empty() || m_blocks.back().part != block_t::FAILED) unrecognised(text);
+        m_blocks.back().part = block_t::SUCCEEDED;
+    }
+    else if (text == BLOCK_CLOSE)
+    {
+        if (m_blocks.empty() || (m_blocks.back().kind == block_t::CATCH && m_blocks.back().part == block_t::BODY))
+            unrecognised(text);
+        m_blocks.pop_back();
+    }
+
+    // The stdin wrapper reports an error and exits with a failing status
+    else if (text == STDIN_CLOSE)
+    {
+        block_t block = close_catch();
+        if (active() && block.failed)
+        {
+            printf("ERROR: %s\n", one_line(block.message).c_str());
+            return run_command("exit 1");
+        }
+    }
+
+    // The Vivado worker's wrapper reports the outcome after a sentinel.  Its body may end on the same line
+    else if (regex_match(text, match, WORKER_CLOSE))
+    {
+        string rest = match[1], failed = match[2], succeeded = match[3];
+        if (!rest.empty()) run_line(rest);
+        block_t block = close_catch();
+        if (active())
+        {
+            run_command("catch {close_hw_manager}");
+            if (block.failed) printf("%sFAILED %s\n", failed.c_str(), one_line(block.message).c_str());
+            else printf("%sOK\n", succeeded.c_str());
+            fflush(stdout);
+        }
+    }
+
+    // Anything else is a single command
+    else if (active())
+    {
+        return (run_command(text) == TCL_OK) ? TCL_OK : fail(m_result);
+    }
+
+    return set_result("");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_file() - Runs every line of a script file, stopping at an error that nothing catches
+//==========================================================================================================
+int CScriptMatcher::run_file(const string& filename)
+{
+    ifstream ifile(filename);
+    if (!ifile.is_open()) return error("couldn't read file \"" + filename + "\": no such file or directory");
+
+    size_t depth = m_blocks.size();
+    string line;
+    while (getline(ifile, line))
+    {
+        if (run_line(line) != TCL_OK) return TCL_ERROR;
+    }
+
+    if (m_blocks.size() != depth) unrecognised("a block that " + filename + " doesn't close");
+    return set_result("");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_command() - Runs a single command that isn't part of a block's structure
+//
+// Returns: A completion code.  The result (or the error message) is in "m_result"
+//==========================================================================================================
+int CScriptMatcher::run_command(string text)
+{
+    smatch match;
+
+    // A backslash-newline, along with the whitespace that follows it, is a single space
+    if (text.find("\\\n") != string::npos) text = regex_replace(text, CONTINUATION, " ");
+    text = trim(text);
+    m_result.clear();
+
+    // Blank lines and comments do nothing
+    if (text.empty() || text[0] == '#') return TCL_OK;
+
+    // The lines that set up the phase announcements
+    if (text == "set ::smartlynq_phases 1") m_phases = true;
+    else if (text == "fconfigure stdout -buffering line") return TCL_OK;
+    else if (regex_match(text, match, TRACE))
+    {
+        auto& trace = m_traces[match[1]];
+        (match[2] == "enter" ? trace.first : trace.second).push_back(match[3]);
+    }
+
+    // Output, and the outcome of a batch device
+    else if (regex_match(text, match, PUTS)) printf("%s\n", (match[1].matched ? match[1] : match[2]).str().c_str());
+    else if (regex_match(text, match, PUTS_MESSAGE))
+    {
+        auto it = m_blocks.rbegin();
+        while (it != m_blocks.rend() && (it->kind != block_t::CATCH || it->part != block_t::FAILED)) ++it;
+        if (it == m_blocks.rend()) unrecognised(text);
+        printf("%s%s\n", match[1].str().c_str(), one_line(it->message).c_str());
+    }
+
+    // Commands that run other commands
+    else if (regex_match(text, match, CATCH))
+    {
+        int rc = run_command(match[1]);
+        return set_result(to_string(rc));
+    }
+    else if (regex_match(text, match, SOURCE)) return run_file(match[1].matched ? match[1] : match[2]);
+    else if (regex_match(text, match, COMMAND)) return command(match[1], match[2]);
+
+    // The helpers that a pipelined batch calls
+    else if (regex_match(text, match, HOLD)    && m_helpers.count("smartlynq_hold"))    hold(match[1]);
+    else if (regex_match(text, match, RELEASE) && m_helpers.count("smartlynq_release")) release(stoul(match[1]));
+    else if (text == "smartlynq_drop" && m_helpers.count("smartlynq_drop")) drop();
+
+    // Anything else is a hardware command
+    else
+    {
+        // "%unless_configured%" asks whether the SmartLynq needs programming before anything else is
+        // substituted, and "%skip_update%" relies on the answer
+        bool unless = regex_match(text, match, UNLESS);
+        bool already = false;
+        if (unless)
+        {
+            string expected = match[1];
+            text = match[2];
+            if (!m_helpers.count("smartlynq_configured")) return error("invalid command name \"smartlynq_configured\"");
+            if (invoke({"current_hw_server"}) != TCL_OK) return TCL_ERROR;
+            if (configured(m_result, expected) != TCL_OK) return TCL_ERROR;
+            already = m_configured;
+        }
+
+        // Substitute the firmware check, then the hw_server
+        for (size_t pos; (pos = text.find(SKIP_UPDATE)) != string::npos; )
+        {
+            if (!m_helpers.count("smartlynq_skip_update")) return error("invalid command name \"smartlynq_skip_update\"");
+            if (invoke({"current_hw_server"}) != TCL_OK || skip_update(m_result) != TCL_OK) return TCL_ERROR;
+            text.replace(pos, SKIP_UPDATE.size(), m_result);
+        }
+        for (size_t pos; (pos = text.find(SERVER)) != string::npos; )
+        {
+            if (invoke({"current_hw_server"}) != TCL_OK) return TCL_ERROR;
+            text.replace(pos, SERVER.size(), quote(m_result));
+        }
+
+        // If the SmartLynq is already configured, the command doesn't run at all
+        if (unless)
+        {
+            if (!m_helpers.count("smartlynq_unless_configured"))
+                return error("invalid command name \"smartlynq_unless_configured\"");
+            m_configured = false;
+            if (already)
+            {
+                printf("%s\n", m_helpers["smartlynq_unless_configured"]["tag"].c_str());
+                fflush(stdout);
+                return set_result("");
+            }
+        }
+
+        // What's left must be a hardware command whose words need no more substitution
+        args_t argv;
+        if (text.find_first_of("[$") != string::npos || !split_list(text, &argv)) unrecognised(text);
+        if (argv.empty()) return set_result("");
+        if (argv.size() == 2 && argv[0] == "smartlynq_skip_update" && m_helpers.count(argv[0])) return skip_update(argv[1]);
+        return invoke(argv);
+    }
+
+    fflush(stdout);
+    return TCL_OK;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// command() - Runs a command of the Vivado script the way "smartlynq_command" does: it's timed, and its
+//             outcome is reported before it's passed on
+//
+// Passed:  index = The number of the command in the Vivado script
+//          text  = The command
+//==========================================================================================================
+int CScriptMatcher::command(const string& index, const string& text)
+{
+    if (!m_helpers.count("smartlynq_command")) return error("invalid command name \"smartlynq_command\"");
+
+    auto start = chrono::steady_clock::now();
+    int rc = run_command(text);
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    string message = (rc == TCL_OK) ? "" : one_line(m_result);
+    printf("%s %s %d %ld %s\n", m_helpers["smartlynq_command"]["tag"].c_str(), index.c_str(), rc, (long)elapsed,
+           message.c_str());
+    fflush(stdout);
+    return rc;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// invoke() - Runs a hardware command, announcing the phases that are traced on it
+//==========================================================================================================
+int CScriptMatcher::invoke(const args_t& argv)
+{
+    auto it = m_commands.find(argv[0]);
+    if (it == m_commands.end()) unrecognised(make_list(argv));
+
+    auto trace = m_traces.find(argv[0]);
+    if (trace != m_traces.end()) for (auto& text : trace->second.first) printf("%s\n", text.c_str());
+    fflush(stdout);
+
+    int rc = it->second(*this, argv);
+
+    if (trace != m_traces.end()) for (auto& text : trace->second.second) printf("%s\n", text.c_str());
+    fflush(stdout);
+    return rc;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// define() - Defines one of the "smartlynq_*" helpers from its TCL definition
+//
+// Passed:  name = The name of the helper
+//          body = The body of its proc, in which its settings are found
+//
+// A helper may be defined again, as the Vivado worker does for every job, and the new settings replace
+// the old ones
+//==========================================================================================================
+void CScriptMatcher::define(const string& name, const string& body)
+{
+    auto helper = HELPERS.find(name);
+    if (helper == HELPERS.end()) unrecognised("proc " + name);
+
+    map<string, string> settings;
+    for (auto& setting : helper->second)
+    {
+        smatch match;
+        if (!regex_search(body, match, setting.second)) unrecognised("proc " + name + " without its " + setting.first);
+        settings[setting.first] = match[1];
+    }
+    m_helpers[name] = settings;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// query() - Runs one of the user's queries on a hw_server
+//
+// Passed:  script  = The query, which refers to the hw_server as "$server"
+//          server  = The hw_server
+//          p_value = Receives the result of the query
+//
+// Returns: 'false' if the query failed
+//==========================================================================================================
+bool CScriptMatcher::query(const string& script, const string& server, string* p_value)
+{
+    string text = script;
+    for (size_t pos = 0; (pos = text.find("$server", pos)) != string::npos; pos += server.size())
+        text.replace(pos, 7, server);
+
+    bool ok = run_command(text) == TCL_OK;
+    *p_value = m_result;
+    return ok;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// skip_update() - Does what "smartlynq_skip_update" does: reports the SmartLynq's serial number and
+//                 firmware version, and returns "-skip_update" if it already runs the bundled firmware
+//==========================================================================================================
+int CScriptMatcher::skip_update(const string& server)
+{
+    auto& settings = m_helpers["smartlynq_skip_update"];
+    if (m_configured) return set_result("");
+
+    string serial, version;
+    if (!query(settings["serial_query"], server, &serial) || serial.empty() || quote(serial) != serial) serial = "unknown";
+
+    // A SmartLynq that we recently programmed with the bundled firmware isn't asked for its version
+    args_t current;
+    bool   known = false;
+    split_list(settings["current"], &current);
+    for (size_t i=0; i<current.size(); i+=2) if (current[i] == serial) known = true;
+
+    if (known)
+        version = settings["version"];
+    else if (!query(settings["firmware_query"], server, &version) || version.empty() || quote(version) != version)
+        version = "unknown";
+
+    printf("%s %s %s\n", settings["tag"].c_str(), serial.c_str(), version.c_str());
+    fflush(stdout);
+    return set_result((version != "unknown" && version == settings["version"]) ? "-skip_update" : "");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// configured() - Does what "smartlynq_configured" does: compares the SmartLynq's configuration with the
+//                expected one, and remembers whether they match
+//
+// Passed:  server   = The hw_server
+//          expected = The expected configuration, as a list of "<key> <value>" pairs
+//==========================================================================================================
+int CScriptMatcher::configured(const string& server, const string& expected)
+{
+    string current;
+    args_t items, wanted;
+    if (!query(m_helpers["smartlynq_configured"]["config_query"], server, &current)
+        || !split_list(current, &items) || items.size() % 2) items.clear();
+    if (!split_list(expected, &wanted)) unrecognised(expected);
+
+    map<string, string> settings;
+    for (size_t i=0; i<items.size(); i+=2) settings[items[i]] = items[i+1];
+
+    m_configured = !settings.empty();
+    for (size_t i=0; i<wanted.size(); i+=2)
+    {
+        auto it = settings.find(wanted[i]);
+        if (it == settings.end() || i + 1 >= wanted.size() || it->second != wanted[i+1]) m_configured = false;
+    }
+    return set_result(m_configured ? "1" : "0");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// hold() / drop() / release() - Do what "smartlynq_hold", "smartlynq_drop" and "smartlynq_release" do:
+//                               keep a pipelined batch's rebooting SmartLynqs connected until there are
+//                               more than "keep" of them, and let go of a SmartLynq that failed
+//==========================================================================================================
+void CScriptMatcher::hold(const string& id)
+{
+    if (invoke({"current_hw_server"}) != TCL_OK || m_result.empty()) return;
+    for (auto& held : m_held) if (held.second == m_result) return;
+    m_held.push_back({id, m_result});
+}
+
+void CScriptMatcher::drop()
+{
+    if (invoke({"current_hw_server"}) != TCL_OK || m_result.empty()) return;
+    string server = m_result;
+    for (auto& held : m_held) if (held.second == server) return;
+    invoke({"disconnect_hw_server", server});
+}
+
+void CScriptMatcher::release(size_t keep)
+{
+    while (m_held.size() > keep)
+    {
+        auto held = m_held.front();
+        m_held.erase(m_held.begin());
+        invoke({"disconnect_hw_server", held.second});
+        printf("%s %s\n", m_helpers["smartlynq_release"]["tag"].c_str(), held.first.c_str());
+        fflush(stdout);
+    }
+}
+//==========================================================================================================
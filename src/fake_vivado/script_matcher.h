@@ -0,0 +1,126 @@
+//==========================================================================================================
+// script_matcher.h - Defines a line matcher that runs the scripts smartlynq_static_ip generates
+//==========================================================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+//----------------------------------------------------------------------------------------------------------
+// CScriptMatcher - Runs the TCL that smartlynq_static_ip generates, one line at a time
+//
+// This is not a TCL interpreter.  It recognises the fixed lines that "script_preamble()", the batch and
+// stdin wrappers and the Vivado worker generate, and implements the "smartlynq_*" helpers natively from
+// the settings it finds in their definitions.  Anything else must be a single hardware command that was
+// added with "add_command()", with "[current_hw_server]", "%skip_update%" and "%unless_configured%" as
+// the only substitutions.  A line that it doesn't recognise ends the program with an error
+//----------------------------------------------------------------------------------------------------------
+class CScriptMatcher
+{
+public:
+
+    // The completion codes of a command
+    enum {TCL_OK, TCL_ERROR};
+
+    // The words of a command, including the name of the command
+    typedef std::vector<std::string> args_t;
+
+    // A hardware command.  It returns a completion code and stores its result in the matcher
+    typedef std::function<int(CScriptMatcher& tcl, const args_t& argv)> command_t;
+
+    // Call this to add (or replace) a hardware command
+    void    add_command(const std::string& name, command_t command) {m_commands[name] = command;}
+
+    // Call this with each line of a script.  Returns TCL_ERROR if a command failed outside of any
+    // "catch".  The error message is in "result()"
+    int     run_line(const std::string& line);
+
+    // Runs every line of a script file, stopping at an error that nothing catches
+    int     run_file(const std::string& filename);
+
+    // Tells whether every block that the script opened has been closed
+    bool    at_top_level() const {return m_blocks.empty();}
+
+    // Fetches the result of the most recent command
+    const std::string& result() const {return m_result;}
+
+    // Commands call these to set their result.  Each returns the appropriate completion code
+    int     set_result(const std::string& value) {m_result = value; return TCL_OK;}
+    int     error(const std::string& message) {m_result = message; return TCL_ERROR;}
+    int     wrong_args(const std::string& usage) {return error("wrong # args: should be \"" + usage + "\"");}
+
+    // Builds a TCL list out of a vector of elements
+    static std::string make_list(const args_t& items);
+
+protected:
+
+    // A block of lines that the script opened and hasn't closed yet.  The lines of a "catch" are
+    // skipped once its body fails, and only the branch for the outcome of the body is run
+    struct block_t
+    {
+        enum kind_t {CATCH, PHASES, PROC, COMMAND} kind;
+        enum {BODY, FAILED, SUCCEEDED} part = BODY;
+        bool        failed = false, skipped = false;
+        std::string name, text, message;
+    };
+
+    // Opens a block.  A block of phase announcements is skipped if they're already set up
+    void    open_block(block_t::kind_t kind, const std::string& name = "");
+
+    // Tells whether the lines in the innermost block are being run, rather than skipped
+    bool    active() const;
+
+    // Reports an error in the innermost block.  Returns TCL_ERROR if nothing catches it
+    int     fail(const std::string& message);
+
+    // Closes the innermost block, which must be a "catch".  Returns the block
+    block_t close_catch();
+
+    // Runs a single command that isn't part of a block's structure
+    int     run_command(std::string text);
+
+    // Runs a command of the Vivado script, timing it and reporting its outcome
+    int     command(const std::string& index, const std::string& text);
+
+    // Runs a hardware command, announcing the phases that are traced on it
+    int     invoke(const args_t& argv);
+
+    // Defines one of the "smartlynq_*" helpers from its TCL definition
+    void    define(const std::string& name, const std::string& body);
+
+    // Runs one of the user's queries on a hw_server.  Returns 'false' if it failed
+    bool    query(const std::string& script, const std::string& server, std::string* p_value);
+
+    // The "smartlynq_*" helpers
+    int     skip_update(const std::string& server);
+    int     configured(const std::string& server, const std::string& expected);
+    void    hold(const std::string& id);
+    void    drop();
+    void    release(size_t keep);
+
+    // Every hardware command, by name
+    std::map<std::string, command_t> m_commands;
+
+    // The blocks that are open, innermost last
+    std::vector<block_t> m_blocks;
+
+    // The text that the phases traced on each hardware command announce, as it's entered and left
+    std::map<std::string, std::pair<args_t, args_t>> m_traces;
+
+    // True once the phase announcements are set up
+    bool    m_phases = false;
+
+    // The settings of the helpers, as found in their definitions, by helper name and setting
+    std::map<std::string, std::map<std::string, std::string>> m_helpers;
+
+    // True when "smartlynq_configured" found that the SmartLynq needs no programming
+    bool    m_configured = false;
+
+    // The ids and hw_servers of the rebooting SmartLynqs that a pipelined batch holds on to
+    std::vector<std::pair<std::string, std::string>> m_held;
+
+    // The result of the most recent command
+    std::string m_result;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -4,69 +4,96 @@
 // Author: Doug Wolf
 //
 //
-// Top-level program flow is in the "execute()" routine.
+// Top-level program flow is in the "execute()" routine.  The programming itself is done by CProvisioner
+// (libsmartlynq); this file is just the command line around it
 //==========================================================================================================
-#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
-#include <stdarg.h>
 #include <string.h>
+#include <time.h>
 #include <iostream>
 #include <fstream>
-#include <map>
-#include <filesystem>
-#include "config_file.h"
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include "manifest.h"
+#include "process.h"
 #include "history.h"
+#include "timings.h"
+#include "discovery.h"
+#include "provisioner.h"
 
 using namespace std;
 
 // We're going to use a lot of these, so make it convenient
 typedef vector<string> strvec;
+typedef CProvisioner::result_t result_t;
 
-// This is the symbol table that we'll use for text substitutions
-map<string,string> symbolTable;
+// The engine that programs the SmartLynqs
+CProvisioner provisioner;
 
-// The vivado script that we'll run to program the IP address
-strvec vivadoScript;
+// The symbols defined on the command line.  These override the ones in the configuration file
+symtab_t commandLineSymbols;
 
-// The contents of the config.ini file that we use during IP address programming
-strvec configIni;
+// In batch or parallel mode, this is the list of SmartLynqs to be programmed
+vector<device_t> batch;
 
-// The fully qualified path to the Vivado executable
-string vivado;
+// This is true if we were given a manifest of devices rather than a single device
+bool batchMode = false;
 
-// This is the Vivado command line we'll execute
-string vivadoCommandLine;
+// This is true if we should program devices read from stdin with a persistent Vivado
+bool workerMode = false;
 
-// Name of a directory where we can store temporary files
-string tmp;
+// This is true if we should find the attached SmartLynqs instead of programming anything
+bool discoverMode = false;
 
-// This is all of the symbols we support
-const string USB_IP       = "%usb_ip%";
-const string STATIC_IP    = "%static_ip%";
-const string GATEWAY_IP   = "%gateway_ip%";
-const string VIVADO       = "%vivado%";
-const string TMP          = "%tmp%";
+// This is true if we should program SmartLynqs as they're plugged in, looking them up by serial number
+bool stationMode = false;
+
+// In station mode, the static IP address for each SmartLynq serial number
+CSerialManifest serialManifest;
+
+// In parallel mode, this is the maximum number of Vivado processes that may run at once
+int maxJobs = 0;
+
+// This is true if the command line was "--timings=json": the timings of each job are written to stdout
+bool timingsJson = false;
+
+// When the program started
+const CTimings::time_point_t programStart = CTimings::now();
+
+// This serializes writes of timing records
+mutex timingsMutex;
 
 // Function prototypes
 void   execute(int argc, const char** argv);
 void   parseCommandLine(int argc, const char** argv);
 void   showHelp();
-void   computeGatewayIP();
-void   execute();
 void   readConfigurationFile();
-string translate(const string&);
-void   translate(strvec&);
-void   writeStringsToFile(strvec&, string filename);
-strvec shell(const char* fmt, ...);
-int    runVivado();
+void   executeBatch();
+void   executeParallel();
+void   executeWorker();
+void   executeDiscover();
+void   executeStation();
+strvec configureDiscovery(CDiscovery& discovery);
+void   reportJob(const result_t& result);
+void   reportTimings(const result_t& result, CTimings::time_point_t start = programStart);
+string commandsJson(const result_t& result);
+string successMessage(const result_t& result);
 
 //==========================================================================================================
 // main() - Runs the program and if an exception is thrown, displays the error and exits
 //==========================================================================================================
 int main(int argc, const char** argv)
 {
+    // If we're interrupted, make sure Vivado doesn't outlive us
+    CProcess::kill_children_on_signal();
+
     try
     {
         execute(argc, argv);
@@ -88,320 +115,706 @@ void execute(int argc, const char** argv)
     // Parse the command line
     parseCommandLine(argc, argv);
 
-    // Compute the IP address of the gateway
-    computeGatewayIP();
+    // If SmartLynqs will be programmed as they're plugged in, wait for them
+    if (stationMode) executeStation();
+
+    // If we were given a manifest of devices, program them all in parallel or from a single Vivado session
+    if (maxJobs)   executeParallel();
+    if (batchMode) executeBatch();
+
+    // If the devices will arrive on stdin, program them with a persistent Vivado
+    if (workerMode) executeWorker();
+
+    // If the user wants to know which SmartLynqs are attached, go find them
+    if (discoverMode) executeDiscover();
 
     // Read in the configuration file
     readConfigurationFile();
 
-    // Perform macro substitution on the Vivado command line
-    vivadoCommandLine = translate(vivadoCommandLine);
+    // Make sure that Vivado exists and is runnable
+    provisioner.check_vivado();
+
+    // This will take a moment, so make sure the user knows what we're doing
+    cout << "Programming static IP " << batch[0].static_ip << "\n";
 
-    // Perform macro substituion on the contents of the 'config.ini' file
-    translate(configIni);
+    // Run Vivado to do the actual programming of the static IP address.  If we're checking, this also
+    // waits for the SmartLynq to answer at its static IP address
+    result_t result = provisioner.program(batch[0]);
 
-    // Perform macro substitution on the contents of the Vivado script
-    translate(vivadoScript);
+    // If we failed, show the Vivado output to the user
+    if (result.unreachable)
+        cout << "FAILED!!  " << result.message << "\n";
+    else if (result.rc)
+    {
+        cout << "FAILED!!  Vivado says:\n";
+        for (auto& s : result.output) cout << s << "\n";
+    }
 
-    // Write the 'config.ini' file to disk
-    writeStringsToFile(configIni, tmp+"/config.ini");
-    
-    // Write the Vivado script to disk
-    writeStringsToFile(vivadoScript, tmp+"/script.tcl");
+    // Otherwise, tell the user that all is well
+    else cout << successMessage(result) << "\n";
 
-    // Run Vivado to do the actual programming of the static IP address
-    int rc = runVivado();
+    // Report how long each phase took
+    reportTimings(result);
 
     // Tell the OS whether or not we succeded
-    exit(rc);
+    exit(result.rc);
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// parseCommandLine() - Fetches the USB IP address and desired static IP address from the command line
-//
-// Passed: argc = Number of command line parameters (including the name of the executable)
-//         argv = Array of pointers to the command line parameters
-//
-// On Exit: symbolTable[USB_IP]    = The current USB IP address of the SmartLynq JTAG programmer
-//          symbolTable[STATIC_IP] = The static IP address to be programmed into the SmartLynq
+// executeBatch() - Programs every SmartLynq in the manifest from a single Vivado session
 //==========================================================================================================
-void parseCommandLine(int argc, const char** argv)
+void executeBatch()
 {
-    uint32_t ip;
+    strvec output;
+    mutex  outputMutex;
 
-    // There should be exactly two parameters on the command line
-    if (argc != 3) showHelp();
+    // Read in the configuration file
+    readConfigurationFile();
 
-    // Ensure that the USB IP address is a properly formatted IPv4 address
-    if (inet_pton(AF_INET, argv[1], &ip) < 1)
+    // Make sure that Vivado exists and is runnable
+    provisioner.check_vivado();
+
+    // This will take a while, so make sure the user knows what we're doing
+    cout << "Programming static IPs for " << batch.size() << " devices\n";
+
+    // Tell the user about each device as soon as its outcome is known.  That can happen on the thread that
+    // checks static IP addresses, so the lines mustn't interleave
+    auto onReported = [&](const result_t& result)
     {
-        cerr << argv[1] << " is malformed\n";
-        exit(1);
-    }
+        lock_guard<mutex> lock(outputMutex);
+        cout << result.device.usb_ip << " -> " << result.device.static_ip << " : "
+             << (result.rc ? "FAILED!!  " + result.message : successMessage(result)) << endl;
+    };
 
-    // Ensure that the static IP address is a properly formatted IPv4 address
-    if (inet_pton(AF_INET, argv[2], &ip) < 1)
+    // Program every device in the manifest
+    int failures = provisioner.program_batch(batch, onReported, [](const result_t& r) {reportTimings(r);}, &output);
+
+    // If any device failed, show the Vivado output to the user
+    if (failures)
     {
-        cerr << argv[2] << " is malformed\n";
-        exit(1);
+        cout << failures << " of " << batch.size() << " devices FAILED!!  Vivado says:\n";
+        for (auto& s : output) cout << s << "\n";
     }
 
-    // Save the two IP address into the symbol table
-    symbolTable[USB_IP]    = argv[1];
-    symbolTable[STATIC_IP] = argv[2];
+    // Tell the OS whether or not we succeded
+    exit(failures ? 1 : 0);
 }
 //==========================================================================================================
 
 
-
-
 //==========================================================================================================
-// computeGatewayIP() - Compute the IP address of the gateway that will be programmed into SmartLynq
-//
-// On Entry: symbolTable[STATIC_IP] = The static IP to be programmed
-//
-// On Exit:  symbolTable[GATEWAY_IP] = The gateway IP address to be programmed
+// executeParallel() - Programs every SmartLynq in the manifest, each in its own Vivado process, with
+//                     no more than "maxJobs" Vivado processes running at once
 //==========================================================================================================
-void computeGatewayIP()
-{   
-    unsigned char octet[4];
-    char buffer[50];
-
-    // Fetch the static IP address
-    string ip = symbolTable[STATIC_IP];
-
-    // Convert the static IP address from a string into the four octets
-    inet_pton(AF_INET, ip.c_str(), octet);
+void executeParallel()
+{
+    atomic<int> nextJob(0);
+    mutex       outputMutex;
+    int         failures = 0;
 
-    // Change the last octet to a 1.  For instance 10.11.12.3 becomes 10.11.12.1
-    octet[3] = 1;
+    // Read in the configuration file
+    readConfigurationFile();
 
-    // Covert the octets back to a dotted quad IP address
-    inet_ntop(AF_INET, octet, buffer, sizeof buffer);
+    // Make sure that Vivado exists and is runnable
+    provisioner.check_vivado();
 
-    // And store the result in our symbol table
-    symbolTable[GATEWAY_IP] = buffer;
+    // This reports the outcome of a device without interleaving with the other workers.  If the device
+    // was programmed, it's called once we know whether it answers at its static IP address
+    auto report = [&](const result_t& result)
+    {
+        lock_guard<mutex> lock(outputMutex);
+        reportJob(result);
+        reportTimings(result);
+        failures += result.rc;
+    };
+
+    // Each worker thread repeatedly fetches the next device and programs it until there are none left
+    auto worker = [&]()
+    {
+        int index;
+        while ((index = nextJob++) < batch.size()) provisioner.program(batch[index], report);
+    };
+
+    // This will take a while, so make sure the user knows what we're doing
+    cout << "Programming static IPs for " << batch.size() << " devices, " << maxJobs << " at a time\n";
+
+    // Start the worker threads, then wait for them to finish all of the devices
+    vector<thread> workers;
+    for (int i=0; i<maxJobs && i<batch.size(); ++i) workers.emplace_back(worker);
+    for (auto& t : workers) t.join();
+    provisioner.wait();
+
+    // Tell the user and the OS whether or not we succeded
+    if (failures) cout << failures << " of " << batch.size() << " devices FAILED!!\n";
+    exit(failures ? 1 : 0);
 }
 //==========================================================================================================
 
 
-
-
 //==========================================================================================================
-// showHelp() - Displays usage text, then exits
+// executeWorker() - Keeps a single Vivado TCL interpreter running, and uses it to program each device
+//                   that is read from stdin, one "<USB_IP> <STATIC_IP>" per line
 //==========================================================================================================
-void showHelp()
+void executeWorker()
 {
-    cout << "Version " SW_VERSION "\n";
-    printf("Usage: smartlynq_static_ip <USB_IP_ADDRESS> <STATIC_IP_ADDRESS>\n");
-    exit(1);    
+    CManifest manifest;
+    string    line;
+    mutex     outputMutex;
+
+    // Read in the configuration file
+    readConfigurationFile();
+
+    // Make sure that Vivado exists and is runnable
+    provisioner.check_vivado();
+
+    // Start Vivado now, so that it's warmed up by the time the first device arrives
+    provisioner.start_session();
+
+    // This tells the user how a device went.  If the device was programmed, it's checked in the background
+    // while Vivado moves on to the next one, and this is called when the check is finished
+    auto report = [&](const result_t& result)
+    {
+        lock_guard<mutex> lock(outputMutex);
+        reportJob(result);
+        reportTimings(result);
+        cout.flush();
+    };
+
+    // Loop through each line of stdin...
+    while (getline(cin, line))
+    {
+        device_t device;
+
+        // Parse the device described by this line, skipping over blank lines and comments
+        try
+        {
+            if (!manifest.parse(line, &device)) continue;
+        }
+        catch(const std::exception& e)
+        {
+            lock_guard<mutex> lock(outputMutex);
+            cout << line << " : " << e.what() << endl;
+            continue;
+        }
+
+        // Program the device.  A failure here fails only this device
+        provisioner.program_session(device, report);
+    }
+
+    // stdin is closed, so we're done as soon as the last device has been checked
+    provisioner.wait();
+    exit(0);
 }
 //==========================================================================================================
 
 
-
 //==========================================================================================================
-// readConfigurationFile() - Reads in the configuration specifications
+// executeDiscover() - Lists the SmartLynqs that are attached to this host over USB, one USB IP address per
+//                     line, so that the list can be turned into a manifest
+//
+// The exit code is 0 if any SmartLynq was found
 //==========================================================================================================
-void readConfigurationFile()
+void executeDiscover()
 {
-    CConfigFile cf;
+    CDiscovery discovery;
 
-    // This is the name of the file that contains our configuration
-    string filename = "smartlynq_static_ip.conf";
+    // Read in the configuration file
+    readConfigurationFile();
 
-    // Read in the config file
-    if (!cf.read(filename, false)) throw runtime_error("Can't open "+filename);
+    // Find out which interfaces to search, and how
+    strvec interfaces = configureDiscovery(discovery);
 
-    // Fetch the name and path of the vivado executable
-    cf.get("vivado", &vivado);
-    symbolTable[VIVADO] = vivado;
+    // Go find the SmartLynqs
+    auto start = CTimings::now();
+    vector<discovered_t> found = discovery.discover();
+    double elapsed = CTimings::since(start);
 
-    // Fetch the name of the temp directory
-    cf.get("tmp", &tmp);
-    symbolTable[TMP] = tmp;
+    // If there was nowhere to look, say so
+    if (discovery.interfaces().empty())
+    {
+        cerr << (interfaces.empty() ? "No IP-over-USB interfaces are up\n" : "None of those interfaces are up\n");
+        exit(1);
+    }
 
-    // Fetch the Vivado command line that we'll execute
-    cf.get("command_line", &vivadoCommandLine);
+    // Tell the user where we looked and what we found.  The comment lines are ignored in a manifest
+    string where;
+    for (auto& s : discovery.interfaces()) where += (where.empty() ? "" : ", ") + s;
+    printf("# %d SmartLynq%s found on %s in %.0f ms\n", (int)found.size(), found.size() == 1 ? "" : "s",
+           where.c_str(), elapsed);
+    for (auto& device : found)
+    {
+        printf("# %s on %s: hw_server answered in %.1f ms\n", device.usb_ip.c_str(), device.interface.c_str(), device.ms);
+    }
+    for (auto& device : found) printf("%s\n", device.usb_ip.c_str());
 
-    // Fetch the script that will be stored in the config.ini file
-    cf.get_script_vector("config.ini", &configIni);
+    // Tell the caller whether we found anything
+    exit(found.empty() ? 1 : 0);
+}
+//==========================================================================================================
 
-    // Fetch the script that will be run by Vivado 
-    cf.get_script_vector("vivado_script", &vivadoScript);
+
+//==========================================================================================================
+// configureDiscovery() - Tells a CDiscovery which interfaces to search and how, from the configuration file
+//
+// Returns: The interfaces named in the configuration file.  Empty means "every interface on the USB bus"
+//==========================================================================================================
+strvec configureDiscovery(CDiscovery& discovery)
+{
+    string name;
+    strvec interfaces;
+
+    istringstream names(provisioner.config().discover_interfaces);
+    while (names >> name) interfaces.push_back(name);
+    discovery.set_interfaces(interfaces);
+    discovery.set_port(provisioner.config().hw_server_port);
+    discovery.set_timeout(provisioner.config().discover_timeout_ms);
+    return interfaces;
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// translate() - Uses the symbolTable to perform text substitution in a string
+// executeStation() - Programs SmartLynqs as they're plugged in, looking up each one's static IP address
+//                    by its serial number, with no more than "maxJobs" Vivado processes running at once
+//
+// We listen for netlink announcements of interfaces and addresses coming and going, and whenever one
+// arrives (or every "station_rescan_ms" regardless, since hw_server starts a while after the interface
+// appears) we search for SmartLynqs.  Each SmartLynq that wasn't there on the previous search is
+// identified with a persistent Vivado, then programmed just as a single device would be.  A SmartLynq is
+// only tried once per plug-in: to retry one that failed, unplug it and plug it back in
+//
+// This runs until it's interrupted
 //==========================================================================================================
-string translate(const string& raw)
+void executeStation()
 {
-    string result = raw;
+    mutex              stateMutex, outputMutex;
+    condition_variable wakeup;
+    CLinkMonitor       monitor;
+    CDiscovery         discovery;
+
+    // The USB IP addresses waiting to be programmed, the ones that were there on the last search, the ones
+    // that are queued or being programmed, and the serial numbers of the SmartLynqs we've programmed
+    deque<string> queue;
+    set<string>   present, busy, programmed;
+
+    // Read in the configuration file
+    readConfigurationFile();
+
+    // Make sure that Vivado exists and is runnable
+    provisioner.check_vivado();
 
-    // Loop through every key-value pair in the symbol table
-    for (auto& pair : symbolTable)
+    // Start the Vivado that identifies SmartLynqs now, so that it's warmed up when the first one arrives
+    provisioner.start_session();
+
+    // Get ready to find SmartLynqs
+    configureDiscovery(discovery);
+    monitor.open();
+
+    // This remembers whether a SmartLynq was programmed, and reports the outcome without interleaving with
+    // the other workers.  "total" is measured from "start", when the SmartLynq was taken off the queue
+    auto finish = [&](const result_t& result, const string& serial, const string& problem, CTimings::time_point_t start)
     {
-        // Get the key/value pair for this symbol-table entry
-        const string& key   = pair.first;
-        const string& value = pair.second;
+        {
+            lock_guard<mutex> lock(stateMutex);
+            if (problem.empty() && result.rc == 0) programmed.insert(serial);
+        }
 
-        // Search for every occurence of this key, and subsitute the value in it's place        
+        lock_guard<mutex> lock(outputMutex);
+        cout << "[" << (serial.empty() ? "unknown" : serial) << "] ";
+        if (!problem.empty())
+            cout << result.device.usb_ip << " : " << problem << endl;
+        else
+        {
+            reportJob(result);
+            reportTimings(result, start);
+            cout.flush();
+        }
+    };
+
+    // Each worker thread identifies and programs the SmartLynqs in the queue, one at a time
+    auto worker = [&]()
+    {
         while (true)
         {
-            auto pos = result.find(key);
-            if (pos == string::npos) break;
-            result.replace(pos, key.length(), value);
+            result_t probe;
+            device_t device;
+            string   problem;
+            bool     ready = false;
+
+            // Wait for a SmartLynq to be plugged in
+            {
+                unique_lock<mutex> lock(stateMutex);
+                wakeup.wait(lock, [&]() {return !queue.empty();});
+                device.usb_ip = queue.front();
+                queue.pop_front();
+            }
+            auto start = CTimings::now();
+
+            // Find out which SmartLynq this is, and whether it's in the manifest
+            try
+            {
+                bool identified = provisioner.identify(device.usb_ip, &probe);
+
+                bool done;
+                {
+                    lock_guard<mutex> lock(stateMutex);
+                    done = programmed.count(probe.serial) != 0;
+                }
+
+                if (!identified)
+                    problem = "FAILED!!  Can't read its serial number";
+                else if (done)
+                    problem = "Already programmed, unplug it";
+                else if (!serialManifest.lookup(probe.serial, &device.static_ip))
+                    problem = "FAILED!!  Serial number " + probe.serial + " isn't in the manifest";
+                else
+                    ready = true;
+            }
+            catch(const std::exception& e)
+            {
+                problem = "FAILED!!  " + string(e.what());
+            }
+
+            // Program it.  If it was programmed, it isn't finished until it answers at its static IP
+            // address.  That's checked in the background while this worker moves on to the next SmartLynq
+            string serial = probe.serial;
+            if (ready) provisioner.program(device, [&finish, serial, start](const result_t& result)
+            {
+                finish(result, serial, "", start);
+            });
+
+            // This worker is done with the SmartLynq
+            {
+                lock_guard<mutex> lock(stateMutex);
+                busy.erase(device.usb_ip);
+            }
+
+            // If it was never programmed, say why
+            if (!ready)
+            {
+                probe.device = device;
+                finish(probe, serial, problem, start);
+            }
         }
-    }
+    };
 
-    // Return the fully translated string to the caller
-    return result;
-}
-//==========================================================================================================
+    // Start the worker threads.  They run until we're interrupted
+    vector<thread> workers;
+    for (int i=0; i<maxJobs; ++i) workers.emplace_back(worker);
 
+    cout << "Waiting for SmartLynqs from a manifest of " << serialManifest.size() << ", programming "
+         << maxJobs << " at a time" << endl;
 
+    // Search for SmartLynqs whenever something is plugged in or unplugged, and now and then regardless
+    while (true)
+    {
+        set<string> found;
+        for (auto& device : discovery.discover()) found.insert(device.usb_ip);
 
-//==========================================================================================================
-// translate() - Uses the symbolTable to perform text substitution of every string in a vector
-//==========================================================================================================
-void translate(strvec& v)
-{
-    for (auto& s : v) s = translate(s);
+        // Queue up each SmartLynq that has appeared since the last search
+        {
+            lock_guard<mutex> lock(stateMutex);
+            for (auto& usbIP : found)
+            {
+                if (present.count(usbIP) || busy.count(usbIP)) continue;
+                busy.insert(usbIP);
+                queue.push_back(usbIP);
+                wakeup.notify_one();
+            }
+            present = found;
+        }
+
+        monitor.wait(provisioner.config().station_rescan_ms);
+    }
 }
 //==========================================================================================================
 
 
-
 //==========================================================================================================
-// writeStringsToFile() - Writes every string in a string-vector to the specified filename
+// reportJob() - Displays a single line telling the user the outcome of a device, and if it failed, the
+//               output of Vivado
 //==========================================================================================================
-void writeStringsToFile(strvec& v, string filename)
+void reportJob(const result_t& result)
 {
-    // Open the file
-    ofstream ofile(filename);
-
-    // If we can't open the file, that's fatal
-    if (!ofile.is_open()) throw runtime_error("Can't create " + filename);
+    cout << result.device.usb_ip << " -> " << result.device.static_ip << " : ";
 
-    // Write every string in vector to the file
-    for (auto& s : v) ofile << s << "\n";
+    // If Vivado did its job but the SmartLynq never showed up at its new address, Vivado's output won't help
+    if (result.unreachable)
+    {
+        cout << "FAILED!!  " << result.message << "\n";
+        return;
+    }
 
-    // And we're done writing the file
-    ofile.close();
+    cout << (result.rc ? "FAILED!!  Vivado says:" : successMessage(result)) << "\n";
+    if (result.rc) for (auto& s : result.output) cout << "    " << s << "\n";
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// chomp() - Removes any carriage-return or linefeed from the end of a buffer
+// reportTimings() - Reports how long each phase of a device took, as a single line of JSON
+//
+// Passed:  result = The result of the device
+//          start  = When the device's "total" starts: the start of the program, or in station mode, the
+//                   time the SmartLynq was found
+//
+// The record is written to stdout if the command line said "--timings=json", and appended to the
+// "timings_file" from the configuration file if there is one.  The timings are in milliseconds.  The
+// shared work ("config_read" and "vivado_check") is included in every record, "verify" is how long the
+// SmartLynq took to answer at its static IP address (if that was checked), and "total" is the time from
+// "start" until the device was finished
 //==========================================================================================================
-static void chomp(char* buffer)
+void reportTimings(const result_t& result, CTimings::time_point_t start)
 {
-    char* p;
-    p = strchr(buffer, 10);
-    if (p) *p = 0;
-    p = strchr(buffer, 13);
-    if (p) *p = 0;
+    const string& timingsFile = provisioner.config().timings_file;
+
+    // If nobody wants the timings, don't bother
+    if (!timingsJson && timingsFile.empty()) return;
+
+    // Combine the shared timings with the device's own
+    CTimings timings = provisioner.timings();
+    timings.merge(result.timings);
+    if (result.verify_ms >= 0) timings.add("verify", result.verify_ms);
+    timings.add("total", CTimings::since(start));
+
+    // Find out the wall-clock time, for the benefit of anyone reading the timings file later
+    char   timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof timestamp, "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    // Which mode are we running in?
+    const char* mode = stationMode ? "station" : maxJobs ? "parallel" : batchMode ? "batch" : workerMode ? "worker" : "single";
+
+    // Build the record.  IP addresses have been validated, so none of the strings need escaping
+    string record = string("{\"time\": \"") + timestamp + "\", \"mode\": \"" + mode + "\""
+                  + ", \"usb_ip\": \"" + result.device.usb_ip + "\", \"static_ip\": \"" + result.device.static_ip + "\""
+                  + ", \"result\": \"" + (result.rc ? "failed" : "ok") + "\", \"timings_ms\": " + timings.json()
+                  + ", \"commands\": " + commandsJson(result) + "}";
+
+    // And write it wherever it's wanted.  If the timings file can't be written, it's not worth failing over
+    lock_guard<mutex> lock(timingsMutex);
+    if (timingsJson) cout << record << endl;
+    if (!timingsFile.empty())
+    {
+        ofstream ofile(timingsFile, ios::app);
+        ofile << record << "\n";
+    }
 }
 //==========================================================================================================
 
 
 //==========================================================================================================
-// shell() - Executes a shell command and returns the output as a vector of strings
+// parseCommandLine() - Fetches the USB IP address and desired static IP address from the command line
+//
+// Passed: argc = Number of command line parameters (including the name of the executable)
+//         argv = Array of pointers to the command line parameters
+//
+// On Exit: batch     = The list of SmartLynqs to be programmed.  If the command line was
+//                      "<USB_IP> <STATIC_IP>", this contains exactly one device
+//
+//          batchMode = true if the devices came from a manifest
+//
+//          maxJobs   = If the command line was "-parallel <N> <manifest>", the number of Vivado processes
+//                      that may run at once.  Otherwise 0
+//
+//          workerMode = true if the command line was "-worker"
+//
+//          discoverMode = true if the command line was "--discover"
+//
+//          stationMode = true if the command line was "-station <N> <serial_manifest>".  maxJobs is N,
+//                        and serialManifest holds the serial manifest
+//
+//          commandLineSymbols = The symbols defined with "-D <name>=<value>" (or "-D<name>=<value>"),
+//                               which may appear anywhere on the command line
+//
+//          timingsJson = true if "--timings=json" appears anywhere on the command line
 //==========================================================================================================
-strvec shell(const char* fmt, ...)
+void parseCommandLine(int argc, const char** argv)
 {
-    strvec result;
-    va_list        ap;
-    char           command[1024];
-    char           buffer[1024];
+    uint32_t    ip;
+    CManifest   manifest;
+    const char* manifestFile = nullptr;
+    vector<const char*> args;
 
-    // Format the command
-    va_start(ap, fmt);
-    vsprintf(command, fmt, ap);
-    va_end(ap);
+    // Pull the symbol definitions and options out of the command line, keeping everything else
+    for (int i=0; i<argc; ++i)
+    {
+        // "--timings=json" asks for the timings of each job
+        if (strncmp(argv[i], "--timings", 9) == 0)
+        {
+            if (strcmp(argv[i], "--timings=json") != 0) throw runtime_error("--timings expects --timings=json");
+            timingsJson = true;
+            continue;
+        }
 
-    // Run the command
-    FILE* fp = popen(command, "r");
+        if (strncmp(argv[i], "-D", 2) != 0)
+        {
+            args.push_back(argv[i]);
+            continue;
+        }
 
-    // If we couldn't do that, give up
-    if (fp == nullptr) return result;
+        // The definition is either part of this parameter, or is the next parameter
+        const char* definition = argv[i][2] ? argv[i] + 2 : (i+1 < argc) ? argv[++i] : "";
+        const char* equals = strchr(definition, '=');
+        if (equals == nullptr) throw runtime_error("-D expects <name>=<value>");
+        CProvisioner::define_symbol(commandLineSymbols, string(definition, equals), equals + 1);
+    }
+    argc = args.size();
+    argv = args.data();
+
+    // If the user wants a persistent Vivado that programs devices as they arrive on stdin...
+    if (argc == 2 && strcmp(argv[1], "-worker") == 0)
+    {
+        workerMode = true;
+        return;
+    }
+
+    // If the user wants to find the SmartLynqs that are attached...
+    if (argc == 2 && strcmp(argv[1], "--discover") == 0)
+    {
+        discoverMode = true;
+        return;
+    }
+
+    // If the user wants SmartLynqs programmed as they're plugged in, find out how many at a time
+    if (argc == 4 && strcmp(argv[1], "-station") == 0)
+    {
+        maxJobs = atoi(argv[2]);
+        if (maxJobs < 1) throw runtime_error(string(argv[2])+" is not a valid number of jobs");
+        if (!serialManifest.read(argv[3])) throw runtime_error("Can't open "+string(argv[3]));
+        if (serialManifest.size() == 0) throw runtime_error(string(argv[3])+" contains no devices");
+        stationMode = true;
+        return;
+    }
 
-    // Fetch every line of the output and push it to our vector of strings
-    while (fgets(buffer, sizeof buffer, fp))
+    // If the user wants to program a manifest of devices in parallel, find out how many at a time
+    if (argc == 4 && strcmp(argv[1], "-parallel") == 0)
     {
-        chomp(buffer);
-        result.push_back(buffer);
+        maxJobs = atoi(argv[2]);
+        if (maxJobs < 1) throw runtime_error(string(argv[2])+" is not a valid number of jobs");
+        manifestFile = argv[3];
     }
 
-    // When the program finishes, close the FILE*
-    fclose(fp);
+    // If the user wants to program a manifest of devices from a single Vivado session...
+    else if (argc == 3 && strcmp(argv[1], "-batch") == 0) manifestFile = argv[2];
 
-    // And hand the output of the program (1 string per line) to the caller
-    return result;
+    // If the user gave us a manifest of devices, read it in
+    if (manifestFile)
+    {
+        if (!manifest.read(manifestFile, false)) throw runtime_error("Can't open "+string(manifestFile));
+        batch = manifest.devices();
+        if (batch.empty()) throw runtime_error(string(manifestFile)+" contains no devices");
+        batchMode = true;
+        return;
+    }
+
+    // There should be exactly two parameters on the command line
+    if (argc != 3) showHelp();
+
+    // Ensure that the USB IP address is a properly formatted IPv4 address
+    if (inet_pton(AF_INET, argv[1], &ip) < 1)
+    {
+        cerr << argv[1] << " is malformed\n";
+        exit(1);
+    }
+
+    // Ensure that the static IP address is a properly formatted IPv4 address
+    if (inet_pton(AF_INET, argv[2], &ip) < 1)
+    {
+        cerr << argv[2] << " is malformed\n";
+        exit(1);
+    }
+
+    // Save the two IP addresses as our one and only device
+    batch.push_back({argv[1], argv[2]});
 }
 //==========================================================================================================
 
 
 
+
 //==========================================================================================================
-// runVivado() - Uses the Vivado TCL scripting engine to program the static IP address into the SmartLynq
+// showHelp() - Displays usage text, then exits
 //==========================================================================================================
-int runVivado()
+void showHelp()
 {
-    strvec result;
-
-    // Assume for the moment that we will succeed
-    bool failed = false;
+    cout << "Version " SW_VERSION "\n";
+    printf("Usage: smartlynq_static_ip <USB_IP_ADDRESS> <STATIC_IP_ADDRESS>\n");
+    printf("       smartlynq_static_ip -batch <MANIFEST_FILE>\n");
+    printf("       smartlynq_static_ip -parallel <MAX_JOBS> <MANIFEST_FILE>\n");
+    printf("       smartlynq_static_ip -worker\n");
+    printf("       smartlynq_static_ip --discover\n");
+    printf("       smartlynq_static_ip -station <MAX_JOBS> <SERIAL_MANIFEST_FILE>\n");
+    printf("Symbols for the configuration file can be defined anywhere with -D <SYMBOL>=<VALUE>\n");
+    printf("--timings=json anywhere on the command line reports how long each phase took\n");
+    exit(1);
+}
+//==========================================================================================================
 
-    // Run "%vivado% -help", just to find out if Vivado exists and is runnable
-    result = shell("%s -help 2>&1", vivado.c_str());
 
-    // If the output of that command is just one line, Vivado doesn't exist
-    if (result.size() < 2) throw runtime_error("Vivado not found!");
 
-    // This will take a moment, so make sure the user knows what we're doing
-    cout << "Programming static IP " << symbolTable[STATIC_IP] << "\n";
-    
-    // Run Vivado, capturing it's output into "result"
-    result = shell("%s", vivadoCommandLine.c_str());
+//==========================================================================================================
+// readConfigurationFile() - Reads in the configuration specifications
+//==========================================================================================================
+void readConfigurationFile()
+{
+    provisioner.configure("smartlynq_static_ip.conf", commandLineSymbols);
+}
+//==========================================================================================================
 
-    // Save the Vivado output to a file just for debugging purposes
-    writeStringsToFile(result, tmp+"/script.result");
 
-    // If the result vector is very short, it means Vivado couldn't be found
-    if (result.size() < 2) throw runtime_error("Vivado not found");
+//==========================================================================================================
+// commandsJson() - Returns the outcome of each command of a device's Vivado script as a JSON array
+//==========================================================================================================
+string commandsJson(const result_t& result)
+{
+    string json = "[";
 
-    // Loop through each line of the Vivado output
-    for (auto& s : result)
+    for (size_t i=0; i<result.commands.size(); ++i)
     {
-        // Extract the first word from the line
-        std::string firstWord = s.substr(0, s.find(" "));
+        const command_result_t& command = result.commands[i];
 
-        // If the first word is "ERROR:" or "couldn't", Vivado is reporting that something has gone awry
-        if (firstWord == "ERROR:" || firstWord == "couldn't")
+        // The command comes from the configuration file, so it may contain characters that need escaping
+        string text;
+        for (char c : command.command)
         {
-            failed = true;
-            break;
+            char escaped[8];
+            if (c == '"' || c == '\\') {text += '\\'; text += c;}
+            else if ((unsigned char)c < 0x20) {snprintf(escaped, sizeof escaped, "\\u%04x", c); text += escaped;}
+            else text += c;
         }
+
+        json += (i ? ", " : "") + string("{\"command\": \"") + text + "\", \"rc\": " + to_string(command.rc)
+              + ", \"ms\": " + to_string(command.ms) + "}";
     }
 
-    // If we failed, show the Vivado output to the user
-    if (failed)
+    return json + "]";
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// successMessage() - Returns the message telling the user that a device succeeded, and what was skipped
+//==========================================================================================================
+string successMessage(const result_t& result)
+{
+    string message = "Success!";
+    char   ready[64];
+
+    if (result.already_configured)
+        message += "  (Already configured, nothing to do)";
+    else if (result.skipped_update)
+        message += "  (Firmware was already current)";
+
+    // If we checked that the SmartLynq answers at its static IP address, say how long that took
+    if (result.verify_ms >= 0)
     {
-        cout << "FAILED!!  Vivado says:\n";
-        for (auto& s : result) cout << s << "\n";
-        return 1;       
+        snprintf(ready, sizeof ready, "  (Answered at its static IP after %.1f seconds)", result.verify_ms / 1000);
+        message += ready;
     }
 
-    // If we get here, we've succeded
-    cout << "Success!\n";
-
-    // Tell the caller that no error occured
-    return 0;
+    return message;
 }
 //==========================================================================================================
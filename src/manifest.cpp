@@ -0,0 +1,178 @@
+//==========================================================================================================
+// manifest.cpp - Implements a reader for manifests of SmartLynq devices to be programmed
+//==========================================================================================================
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <fstream>
+#include <stdexcept>
+#include "manifest.h"
+#include "tokenizer.h"
+
+using namespace std;
+
+
+//==========================================================================================================
+// is_ipv4() - Returns true if the string is a properly formatted IPv4 address
+//==========================================================================================================
+static bool is_ipv4(const string& s)
+{
+    uint32_t ip;
+    return inet_pton(AF_INET, s.c_str(), &ip) == 1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parse() - Parses a single "<USB_IP> <STATIC_IP>" line
+//
+// Passed:  line     = The line to be parsed
+//          p_device = Where to store the device described by the line
+//
+// Returns: 'true' if the line describes a device, 'false' if it is blank or a comment
+//
+// Throws a runtime_error if the line is malformed
+//==========================================================================================================
+bool CManifest::parse(const string& line, device_t* p_device)
+{
+    CTokenizer tokenizer;
+    vector<string_view> tokens;
+
+    // Break the line up into tokens
+    tokenizer.parse(line, &tokens);
+
+    // If the line is blank, ignore it
+    if (tokens.empty()) return false;
+
+    // If the line is a comment, ignore it
+    if (tokens[0].substr(0, 1) == "#" || tokens[0].substr(0, 2) == "//") return false;
+
+    // Every line must consist of exactly a USB IP address and a static IP address
+    if (tokens.size() != 2) throw runtime_error("expected <USB_IP> <STATIC_IP>");
+
+    // Hand the caller the device
+    p_device->usb_ip    = tokens[0];
+    p_device->static_ip = tokens[1];
+
+    // Ensure that both IP addresses are properly formatted
+    if (!is_ipv4(p_device->usb_ip))    throw runtime_error(p_device->usb_ip + " is malformed");
+    if (!is_ipv4(p_device->static_ip)) throw runtime_error(p_device->static_ip + " is malformed");
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read() - Reads in the manifest file
+//
+// On Exit: m_devices = one entry per "<USB_IP> <STATIC_IP>" line in the file
+//==========================================================================================================
+bool CManifest::read(string filename, bool msg_on_fail)
+{
+    string   line;
+    device_t device;
+    int      line_number = 0;
+
+    // We don't have any devices yet
+    m_devices.clear();
+
+    // Open the input file
+    ifstream ifile(filename);
+
+    // If the input file couldn't be opened, complain about it
+    if (!ifile.is_open())
+    {
+        if (msg_on_fail) printf("Failed to open file \"%s\"\n", filename.c_str());
+        return false;
+    }
+
+    // Loop through every line of the input file...
+    while (getline(ifile, line))
+    {
+        // Keep track of the line number for error messages
+        ++line_number;
+
+        // Build the name of this line, for use in error messages
+        string where = filename + " line " + to_string(line_number) + ": ";
+
+        // Parse the line, skipping over blank lines and comments
+        try
+        {
+            if (!parse(line, &device)) continue;
+        }
+        catch(const std::exception& e)
+        {
+            throw runtime_error(where + e.what());
+        }
+
+        // Every device must have its own USB IP address
+        for (auto& d : m_devices)
+        {
+            if (d.usb_ip == device.usb_ip) throw runtime_error(where + device.usb_ip + " is listed twice");
+        }
+
+        // Add this device to our list
+        m_devices.push_back(device);
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read() - Reads in a manifest of "<SERIAL_NUMBER> <STATIC_IP>" lines
+//
+// On Exit: m_static_ip = the static IP address for each serial number in the file
+//==========================================================================================================
+bool CSerialManifest::read(string filename)
+{
+    CTokenizer tokenizer;
+    vector<string_view> tokens;
+    string   line;
+    int      line_number = 0;
+
+    // We don't have any devices yet
+    m_static_ip.clear();
+
+    // Open the input file
+    ifstream ifile(filename);
+    if (!ifile.is_open()) return false;
+
+    // Loop through every line of the input file...
+    while (getline(ifile, line))
+    {
+        // Build the name of this line, for use in error messages
+        string where = filename + " line " + to_string(++line_number) + ": ";
+
+        // Skip over blank lines and comments
+        tokenizer.parse(line, &tokens);
+        if (tokens.empty() || tokens[0].substr(0, 1) == "#" || tokens[0].substr(0, 2) == "//") continue;
+
+        // Every line must consist of exactly a serial number and a static IP address
+        if (tokens.size() != 2) throw runtime_error(where + "expected <SERIAL_NUMBER> <STATIC_IP>");
+        string serial(tokens[0]), static_ip(tokens[1]);
+        if (!is_ipv4(static_ip)) throw runtime_error(where + static_ip + " is malformed");
+
+        // Every SmartLynq must be listed only once
+        if (m_static_ip.count(serial)) throw runtime_error(where + serial + " is listed twice");
+        m_static_ip[serial] = static_ip;
+    }
+
+    // Tell the caller that all is well
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// lookup() - Looks up the static IP address that belongs to a serial number
+//==========================================================================================================
+bool CSerialManifest::lookup(const string& serial, string* p_static_ip) const
+{
+    auto it = m_static_ip.find(serial);
+    if (it == m_static_ip.end()) return false;
+    *p_static_ip = it->second;
+    return true;
+}
+//==========================================================================================================
@@ -0,0 +1,76 @@
+//==========================================================================================================
+// manifest.h - Defines a reader for manifests of SmartLynq devices to be programmed
+//==========================================================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+
+//----------------------------------------------------------------------------------------------------------
+// device_t - Describes a single SmartLynq that is to be programmed
+//----------------------------------------------------------------------------------------------------------
+struct device_t
+{
+    // The IP address of the SmartLynq's IP-over-USB interface
+    std::string usb_ip;
+
+    // The static IP address to be programmed into the SmartLynq
+    std::string static_ip;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// CManifest - Reads a file containing one "<USB_IP> <STATIC_IP>" pair per line
+//
+// Blank lines, and lines that begin with '#' or "//" are ignored
+//----------------------------------------------------------------------------------------------------------
+class CManifest
+{
+public:
+
+    // Call this to read the manifest.  Returns 'true' on success, 'false' if file not found
+    // Can throw exception runtime_error if the manifest is malformed
+    bool    read(std::string filename, bool msg_on_fail = true);
+
+    // Call this to parse a single line.  Returns 'false' if the line is blank or a comment
+    // Can throw exception runtime_error if the line is malformed
+    bool    parse(const std::string& line, device_t* p_device);
+
+    // Call this to fetch the list of devices that were in the manifest
+    const std::vector<device_t>& devices() {return m_devices;}
+
+protected:
+
+    // The devices that were listed in the manifest, in the order they were listed
+    std::vector<device_t> m_devices;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// CSerialManifest - Reads a file containing one "<SERIAL_NUMBER> <STATIC_IP>" pair per line, for
+//                   programming SmartLynqs that are identified by serial number rather than USB IP address
+//
+// Blank lines, and lines that begin with '#' or "//" are ignored
+//----------------------------------------------------------------------------------------------------------
+class CSerialManifest
+{
+public:
+
+    // Call this to read the manifest.  Returns 'true' on success, 'false' if file not found
+    // Can throw exception runtime_error if the manifest is malformed
+    bool    read(std::string filename);
+
+    // Call this to look up the static IP address for a serial number.  Returns 'false' if it isn't listed
+    bool    lookup(const std::string& serial, std::string* p_static_ip) const;
+
+    // Call this to find out how many SmartLynqs are listed
+    size_t  size() const {return m_static_ip.size();}
+
+protected:
+
+    // The static IP address for each serial number
+    std::map<std::string, std::string> m_static_ip;
+};
+//----------------------------------------------------------------------------------------------------------
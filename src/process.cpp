@@ -0,0 +1,390 @@
+//==========================================================================================================
+// process.cpp - Implements a runner for child processes whose output is processed as it arrives
+//==========================================================================================================
+#include <unistd.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include "process.h"
+
+using namespace std;
+
+// This is the environment that child processes inherit
+extern char** environ;
+
+// This is the process-group ID of every running child, so the signal handler can kill them
+static const int MAX_CHILDREN = 256;
+static atomic<pid_t> running_child[MAX_CHILDREN];
+
+
+//==========================================================================================================
+// now_ms() - Returns the current time in milliseconds on a clock that never jumps
+//==========================================================================================================
+static int64_t now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// set_timeout() - Sets a deadline for the arrival of lines
+//
+// Passed: milliseconds = How long from now the deadline is.  0 means "no deadline"
+//==========================================================================================================
+void CLineReader::set_timeout(int milliseconds)
+{
+    m_deadline = (milliseconds > 0) ? now_ms() + milliseconds : 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read_line() - Fetches the next line from the file descriptor
+//
+// Passed:  line = Where to store the line, without any carriage-return or linefeed
+//
+// Returns: LINE        = "line" contains the next line
+//          END_OF_FILE = The other end closed the file descriptor
+//          TIMEOUT     = The deadline passed before a complete line arrived
+//==========================================================================================================
+int CLineReader::read_line(string& line)
+{
+    char buffer[4096];
+
+    while (true)
+    {
+        // If we already have a complete line, hand it to the caller
+        size_t eol = m_buffer.find('\n');
+        if (eol != string::npos)
+        {
+            line.assign(m_buffer, 0, eol);
+            m_buffer.erase(0, eol + 1);
+            if (!line.empty() && line.back() == 13) line.pop_back();
+            return LINE;
+        }
+
+        // Figure out how long we're allowed to wait for more data
+        int timeout = -1;
+        if (m_deadline)
+        {
+            int64_t remaining = m_deadline - now_ms();
+            if (remaining <= 0) return TIMEOUT;
+            timeout = (int)remaining;
+        }
+
+        // Wait for data to arrive
+        pollfd pfd = {m_fd, POLLIN, 0};
+        int rc = poll(&pfd, 1, timeout);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc == 0) return TIMEOUT;
+
+        // Fetch whatever data is available
+        ssize_t count = (rc < 0) ? 0 : read(m_fd, buffer, sizeof buffer);
+        if (count < 0 && errno == EINTR) continue;
+
+        // If there's more data, append it to our buffer and go look for a complete line
+        if (count > 0)
+        {
+            m_buffer.append(buffer, count);
+            continue;
+        }
+
+        // If we get here, the other end is closed.  Any partial line is still a line
+        if (m_buffer.empty()) return END_OF_FILE;
+        line.swap(m_buffer);
+        m_buffer.clear();
+        if (line.back() == 13) line.pop_back();
+        return LINE;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// kill_running_children() - Signal handler that kills every running child, then dies of the same signal
+//==========================================================================================================
+static void kill_running_children(int sig)
+{
+    for (int i=0; i<MAX_CHILDREN; ++i)
+    {
+        pid_t pid = running_child[i];
+        if (pid) kill(-pid, SIGKILL);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// kill_children_on_signal() - Arranges for SIGINT and SIGTERM to kill every running child before we exit
+//==========================================================================================================
+void CProcess::kill_children_on_signal()
+{
+    signal(SIGINT,  kill_running_children);
+    signal(SIGTERM, kill_running_children);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// register_child() - Records a running child's process group so the signal handler can kill it
+//==========================================================================================================
+void CProcess::register_child(pid_t pid)
+{
+    for (int i=0; i<MAX_CHILDREN; ++i)
+    {
+        pid_t empty = 0;
+        if (running_child[i].compare_exchange_strong(empty, pid)) return;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// unregister_child() - Forgets about a child that is no longer running
+//==========================================================================================================
+void CProcess::unregister_child(pid_t pid)
+{
+    for (int i=0; i<MAX_CHILDREN; ++i)
+    {
+        pid_t expected = pid;
+        if (running_child[i].compare_exchange_strong(expected, 0)) return;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// spawn() - Starts a shell command in a process group of its own
+//
+// Passed:  command   = The shell command to run
+//          input_fd  = The file descriptor that becomes the command's stdin, or -1 to share ours
+//          output_fd = The file descriptor that becomes the command's stdout and stderr
+//
+// Returns: The process ID of the command (which is also its process group ID), or -1 if it couldn't
+//          be started
+//
+// The command is registered as a running child, so that if we're interrupted by a signal, the command
+// and everything it started die too.  It must be unregistered once it has been reaped
+//==========================================================================================================
+pid_t CProcess::spawn(const string& command, int input_fd, int output_fd)
+{
+    pid_t                      pid;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    sigset_t                   fatal, old_mask;
+
+    // Hold off SIGINT and SIGTERM until the child is registered.  Otherwise the signal handler could run
+    // after the child exists but before it knows to kill it, and the child would outlive us
+    sigemptyset(&fatal);
+    sigaddset(&fatal, SIGINT);
+    sigaddset(&fatal, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &fatal, &old_mask);
+
+    // Hook up the child's stdin, stdout and stderr
+    posix_spawn_file_actions_init(&actions);
+    if (input_fd >= 0) posix_spawn_file_actions_adddup2(&actions, input_fd, 0);
+    posix_spawn_file_actions_adddup2(&actions, output_fd, 1);
+    posix_spawn_file_actions_adddup2(&actions, output_fd, 2);
+
+    // The child runs in its own process group, and starts out with the signal mask we had on the way in
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setsigmask(&attr, &old_mask);
+
+    // Start the command
+    const char* argv[] = {"sh", "-c", command.c_str(), NULL};
+    int rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, (char* const*)argv, environ);
+
+    // We're done with the spawn attributes
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    // If we're interrupted by a signal, the child must die too
+    if (rc == 0) register_child(pid);
+
+    // Now a signal can be handled
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    // Tell the caller the process ID of the child, or that we couldn't start it
+    return (rc == 0) ? pid : -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run() - Runs a shell command, handing each line of its output to a callback as it arrives
+//
+// Passed:  command = The shell command to run
+//          on_line = Called with each line of output, without any carriage-return or linefeed.  If this
+//                    returns 'false', the command (and everything it started) is killed immediately
+//
+// Returns: The exit code of the command, or 128 + signal number if it was killed by a signal
+//
+// The command runs in its own process group so that if it must be killed, any processes that it
+// started die along with it.  The command is killed if the deadline (which starts out as the one given
+// to "set_initial_timeout()", and can be changed by the line handler) passes.  Lines of any length are
+// handled.  If there is input text, it is written to the command's stdin from a separate thread so that
+// a command that doesn't read all of its input before producing output can't deadlock us.
+//==========================================================================================================
+int CProcess::run(string command, line_handler_t on_line)
+{
+    int    fd[2], in[2] = {-1, -1}, status, rc;
+    thread writer;
+    pid_t  pid;
+    string line;
+
+    // We haven't aborted the command (yet!)
+    m_aborted = m_timed_out = false;
+
+    // Create the pipe that the child will write its output into
+    if (pipe2(fd, O_CLOEXEC) < 0) throw runtime_error("Can't create pipe");
+
+    // If we have input for the child, create the pipe that it will read it from
+    if (!m_input.empty() && pipe2(in, O_CLOEXEC) < 0)
+    {
+        close(fd[0]);
+        close(fd[1]);
+        throw runtime_error("Can't create pipe");
+    }
+
+    // Start the command with its stdout and stderr both going into the pipe
+    pid = spawn(command, in[0], fd[1]);
+
+    // We're done with the child's ends of the pipes
+    close(fd[1]);
+    if (in[0] >= 0) close(in[0]);
+
+    // If we couldn't start the command, complain
+    if (pid < 0)
+    {
+        close(fd[0]);
+        if (in[1] >= 0) close(in[1]);
+        throw runtime_error("Can't run " + command);
+    }
+
+    // If we have input for the child, start feeding it.  If the child dies before reading all of it,
+    // the write must fail rather than kill us
+    if (in[1] >= 0)
+    {
+        writer = thread([this, in]()
+        {
+            CSigpipeBlocker blocker;
+            const char* p = m_input.data();
+            size_t remaining = m_input.size();
+            while (remaining)
+            {
+                ssize_t count = write(in[1], p, remaining);
+                if (count < 0 && errno == EINTR) continue;
+                if (count <= 0) break;
+                p += count;
+                remaining -= count;
+            }
+            close(in[1]);
+        });
+    }
+
+    // Start reading the output of the command
+    m_reader.attach(fd[0]);
+    m_reader.set_timeout(m_timeout);
+
+    // Hand each line of output to the callback until the command closes its end of the pipe
+    while (true)
+    {
+        rc = m_reader.read_line(line);
+
+        // If the command is taking too long, kill it
+        if (rc == CLineReader::TIMEOUT)
+        {
+            m_timed_out = true;
+            kill(-pid, SIGKILL);
+            break;
+        }
+
+        // If the command has closed its end of the pipe, we're done
+        if (rc == CLineReader::END_OF_FILE) break;
+
+        // If the callback has seen enough, kill the command
+        if (!on_line(line))
+        {
+            m_aborted = true;
+            kill(-pid, SIGKILL);
+            break;
+        }
+    }
+
+    // We're done with our end of the pipe
+    close(fd[0]);
+
+    // Wait for the command to finish and fetch its exit status
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    unregister_child(pid);
+
+    // Once the command is gone, the input writer can't be blocked any longer
+    if (writer.joinable()) writer.join();
+
+    // Translate the exit status into something easy to use
+    if (WIFEXITED(status))
+        m_exit_status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        m_exit_status = 128 + WTERMSIG(status);
+    else
+        m_exit_status = -1;
+
+    // Hand the caller the exit status
+    return m_exit_status;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run() - Runs a shell command and returns its output as a vector of strings (one string per line)
+//==========================================================================================================
+int CProcess::run(string command, vector<string>* p_output)
+{
+    p_output->clear();
+    return run(command, [p_output](const string& line) {p_output->push_back(line); return true;});
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CSigpipeBlocker - Blocks SIGPIPE on the calling thread for as long as it exists
+//==========================================================================================================
+CSigpipeBlocker::CSigpipeBlocker()
+{
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &m_old_mask);
+}
+
+CSigpipeBlocker::~CSigpipeBlocker()
+{
+    sigset_t sigpipe, pending;
+    struct timespec no_wait = {0, 0};
+
+    // If SIGPIPE was already blocked when we started, whatever is pending isn't ours to discard
+    if (sigismember(&m_old_mask, SIGPIPE)) return;
+
+    // Our failed writes leave a SIGPIPE pending on this thread.  Swallow it before it's unblocked
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    if (sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE)) sigtimedwait(&sigpipe, NULL, &no_wait);
+
+    pthread_sigmask(SIG_SETMASK, &m_old_mask, NULL);
+}
+//==========================================================================================================
@@ -0,0 +1,145 @@
+//==========================================================================================================
+// process.h - Defines a runner for child processes whose output is processed as it arrives
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+//----------------------------------------------------------------------------------------------------------
+// CLineReader - Reads lines of any length from a file descriptor, with an optional deadline
+//----------------------------------------------------------------------------------------------------------
+class CLineReader
+{
+public:
+
+    // These are the possible results of "read_line()"
+    enum {LINE, END_OF_FILE, TIMEOUT};
+
+    // Default constructor
+    CLineReader() {m_fd = -1; m_deadline = 0;}
+
+    // Call this to begin reading from a file descriptor.  Clears any deadline
+    void    attach(int fd) {m_fd = fd; m_buffer.clear(); m_deadline = 0;}
+
+    // Call this to set a deadline this many milliseconds from now.  0 means "no deadline"
+    void    set_timeout(int milliseconds);
+
+    // Call this to fetch the next line, without any carriage-return or linefeed.
+    // Returns LINE, END_OF_FILE, or TIMEOUT if the deadline passed before a line arrived
+    int     read_line(std::string& line);
+
+protected:
+
+    // The file descriptor we're reading from
+    int     m_fd;
+
+    // Data that has been read but not yet handed to the caller
+    std::string m_buffer;
+
+    // The deadline in milliseconds of CLOCK_MONOTONIC, or 0 for none
+    int64_t m_deadline;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CProcess - Runs a shell command and hands each line of its output (stdout and stderr) to a callback
+//            as soon as the line arrives.  The callback can abort the command at any time, and can set
+//            a deadline after which the command is killed.
+//----------------------------------------------------------------------------------------------------------
+class CProcess
+{
+public:
+
+    // A line handler is called once per line of output.  Returning 'false' kills the command
+    typedef std::function<bool(const std::string& line)> line_handler_t;
+
+    // Default constructor
+    CProcess() {m_exit_status = -1; m_aborted = m_timed_out = false; m_timeout = 0;}
+
+    // Call this before "run()" to set the initial deadline in milliseconds.  0 means "no deadline"
+    void    set_initial_timeout(int milliseconds) {m_timeout = milliseconds;}
+
+    // A line handler can call this to set a new deadline this many milliseconds from now
+    void    set_timeout(int milliseconds) {m_reader.set_timeout(milliseconds);}
+
+    // Call this before "run()" to feed text to the command's stdin.  If this is never called (or is
+    // called with an empty string), the command shares our stdin
+    void    set_input(const std::string& text) {m_input = text;}
+
+    // Call this to run a shell command.  Returns the exit status of the command (see below)
+    // Can throw exception runtime_error
+    int     run(std::string command, line_handler_t on_line);
+
+    // Convenience method: runs a command and returns its output as a vector of strings
+    // Can throw exception runtime_error
+    int     run(std::string command, std::vector<std::string>* p_output);
+
+    // The exit code of the command, or 128 + signal number if the command was killed by a signal
+    int     exit_status() {return m_exit_status;}
+
+    // Tells the caller whether the command was killed because a line handler returned 'false'
+    bool    was_aborted() {return m_aborted;}
+
+    // Tells the caller whether the command was killed because a deadline passed
+    bool    timed_out() {return m_timed_out;}
+
+    // Call this once at startup so that SIGINT and SIGTERM kill every running child before we exit
+    static void kill_children_on_signal();
+
+    // Starts a shell command in a process group of its own, with its stdin (unless "input_fd" is -1),
+    // stdout and stderr redirected, and registers it as a running child.  Returns its process ID, or -1
+    static pid_t spawn(const std::string& command, int input_fd, int output_fd);
+
+    // These keep track of running children (by process group) so the signal handler can kill them
+    static void register_child(pid_t pid);
+    static void unregister_child(pid_t pid);
+
+protected:
+
+    // Reads the output of the command
+    CLineReader m_reader;
+
+    // The initial deadline in milliseconds
+    int     m_timeout;
+
+    // The text that will be written to the command's stdin
+    std::string m_input;
+
+    // The exit status of the most recently run command
+    int     m_exit_status;
+
+    // True if the most recently run command was killed by the line handler or by a deadline
+    bool    m_aborted, m_timed_out;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CSigpipeBlocker - Blocks SIGPIPE on the calling thread for as long as it exists, so that writing to a
+//                   pipe whose reader has died fails with EPIPE rather than killing the whole program.
+//                   A SIGPIPE raised meanwhile is discarded.  Other threads' handling of SIGPIPE is left
+//                   alone, so programs that link against us keep whatever disposition they chose
+//----------------------------------------------------------------------------------------------------------
+class CSigpipeBlocker
+{
+public:
+
+    // Blocks SIGPIPE on this thread
+    CSigpipeBlocker();
+
+    // Discards any SIGPIPE raised while it was blocked, then restores this thread's signal mask
+    ~CSigpipeBlocker();
+
+protected:
+
+    // This thread's signal mask before we blocked SIGPIPE
+    sigset_t m_old_mask;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,1623 @@
+//==========================================================================================================
+// provisioner.cpp - Implements the engine that programs static IP addresses into SmartLynqs
+//==========================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <filesystem>
+#include <future>
+#include <condition_variable>
+#include <memory>
+#include <stdexcept>
+#include "provisioner.h"
+#include "config_file.h"
+#include "process.h"
+#include "tokenizer.h"
+
+using namespace std;
+
+// We're going to use a lot of these, so make it convenient
+typedef vector<string> strvec;
+
+// Every key of the configuration file, and where in a config_t its value is stored
+using config_t = CProvisioner::config_t;
+typedef CConfigKey<config_t> config_key_t;
+constexpr config_key_t configSchema[] =
+{
+    {"vivado",              config_key_t::REQUIRED, &config_t::vivado             },
+    {"tmp",                 config_key_t::REQUIRED, &config_t::tmp                },
+    {"command_line",        config_key_t::REQUIRED, &config_t::command_line       },
+    {"worker_command_line", config_key_t::OPTIONAL, &config_t::worker_command_line},
+    {"use_temp_files",      config_key_t::OPTIONAL, &config_t::use_temp_files     },
+    {"launch_timeout",      config_key_t::OPTIONAL, &config_t::launch_timeout     },
+    {"connect_timeout",     config_key_t::OPTIONAL, &config_t::connect_timeout    },
+    {"update_timeout",      config_key_t::OPTIONAL, &config_t::update_timeout     },
+    {"reset_timeout",       config_key_t::OPTIONAL, &config_t::reset_timeout      },
+    {"firmware_version",    config_key_t::OPTIONAL, &config_t::firmware_version   },
+    {"firmware_query",      config_key_t::OPTIONAL, &config_t::firmware_query     },
+    {"serial_query",        config_key_t::OPTIONAL, &config_t::serial_query       },
+    {"config_query",        config_key_t::OPTIONAL, &config_t::config_query       },
+    {"config.ini",          config_key_t::REQUIRED, &config_t::config_ini         },
+    {"vivado_script",       config_key_t::REQUIRED, &config_t::vivado_script      },
+    {"symbols",             config_key_t::OPTIONAL, &config_t::symbols            },
+    {"timings_file",        config_key_t::OPTIONAL, &config_t::timings_file       },
+    {"hw_server_port",      config_key_t::OPTIONAL, &config_t::hw_server_port     },
+    {"discover_interfaces", config_key_t::OPTIONAL, &config_t::discover_interfaces},
+    {"discover_timeout_ms", config_key_t::OPTIONAL, &config_t::discover_timeout_ms},
+    {"station_rescan_ms",   config_key_t::OPTIONAL, &config_t::station_rescan_ms  },
+    {"verify_timeout",      config_key_t::OPTIONAL, &config_t::verify_timeout     },
+    {"pipeline_depth",      config_key_t::OPTIONAL, &config_t::pipeline_depth     },
+};
+
+// This is all of the symbols we support
+static const string USB_IP       = "%usb_ip%";
+static const string STATIC_IP    = "%static_ip%";
+static const string GATEWAY_IP   = "%gateway_ip%";
+static const string VIVADO       = "%vivado%";
+static const string TMP          = "%tmp%";
+static const string CONFIG_INI   = "%config_ini%";
+static const string SKIP_UPDATE  = "%skip_update%";
+static const string UNLESS_CONFIGURED = "%unless_configured%";
+
+// In batch mode, the Vivado script reports the outcome for each device with a line that starts with this
+static const string RESULT_TAG   = "SMARTLYNQ_RESULT";
+
+// The Vivado script announces the start of each phase of programming with a line that starts with this
+static const string PHASE_TAG    = "SMARTLYNQ_PHASE";
+
+// The Vivado script reports the SmartLynq's serial number and firmware version with a line that starts with this
+static const string FIRMWARE_TAG = "SMARTLYNQ_FIRMWARE";
+
+// The Vivado script reports that the SmartLynq was already configured with a line that starts with this
+static const string CONFIG_TAG   = "SMARTLYNQ_CONFIGURED";
+
+// The Vivado script reports the outcome of each of its commands with a line that starts with this
+static const string COMMAND_TAG  = "SMARTLYNQ_COMMAND";
+
+// In a pipelined batch, the tag that announces Vivado has let go of a SmartLynq that was rebooting
+static const string RELEASE_TAG  = "SMARTLYNQ_RELEASED";
+
+
+//==========================================================================================================
+// computeGatewayIP() - Compute the IP address of the gateway that will be programmed into SmartLynq
+//
+// Passed:  staticIP = The static IP to be programmed
+//
+// Returns: The gateway IP address to be programmed
+//==========================================================================================================
+static string computeGatewayIP(const string& staticIP)
+{
+    unsigned char octet[4];
+    char buffer[50];
+
+    // Convert the static IP address from a string into the four octets
+    inet_pton(AF_INET, staticIP.c_str(), octet);
+
+    // Change the last octet to a 1.  For instance 10.11.12.3 becomes 10.11.12.1
+    octet[3] = 1;
+
+    // Covert the octets back to a dotted quad IP address
+    inet_ntop(AF_INET, octet, buffer, sizeof buffer);
+
+    // And hand the result to the caller
+    return buffer;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeStringsToFile() - Writes every string in a string-vector to the specified filename
+//==========================================================================================================
+static void writeStringsToFile(const strvec& v, const string& filename)
+{
+    // Open the file
+    ofstream ofile(filename);
+
+    // If we can't open the file, that's fatal
+    if (!ofile.is_open()) throw runtime_error("Can't create " + filename);
+
+    // Write every string in vector to the file
+    for (auto& s : v) ofile << s << "\n";
+
+    // And we're done writing the file
+    ofile.close();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parseFirmware() - Parses the "<serial_number> <version>" that follows a firmware report, or that makes
+//                   up a line of the firmware cache
+//
+// Passed:  text      = The text to parse
+//          p_serial  = Receives the serial number
+//          p_version = Receives the firmware version
+//
+// Returns: true if the text was exactly two words.  Vivado reports anything that isn't a plain TCL word
+//          as "unknown", so anything else is a malformed report
+//==========================================================================================================
+static bool parseFirmware(const char* text, string* p_serial, string* p_version)
+{
+    char serial[256] = "", version[256] = "";
+    int  end = 0;
+
+    // Fetch both words, and make sure that nothing but white-space follows them
+    if (sscanf(text, " %255s %255s %n", serial, version, &end) < 2 || end == 0 || text[end]) return false;
+
+    *p_serial  = serial;
+    *p_version = version;
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeStringsToMemory() - Writes every string in a string-vector to an anonymous in-memory file
+//
+// Passed:  v    = The strings to write
+//          name = The name of the in-memory file (only used for debugging)
+//
+// Returns: The file descriptor of the in-memory file.  The file disappears when it is closed.  Other
+//          processes can open it as "/proc/<our_pid>/fd/<file_descriptor>"
+//==========================================================================================================
+static int writeStringsToMemory(strvec& v, const string& name)
+{
+    string text;
+
+    // Create the in-memory file
+    int fd = memfd_create(name.c_str(), MFD_CLOEXEC);
+
+    // If we can't create the file, that's fatal
+    if (fd < 0) throw runtime_error("Can't create in-memory " + name);
+
+    // Write every string in the vector to the file
+    for (auto& s : v) text += s + "\n";
+    if (write(fd, text.data(), text.size()) != (ssize_t)text.size())
+    {
+        close(fd);
+        throw runtime_error("Can't write in-memory " + name);
+    }
+
+    // Hand the caller the file descriptor
+    return fd;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stdinScript() - Returns the text that runs a Vivado script when fed to Vivado's stdin in TCL mode
+//
+// In TCL mode, Vivado carries on with the next command after an error, so the script is wrapped in a
+// "catch" that reports the error and exits with a failing status, just as batch mode would.  The first
+// thing the script does is end the line, so that any prompt Vivado prints is on a line of its own
+//==========================================================================================================
+static string stdinScript(const strvec& script)
+{
+    string result = "if {[catch {\nputs {}\n";
+    for (auto& s : script) result += s + "\n";
+    result += "} msg]} {puts \"ERROR: [string map [list \\n { }] $msg]\"; exit 1}\nexit\n";
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// isCompleteCommand() - Returns true if some TCL is a complete command, i.e., it has no unclosed braces,
+//                       brackets or quotes, and doesn't end with a backslash that continues the line
+//==========================================================================================================
+static bool isCompleteCommand(const string& text)
+{
+    int  braces = 0, brackets = 0;
+    bool quoted = false;
+
+    for (size_t i=0; i<text.size(); ++i)
+    {
+        char c = text[i];
+
+        // A backslash escapes the next character.  If there isn't one, the command continues
+        if (c == '\\')
+        {
+            if (++i == text.size()) return false;
+            continue;
+        }
+
+        // Inside of braces, only braces matter
+        if (braces)
+        {
+            if (c == '{') ++braces;
+            if (c == '}') --braces;
+            continue;
+        }
+
+        if      (c == '"') quoted = !quoted;
+        else if (c == '{' && !quoted) ++braces;
+        else if (c == '[') ++brackets;
+        else if (c == ']' && brackets) --brackets;
+    }
+
+    return braces == 0 && brackets == 0 && !quoted;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// tclWord() - Returns a string quoted so that TCL takes it as a single word, exactly as it is
+//==========================================================================================================
+static string tclWord(string_view text)
+{
+    // Most words can simply be enclosed in braces
+    if (text.find_first_of("{}\\") == string_view::npos) return "{" + string(text) + "}";
+
+    // Otherwise, every character that means something to TCL is escaped
+    string result;
+    for (char c : text)
+    {
+        if (strchr("{}[]$\"\\; \t", c)) result += '\\';
+        result += c;
+    }
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// expectedConfig() - Returns the settings in a rendered config.ini as a TCL list of "<key> <value>" pairs
+//
+// Passed:  configIni = The translated contents of the config.ini file
+//
+// Only lines of the form "set <key> <value>" are settings; everything else is ignored.  The value is the
+// rest of the line, however long it is and however many tokens it has
+//==========================================================================================================
+static string expectedConfig(const strvec& configIni)
+{
+    CTokenizer          tokenizer;
+    vector<string_view> tokens;
+    string              result;
+
+    for (auto& s : configIni)
+    {
+        tokenizer.parse(s, &tokens);
+        if (tokens.size() < 2 || tokens[0] != "set") continue;
+
+        // The value is every token after the key, separated by single spaces
+        string value;
+        for (size_t i = 2; i < tokens.size(); ++i) value += (i > 2 ? " " : "") + string(tokens[i]);
+
+        result += " " + tclWord(tokens[1]) + " " + tclWord(value);
+    }
+
+    return "{" + result + " }";
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// configure() - Reads in the configuration specifications
+//
+// Passed:  filename = The name of the configuration file
+//          symbols  = Symbols that override the user-defined symbols in the configuration file
+//==========================================================================================================
+void CProvisioner::configure(const string& filename, const symtab_t& symbols)
+{
+    CConfigFile cf;
+    CTimings::CSpan span(m_timings, "config_read");
+
+    // Read in the config file.  As long as it doesn't change, it only needs to be parsed once
+    cf.set_cache_file(filename + ".cache");
+    if (!cf.read(filename, false)) throw runtime_error("Can't open "+filename);
+
+    // Fetch every setting, making sure that each one exists (if it must) and has the right type
+    m_config = config_t();
+    cf.load(configSchema, &m_config);
+
+    // If the config file had to be parsed, cache it for next time, unless we mustn't write any files
+    if (m_config.use_temp_files) cf.write_cache();
+
+    // Compile the command lines and the templates
+    m_command_line        = m_config.command_line;
+    m_worker_command_line = m_config.worker_command_line;
+    m_config_ini          = CTemplate::compile(m_config.config_ini);
+    m_vivado_script       = CTemplate::compile(m_config.vivado_script);
+
+    // Find the commands in the Vivado script, so that each can be run and timed on its own
+    m_commands = find_commands(m_config.vivado_script);
+
+    // Look up the deadline for each phase of programming by the name of the phase
+    m_phase_timeout =
+    {
+        {"launch",  m_config.launch_timeout },
+        {"connect", m_config.connect_timeout},
+        {"update",  m_config.update_timeout },
+        {"reset",   m_config.reset_timeout  }
+    };
+
+    // Fetch the user-defined symbols, one "<name> <value>" per line
+    m_symbols.clear();
+    for (auto& line : m_config.symbols)
+    {
+        size_t split = line.find_first_of(" \t");
+        size_t value = line.find_first_not_of(" \t", split);
+        define_symbol(m_symbols, line.substr(0, split), value == string::npos ? "" : line.substr(value));
+    }
+
+    // The symbols we were handed override the ones in the configuration file
+    for (auto& pair : symbols) m_symbols[pair.first] = pair.second;
+
+    // Vivado may have moved, so it has to be checked again
+    m_vivado_ok = false;
+
+    // Find out which SmartLynqs are already known to be running the bundled firmware
+    load_firmware();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// timings() - Returns the timings of the work that is shared by every SmartLynq
+//==========================================================================================================
+CTimings CProvisioner::timings()
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_timings;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// define_symbol() - Adds a user-defined symbol to a symbol table
+//
+// Passed:  symbols = The symbol table
+//          name    = The name of the symbol, without the '%' delimiters
+//          value   = The text that will be substituted for the symbol
+//
+// Can throw exception runtime_error if the name isn't a valid symbol name
+//==========================================================================================================
+void CProvisioner::define_symbol(symtab_t& symbols, const string& name, const string& value)
+{
+    if (!CTemplate::is_symbol_name(name)) throw runtime_error("\""+name+"\" is not a valid symbol name");
+    symbols["%" + name + "%"] = value;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// check_vivado() - Throws a runtime_error if Vivado doesn't exist or isn't runnable
+//
+// On Exit: m_vivado_version = The version string that Vivado reports about itself
+//
+// Running Vivado to find out whether it works is slow, so once we know that a particular Vivado
+// executable works, we record its identity (path, inode, size and modification time) and its version in
+// a cache file.  As long as the executable still has the same identity, we trust the cache and never
+// need to run Vivado just to check on it.  Once it has passed, it isn't checked again.  If "use_temp_files"
+// is false, an existing cache file is still trusted, but a new one isn't written
+//==========================================================================================================
+void CProvisioner::check_vivado()
+{
+    struct stat sb;
+    string      cachedKey;
+
+    // If we already know that Vivado works, we're done
+    lock_guard<mutex> lock(m_mutex);
+    if (m_vivado_ok) return;
+    CTimings::CSpan span(m_timings, "vivado_check");
+
+    // This is the file where we cache the identity of a Vivado executable that is known to work
+    string cacheFile = m_config.tmp + "/smartlynq_vivado.cache";
+
+    // If the Vivado executable doesn't exist or isn't executable, it certainly won't run
+    if (stat(m_config.vivado.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode) || access(m_config.vivado.c_str(), X_OK) != 0)
+    {
+        throw runtime_error("Vivado not found!");
+    }
+
+    // Build the identity of this Vivado executable
+    string key = to_string(sb.st_ino) + " " + to_string(sb.st_size) + " "
+               + to_string(sb.st_mtim.tv_sec) + "." + to_string(sb.st_mtim.tv_nsec) + " " + m_config.vivado;
+
+    // If the cache says this exact executable is known to work, we're done
+    ifstream ifile(cacheFile);
+    if (getline(ifile, cachedKey) && cachedKey == key && getline(ifile, m_vivado_version))
+    {
+        m_vivado_ok = true;
+        return;
+    }
+
+    // Run "%vivado% -version", just to find out if Vivado is runnable
+    CProcess process;
+    strvec   result;
+    process.run(m_config.vivado + " -version", &result);
+
+    // If the output of that command is just one line, Vivado doesn't exist
+    if (result.size() < 2) throw runtime_error("Vivado not found!");
+
+    // The first line of the output is the version string
+    m_vivado_version = result[0];
+    m_vivado_ok = true;
+
+    // Record the fact that this Vivado executable works, unless we mustn't write any files.  If we can't,
+    // we'll just check again next time
+    strvec cache = {key, m_vivado_version};
+    try
+    {
+        if (m_config.use_temp_files) writeStringsToFile(cache, cacheFile);
+    }
+    catch(const std::exception& e) {}
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// make_scratch_dir() - Creates a directory under "tmp" where a single job can store its temporary files
+//
+// Passed:  name = A name that is unique among all the jobs that might be running at the same time
+//
+// Returns: The path of the directory
+//==========================================================================================================
+string CProvisioner::make_scratch_dir(const string& name)
+{
+    string path = m_config.tmp + "/smartlynq_" + name;
+    filesystem::create_directories(path);
+    return path;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// prepare_job() - Performs macro substitution for a single device and writes its files to disk
+//
+// Passed:  job    = The job to be filled in
+//          device = The device that this job will program
+//
+// On Exit: job.scratch       = A directory of temporary files that belongs only to this job
+//          job.command_line  = The translated Vivado command line
+//          job.config_ini    = The translated contents of the config.ini file
+//          job.vivado_script = The translated Vivado script
+//
+//          "config.ini" and "script.tcl" have been written into job.scratch, or if we don't use temporary
+//          files, config.ini is in the in-memory file job.config_fd, and the Vivado script will be fed to
+//          Vivado's stdin
+//==========================================================================================================
+void CProvisioner::prepare_job(job_t& job, const device_t& device)
+{
+    CTimings::CSpan translate(job.timings, "translate");
+
+    // Keep track of which device we are programming
+    job.device = device;
+
+    // Each job has its own scratch directory, so concurrent jobs don't clobber each other's files, even
+    // when they program the same USB IP address
+    if (m_config.use_temp_files) job.scratch = make_scratch_dir(to_string(++m_job_count) + "_" + device.usb_ip);
+
+    // Fill in the symbol table for this device.  Our own symbols take precedence over the user's
+    job.symbol_table = m_symbols;
+    job.symbol_table[USB_IP]     = device.usb_ip;
+    job.symbol_table[STATIC_IP]  = device.static_ip;
+    job.symbol_table[GATEWAY_IP] = computeGatewayIP(device.static_ip);
+    job.symbol_table[VIVADO]     = m_config.vivado;
+    job.symbol_table[TMP]        = job.scratch;
+    job.symbol_table[SKIP_UPDATE] = "{*}[smartlynq_skip_update [current_hw_server]]";
+
+    // Perform macro substitution on the Vivado command line.  If the script will be fed to Vivado's
+    // stdin, Vivado runs as a TCL interpreter instead
+    job.command_line = (m_config.use_temp_files ? m_command_line : m_worker_command_line).render(job.symbol_table);
+
+    // Perform macro substituion on the contents of the 'config.ini' file
+    job.config_ini = CTemplate::render(m_config_ini, job.symbol_table);
+    translate.stop();
+
+    // Write the 'config.ini' file to disk, or to an in-memory file that Vivado can open through /proc
+    CTimings::CSpan writeIni(job.timings, "write");
+    if (m_config.use_temp_files)
+    {
+        writeStringsToFile(job.config_ini, job.scratch+"/config.ini");
+        job.symbol_table[CONFIG_INI] = job.scratch+"/config.ini";
+    }
+    else
+    {
+        job.config_fd = writeStringsToMemory(job.config_ini, "config.ini");
+        job.symbol_table[CONFIG_INI] = "/proc/" + to_string(getpid()) + "/fd/" + to_string(job.config_fd);
+    }
+    writeIni.stop();
+
+    // The rest is translation again
+    CTimings::CSpan translateScript(job.timings, "translate");
+
+    // The SmartLynq doesn't need to be programmed if it already has the configuration we just rendered
+    job.symbol_table[UNLESS_CONFIGURED] = "smartlynq_unless_configured [smartlynq_configured [current_hw_server] "
+                                        + expectedConfig(job.config_ini) + "]";
+
+    // Perform macro substitution on the contents of the Vivado script, and have Vivado report the
+    // outcome of each command
+    job.vivado_script = wrap_commands(CTemplate::render(m_vivado_script, job.symbol_table));
+    translateScript.stop();
+
+    // Write the Vivado script to disk
+    CTimings::CSpan writeScript(job.timings, "write");
+    if (m_config.use_temp_files)
+    {
+        strvec script = job_script(job);
+        writeStringsToFile(script, job.scratch+"/script.tcl");
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// job_script() - Returns the complete Vivado script for a job: our TCL helpers followed by the
+//                translated Vivado script
+//==========================================================================================================
+strvec CProvisioner::job_script(const job_t& job)
+{
+    strvec script = script_preamble();
+    script.insert(script.end(), job.vivado_script.begin(), job.vivado_script.end());
+    return script;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// find_commands() - Finds the top-level commands in a Vivado script
+//
+// Passed:  script = The lines of the Vivado script template
+//
+// Returns: The lines that each command spans.  Blank lines and comments aren't commands
+//==========================================================================================================
+vector<CProvisioner::script_command_t> CProvisioner::find_commands(const strvec& script)
+{
+    vector<script_command_t> result;
+
+    for (size_t i=0; i<script.size(); ++i)
+    {
+        // Skip over blank lines and comments
+        size_t start = script[i].find_first_not_of(" \t");
+        if (start == string::npos || script[i][start] == '#') continue;
+
+        // A command continues onto following lines until it's complete
+        script_command_t command = {i, 1, ""};
+        string text = script[i];
+        while (!isCompleteCommand(text) && i + 1 < script.size()) text += "\n" + script[++i];
+        command.count = i - command.first + 1;
+
+        // Squeeze the command onto a single line for display.  A backslash-newline is just a space
+        for (size_t j=0; j<text.size(); ++j)
+        {
+            char c = text[j];
+            if (c == '\\' && j + 1 < text.size() && text[j+1] == '\n') c = text[++j];
+            bool space = (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+            if (!space) command.text += c;
+            else if (!command.text.empty() && command.text.back() != ' ') command.text += ' ';
+        }
+        if (!command.text.empty() && command.text.back() == ' ') command.text.pop_back();
+
+        result.push_back(command);
+    }
+
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// wrap_commands() - Wraps each command of a rendered Vivado script in "smartlynq_command"
+//
+// Passed:  script = The lines of the translated Vivado script.  There is one line for each line of the
+//                   template, so the commands are where "m_commands" says they are
+//
+// Returns: The script, with each command run by "smartlynq_command" (see "script_preamble()"), which
+//          times the command and reports its outcome
+//==========================================================================================================
+strvec CProvisioner::wrap_commands(const strvec& script)
+{
+    strvec result;
+    size_t next = 0;
+
+    for (size_t n=0; n<m_commands.size(); ++n)
+    {
+        const script_command_t& command = m_commands[n];
+        string prefix = "smartlynq_command " + to_string(n + 1) + " {";
+
+        // Blank lines and comments between commands are copied as-is
+        while (next < command.first) result.push_back(script[next++]);
+
+        // A single-line command is wrapped on that line.  Otherwise the wrapper gets lines of its own
+        if (command.count == 1)
+        {
+            size_t start = script[next].find_first_not_of(" \t");
+            result.push_back(prefix + script[next++].substr(start) + "}");
+            continue;
+        }
+        result.push_back(prefix);
+        while (next < command.first + command.count) result.push_back(script[next++]);
+        result.push_back("}");
+    }
+
+    // Copy whatever follows the last command
+    while (next < script.size()) result.push_back(script[next++]);
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// script_preamble() - Returns the TCL helpers that every Vivado script starts with
+//
+// The preamble makes Vivado announce the start of each phase of programming.  The phases are:
+//    launch  - From the time Vivado starts until "connect_hw_server" is called
+//    connect - From the time "connect_hw_server" is called until "update_hw_firmware" is called
+//    update  - From the time "update_hw_firmware" is called until it returns
+//    reset   - From the time "update_hw_firmware" returns (having reset the SmartLynq) until the end
+//
+// It also defines "smartlynq_skip_update", which %skip_update% expands into.  It reports the
+// SmartLynq's serial number and firmware version, and returns "-skip_update" if that firmware version
+// is the one bundled with Vivado.  A SmartLynq that the firmware cache says is already running the bundled
+// version isn't asked for its version at all.  The serial number and version are reported as "unknown"
+// unless each is a plain TCL word, so that the report is always exactly two words
+//
+// It defines "smartlynq_configured" and "smartlynq_unless_configured", which %unless_configured% expands
+// into.  The first reads back the SmartLynq's current configuration with "config_query" and compares it
+// with the one in config.ini, and the second runs the rest of the command only if they differ.  TCL
+// substitutes the words of a command from left to right, so the comparison is made before the rest of
+// the command is substituted.  It leaves its answer in "::smartlynq_configured", so that if the command
+// won't run, "smartlynq_skip_update" doesn't bother asking the SmartLynq for its firmware version
+//
+// It defines "smartlynq_command", which runs each command of the Vivado script (see "wrap_commands()").
+// It runs the command in the caller's scope inside a "catch", times it, and reports
+// "<COMMAND_TAG> <command_number> <return_code> <milliseconds> [error_message]" before passing the
+// outcome on, so that an error still stops the script
+//
+// Finally, it defines "smartlynq_hold" and "smartlynq_release", which keep a pipelined batch's rebooting
+// SmartLynqs connected until there are too many of them, and "smartlynq_drop", which lets go of a
+// SmartLynq that failed unless it's one of those (see "render_batch_device()")
+//
+// The TCL is safe to run more than once in the same Vivado session
+//==========================================================================================================
+strvec CProvisioner::script_preamble()
+{
+    // This builds a TCL callback that announces the named phase
+    auto announce = [](const string& phase) {return "{apply {args {puts \"" + PHASE_TAG + " " + phase + "\"}}}";};
+
+    return
+    {
+        "if {![info exists ::smartlynq_phases]} {",
+        "    set ::smartlynq_phases 1",
+        "    catch {fconfigure stdout -buffering line}",
+        "    catch {trace add execution connect_hw_server  enter " + announce("connect") + "}",
+        "    catch {trace add execution update_hw_firmware enter " + announce("update")  + "}",
+        "    catch {trace add execution update_hw_firmware leave " + announce("reset")   + "}",
+        "}",
+        "proc smartlynq_skip_update {server} {",
+        "    if {[info exists ::smartlynq_configured] && $::smartlynq_configured} {return {}}",
+        "    if {[catch {" + m_config.serial_query + "} serial] || $serial eq {} || [list $serial] ne $serial} {",
+        "        set serial unknown",
+        "    }",
+        "    if {[dict exists {" + current_firmware() + "} $serial]} {",
+        "        set version {" + m_config.firmware_version + "}",
+        "    } elseif {[catch {" + m_config.firmware_query + "} version] || $version eq {} || [list $version] ne $version} {",
+        "        set version unknown",
+        "    }",
+        "    puts \"" + FIRMWARE_TAG + " $serial $version\"",
+        "    if {$version ne {unknown} && $version eq {" + m_config.firmware_version + "}} {return -skip_update}",
+        "    return {}",
+        "}",
+        "proc smartlynq_configured {server expected} {",
+        "    if {[catch {" + m_config.config_query + "} current] || [catch {dict size $current}]} {set current {}}",
+        "    set configured [expr {[dict size $current] > 0}]",
+        "    foreach {key value} $expected {",
+        "        if {![dict exists $current $key] || [dict get $current $key] ne $value} {set configured 0}",
+        "    }",
+        "    set ::smartlynq_configured $configured",
+        "    return $configured",
+        "}",
+        "proc smartlynq_unless_configured {configured args} {",
+        "    set ::smartlynq_configured 0",
+        "    if {$configured} {puts \"" + CONFIG_TAG + "\"; return}",
+        "    uplevel 1 $args",
+        "}",
+        "proc smartlynq_command {index command} {",
+        "    set start [clock milliseconds]",
+        "    set rc [catch {uplevel 1 $command} result]",
+        "    set elapsed [expr {[clock milliseconds] - $start}]",
+        "    set message {}",
+        "    if {$rc} {set message [string map [list \\n { }] $result]}",
+        "    puts \"" + COMMAND_TAG + " $index $rc $elapsed $message\"",
+        "    return -code $rc $result",
+        "}",
+        "proc smartlynq_hold {id} {",
+        "    if {![info exists ::smartlynq_held]} {set ::smartlynq_held {}}",
+        "    if {[catch {current_hw_server} server] || $server eq {}} return",
+        "    foreach held $::smartlynq_held {if {[lindex $held 1] eq $server} return}",
+        "    lappend ::smartlynq_held [list $id $server]",
+        "}",
+        "proc smartlynq_drop {} {",
+        "    if {![info exists ::smartlynq_held]} {set ::smartlynq_held {}}",
+        "    if {[catch {current_hw_server} server] || $server eq {}} return",
+        "    foreach held $::smartlynq_held {if {[lindex $held 1] eq $server} return}",
+        "    catch {disconnect_hw_server $server}",
+        "}",
+        "proc smartlynq_release {keep} {",
+        "    if {![info exists ::smartlynq_held]} return",
+        "    while {[llength $::smartlynq_held] > $keep} {",
+        "        set held [lindex $::smartlynq_held 0]",
+        "        set ::smartlynq_held [lrange $::smartlynq_held 1 end]",
+        "        catch {disconnect_hw_server [lindex $held 1]}",
+        "        puts \"" + RELEASE_TAG + " [lindex $held 0]\"",
+        "    }",
+        "}"
+    };
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// check_phase() - Checks to see if a line of Vivado output announces the start of a new phase
+//
+// Passed:  line    = A line of Vivado output
+//          p_phase = Receives the name of the new phase
+//
+// Returns: The number of milliseconds allowed for the new phase (0 = no limit), or -1 if the line
+//          doesn't announce the start of a phase
+//==========================================================================================================
+int CProvisioner::check_phase(const string& line, string* p_phase)
+{
+    // If this line doesn't announce a phase, tell the caller
+    if (line.compare(0, PHASE_TAG.size(), PHASE_TAG) != 0) return -1;
+
+    // Fetch the name of the phase
+    *p_phase = line.substr(PHASE_TAG.size() + 1);
+
+    // Hand the caller the deadline for this phase
+    return phase_timeout(*p_phase) * 1000;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// phase_timeout() - Returns the number of seconds Vivado is allowed to spend in a phase (0 = no limit)
+//
+// This only ever reads m_phase_timeout, so it's safe to call from any number of threads at once
+//==========================================================================================================
+int CProvisioner::phase_timeout(const string& phase) const
+{
+    auto it = m_phase_timeout.find(phase);
+    return (it == m_phase_timeout.end()) ? 0 : it->second;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// check_report() - Checks to see if a line of Vivado output reports the SmartLynq's firmware version,
+//                  reports that the SmartLynq was already configured, or reports the outcome of a
+//                  command of the Vivado script
+//
+// Passed:  line   = A line of Vivado output
+//          result = The result that the line belongs to
+//
+// On Exit: If the line was a firmware report, result.serial, result.firmware and result.skipped_update
+//          are filled in
+//          If the line was a configuration report, result.already_configured is true
+//          If the line was a command report, the outcome of the command is appended to result.commands
+//
+// Returns: true if the line was one of those reports
+//==========================================================================================================
+bool CProvisioner::check_report(const string& line, result_t& result)
+{
+    // If the SmartLynq was already configured, make a note of it
+    if (line == CONFIG_TAG)
+    {
+        result.already_configured = true;
+        return true;
+    }
+
+    // A command report looks like "<COMMAND_TAG> <command_number> <return_code> <milliseconds> [message]"
+    if (line.compare(0, COMMAND_TAG.size(), COMMAND_TAG) == 0)
+    {
+        command_result_t command = {0, 0, 0, "", ""};
+        int msgStart = 0;
+        if (sscanf(line.c_str() + COMMAND_TAG.size(), " %d %d %d %n", &command.index, &command.rc, &command.ms, &msgStart) < 3)
+            return false;
+        command.message = line.substr(COMMAND_TAG.size() + msgStart);
+        if (command.index >= 1 && command.index <= m_commands.size()) command.command = m_commands[command.index - 1].text;
+        result.commands.push_back(command);
+        return true;
+    }
+
+    // If this line isn't a firmware report, tell the caller
+    if (line.compare(0, FIRMWARE_TAG.size(), FIRMWARE_TAG) != 0) return false;
+
+    // A firmware report looks like "<FIRMWARE_TAG> <serial_number> <version>".  If it doesn't, it's just output
+    if (!parseFirmware(line.c_str() + FIRMWARE_TAG.size(), &result.serial, &result.firmware)) return false;
+
+    // The firmware update was skipped if the SmartLynq already had the bundled firmware
+    result.skipped_update = (result.firmware != "unknown" && result.firmware == m_config.firmware_version);
+
+    // Tell the caller that this was a firmware report
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// load_firmware() - Reads the firmware cache: the firmware version that each SmartLynq we've programmed
+//                   is known to be running
+//
+// The file "smartlynq_firmware.cache" in the "tmp" directory has one "<serial_number> <version>" line
+// for each SmartLynq that has been programmed.  If the file doesn't exist, no SmartLynq is known yet
+//==========================================================================================================
+void CProvisioner::load_firmware()
+{
+    string line, serial, version;
+
+    lock_guard<mutex> lock(m_firmware_mutex);
+    m_firmware.clear();
+
+    // Fetch each line, skipping any that are malformed.  If a serial number appears twice, the later wins
+    ifstream ifile(m_config.tmp + "/smartlynq_firmware.cache");
+    while (getline(ifile, line))
+    {
+        if (parseFirmware(line.c_str(), &serial, &version)) m_firmware[serial] = version;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// current_firmware() - Returns a TCL dictionary whose keys are the serial numbers of the SmartLynqs that
+//                      the firmware cache says are running the firmware bundled with Vivado
+//==========================================================================================================
+string CProvisioner::current_firmware()
+{
+    string result;
+
+    // If there's no bundled firmware, no SmartLynq can be running it
+    if (m_config.firmware_version.empty()) return result;
+
+    lock_guard<mutex> lock(m_firmware_mutex);
+    for (auto& pair : m_firmware)
+    {
+        if (pair.second == m_config.firmware_version) result += (result.empty() ? "" : " ") + pair.first + " 1";
+    }
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// record_firmware() - Records the firmware version of a successfully programmed SmartLynq
+//
+// The firmware cache is rewritten with this SmartLynq's entry replacing any older one.  If "use_temp_files"
+// is false, the entry is only kept in memory
+//==========================================================================================================
+void CProvisioner::record_firmware(const result_t& result)
+{
+    // If we don't know which SmartLynq this is, there's nothing to record
+    if (result.serial.empty() || result.serial == "unknown") return;
+
+    // If the firmware was updated, it's now running the bundled version
+    bool   updated = !result.skipped_update && !result.already_configured;
+    string version = updated ? m_config.firmware_version : result.firmware;
+
+    // If we don't know what version that is, there's nothing to record
+    if (version.empty() || version == "unknown") return;
+
+    // If the cache already knows this, there's nothing to do
+    lock_guard<mutex> lock(m_firmware_mutex);
+    auto it = m_firmware.find(result.serial);
+    if (it != m_firmware.end() && it->second == version) return;
+    m_firmware[result.serial] = version;
+
+    // Rewrite the cache, unless we mustn't write any files.  If we can't, it's not worth failing the job over
+    if (!m_config.use_temp_files) return;
+    strvec cache;
+    for (auto& pair : m_firmware) cache.push_back(pair.first + " " + pair.second);
+    try
+    {
+        writeStringsToFile(cache, m_config.tmp + "/smartlynq_firmware.cache");
+    }
+    catch(const std::exception& e) {}
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// command_failure() - Returns a message telling the user which command of the Vivado script failed
+//==========================================================================================================
+string CProvisioner::command_failure(const command_result_t& command)
+{
+    string text = command.command.empty() ? "command " + to_string(command.index) : command.command;
+
+    return "\"" + text + "\" failed after " + to_string(command.ms) + " ms: " + command.message;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// watchdog_message() - Returns a message telling the user that Vivado was killed for taking too long
+//==========================================================================================================
+string CProvisioner::watchdog_message(const string& phase)
+{
+    return "Watchdog: Vivado killed after spending more than " + to_string(phase_timeout(phase))
+         + " seconds in the \"" + phase + "\" phase";
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// unreachable_message() - Returns the message telling the user that a SmartLynq was programmed, but never
+//                         answered at its static IP address
+//==========================================================================================================
+string CProvisioner::unreachable_message(const result_t& result)
+{
+    return "Programmed, but hw_server at " + result.device.static_ip + ":" + to_string(m_config.hw_server_port)
+         + " didn't answer within " + to_string(m_config.verify_timeout) + " seconds";
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// program() - Programs a SmartLynq with a Vivado process of its own, and waits until it's finished
+//==========================================================================================================
+CProvisioner::result_t CProvisioner::program(const device_t& device)
+{
+    promise<result_t> finished;
+
+    program(device, [&finished](const result_t& result) {finished.set_value(result);});
+
+    return finished.get_future().get();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// program() - Programs a SmartLynq with a Vivado process of its own
+//
+// Passed:  device  = The SmartLynq to program
+//          on_done = Handed the result once the SmartLynq is finished.  May be empty
+//
+// A failure here fails only this SmartLynq: it's reported in the result rather than thrown
+//==========================================================================================================
+void CProvisioner::program(const device_t& device, callback_t on_done)
+{
+    job_t job;
+
+    // Render the job's files and run Vivado
+    try
+    {
+        check_vivado();
+        prepare_job(job, device);
+        if (run_vivado(job) == 0) record_firmware(job);
+    }
+    catch(const std::exception& e)
+    {
+        job.output.push_back(e.what());
+        job.message = e.what();
+        job.rc = 1;
+    }
+
+    // And hand the result over once the SmartLynq is finished
+    finish_job(job, on_done);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_vivado() - Uses the Vivado TCL scripting engine to program the static IP address into the SmartLynq
+//
+// On Exit: job.output   = The output of Vivado
+//          job.commands = The outcome of each command of the Vivado script that Vivado ran
+//          job.rc       = 0 if the device was programmed successfully, otherwise 1
+//          job.message  = If the device wasn't programmed, why not
+//
+// The device was programmed successfully only if Vivado reports that every command of the script
+// succeeded, and then exits cleanly.  Vivado is killed as soon as it reports that a command failed, or
+// if it spends too long in any phase
+//
+// Returns: job.rc
+//==========================================================================================================
+int CProvisioner::run_vivado(job_t& job)
+{
+    CProcess process;
+    bool     fatal = false;
+
+    // Vivado is in the "launch" phase until it tells us otherwise
+    job.phase = "launch";
+    process.set_initial_timeout(phase_timeout(job.phase) * 1000);
+    job.timings.begin_phase(job.phase);
+
+    // If the script isn't on disk, feed it to Vivado's stdin
+    if (!m_config.use_temp_files) process.set_input(stdinScript(job_script(job)));
+
+    // Run Vivado, examining each line of its output as it arrives.  There's no point in waiting for
+    // Vivado to shut down after it has reported a fatal error, so at that point we kill it
+    int status = process.run(job.command_line, [&](const string& line)
+    {
+        // If this line announces a new phase, start enforcing the deadline for that phase
+        int timeout = check_phase(line, &job.phase);
+        if (timeout >= 0)
+        {
+            process.set_timeout(timeout);
+            job.timings.begin_phase(job.phase);
+            return true;
+        }
+
+        // Any other line that isn't a report is ordinary output
+        if (!check_report(line, job))
+        {
+            job.output.push_back(line);
+            return true;
+        }
+
+        // If that report says a command failed, there's no point in going on
+        fatal = !job.commands.empty() && job.commands.back().rc == 1;
+        if (fatal) job.output.push_back(job.message = command_failure(job.commands.back()));
+        return !fatal;
+    });
+
+    // Vivado's last phase ends when it exits
+    job.timings.end_phase();
+
+    // If Vivado took too long, tell the user which phase it got stuck in
+    if (process.timed_out())
+    {
+        job.output.push_back(job.message = watchdog_message(job.phase));
+        fatal = true;
+    }
+
+    // If Vivado exited without running every command, something went wrong that it didn't report
+    bool finished = (job.commands.size() == m_commands.size());
+    if (!fatal && !finished) job.output.push_back(job.message = "Vivado exited before running every command of the script");
+
+    // Save the Vivado output to a file just for debugging purposes
+    if (m_config.use_temp_files) writeStringsToFile(job.output, job.scratch+"/script.result");
+
+    // If the shell couldn't find Vivado or it never ran a command and said little, Vivado couldn't be found.
+    // A Vivado that the watchdog killed while it was launching says just as little, but it was found
+    bool silent = job.commands.empty() && job.output.size() < 2 && !process.timed_out();
+    if (status == 127 || silent) throw runtime_error("Vivado not found");
+
+    // The job failed unless every command succeeded and Vivado exited cleanly
+    job.rc = (fatal || !finished || status != 0) ? 1 : 0;
+    if (job.rc && job.message.empty()) job.message = "Vivado exited with status " + to_string(status);
+
+    // Tell the caller whether or not an error occured
+    return job.rc;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// finish_job() - Finishes a job that Vivado is done with
+//
+// Passed:  job     = The job.  It needn't outlive this call
+//          on_done = Handed the result once the SmartLynq is finished.  May be empty
+//
+// If the SmartLynq was programmed and "verify_timeout" is set, it isn't finished until it answers at its
+// static IP address.  That's checked in the background, so "on_done" is called on the verifier's thread
+//==========================================================================================================
+void CProvisioner::finish_job(job_t& job, callback_t on_done)
+{
+    // Vivado is done with the in-memory config.ini
+    if (job.config_fd >= 0) close(job.config_fd);
+    job.config_fd = -1;
+
+    // If the SmartLynq was programmed, check it at its static IP address with a copy of the job that
+    // lives until the check is finished
+    if (job.rc == 0 && m_config.verify_timeout)
+    {
+        auto checked = make_shared<job_t>(job);
+        start_verification(*checked, [checked, on_done]() {if (on_done) on_done(*checked);});
+        return;
+    }
+
+    if (on_done) on_done(job);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// start_verification() - Starts checking, in the background, that hw_server answers at the static IP
+//                        address of a SmartLynq that was just programmed
+//
+// Passed:  job     = The job that programmed the SmartLynq.  It must outlive the check
+//          on_done = Called on the verifier's thread once the check is finished.  May be empty
+//
+// On Exit: When the check is finished, job.verify_ms is filled in, and if hw_server didn't answer before
+//          "verify_timeout" ran out, job.unreachable is set and the job has failed
+//==========================================================================================================
+void CProvisioner::start_verification(job_t& job, function<void()> on_done)
+{
+    job_t* p_job   = &job;
+    string message = unreachable_message(job);
+
+    m_verifier.add(job.device.static_ip, m_config.hw_server_port, m_config.verify_timeout * 1000,
+    [p_job, message, on_done](const CVerifier::result_t& result)
+    {
+        p_job->verify_ms = result.ms;
+        if (!result.ready)
+        {
+            p_job->unreachable = true;
+            p_job->message = message;
+            p_job->rc = 1;
+        }
+        if (on_done) on_done();
+    });
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// start_session() - Starts the Vivado that stays running, unless it's already running
+//==========================================================================================================
+void CProvisioner::start_session()
+{
+    lock_guard<mutex> lock(m_session_mutex);
+    if (m_session.is_running()) return;
+
+    symtab_t symbols = m_symbols;
+    symbols[VIVADO]  = m_config.vivado;
+    m_session.set_command_line(m_worker_command_line.render(symbols));
+    m_session.set_initial_timeout(phase_timeout("launch") * 1000);
+    m_session.start();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// program_session() - Programs a SmartLynq with the Vivado that stays running
+//
+// Passed:  device  = The SmartLynq to program
+//          on_done = Handed the result once the SmartLynq is finished.  May be empty
+//
+// A failure here fails only this SmartLynq: it's reported in the result rather than thrown
+//==========================================================================================================
+void CProvisioner::program_session(const device_t& device, callback_t on_done)
+{
+    job_t job;
+
+    try
+    {
+        check_vivado();
+        prepare_job(job, device);
+        if (run_session(job) == 0) record_firmware(job);
+    }
+    catch(const std::exception& e)
+    {
+        job.output.push_back(e.what());
+        job.message = e.what();
+        job.rc = 1;
+    }
+
+    finish_job(job, on_done);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_session() - Runs a job's Vivado script with the Vivado that stays running
+//
+// On Exit: job.output, job.commands, job.rc and job.message are filled in, as with "run_vivado()"
+//
+// Returns: job.rc
+//==========================================================================================================
+int CProvisioner::run_session(job_t& job)
+{
+    // Make sure there's a Vivado to run the script, then wait our turn for it
+    start_session();
+    lock_guard<mutex> lock(m_session_mutex);
+
+    // Run the script, enforcing the deadline for each phase of programming
+    job.phase = "launch";
+    job.timings.begin_phase(job.phase);
+    auto on_line = [&](const string& line)
+    {
+        int timeout = check_phase(line, &job.phase);
+        if (timeout >= 0)
+        {
+            m_session.set_timeout(timeout);
+            job.timings.begin_phase(job.phase);
+        }
+        check_report(line, job);
+        return true;
+    };
+    if (m_config.use_temp_files)
+        job.rc = m_session.run_script(job.scratch+"/script.tcl", &job.output, on_line) ? 0 : 1;
+    else
+        job.rc = m_session.run_script(job_script(job), &job.output, on_line) ? 0 : 1;
+    job.timings.end_phase();
+
+    // If Vivado took too long, tell the user which phase it got stuck in.  Otherwise, if a command
+    // failed, say which one
+    if (m_session.timed_out())
+        job.output.push_back(job.message = watchdog_message(job.phase));
+    else if (job.rc)
+    {
+        job.message = "Vivado reported an error";
+        for (auto& command : job.commands) if (command.rc == 1) job.message = command_failure(command);
+    }
+
+    // Save the Vivado output to a file just for debugging purposes
+    if (m_config.use_temp_files) writeStringsToFile(job.output, job.scratch+"/script.result");
+
+    return job.rc;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// identify() - Uses the Vivado that stays running to fetch the serial number of a SmartLynq
+//
+// Passed:  usb_ip   = The SmartLynq's USB IP address
+//          p_result = Receives the serial number, firmware version and the output of Vivado
+//
+// Returns: 'true' if the serial number was fetched
+//==========================================================================================================
+bool CProvisioner::identify(const string& usb_ip, result_t* p_result)
+{
+    result_t result;
+    string   phase;
+
+    // Connect to the SmartLynq and report its serial number and firmware version
+    result.device.usb_ip = usb_ip;
+    strvec script = script_preamble();
+    script.push_back("open_hw_manager");
+    script.push_back("connect_hw_server -url " + usb_ip);
+    script.push_back("smartlynq_skip_update [current_hw_server]");
+
+    // Make sure there's a Vivado to run the script, then wait our turn for it
+    start_session();
+    lock_guard<mutex> lock(m_session_mutex);
+
+    // Run the script, enforcing the deadline for each phase
+    bool ok = m_session.run_script(script, &result.output, [&](const string& line)
+    {
+        int timeout = check_phase(line, &phase);
+        if (timeout >= 0) m_session.set_timeout(timeout);
+        check_report(line, result);
+        return true;
+    });
+
+    // Tell the caller whether we know which SmartLynq this is
+    *p_result = result;
+    return ok && !result.serial.empty() && result.serial != "unknown";
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// render_batch_device() - Renders the Vivado script fragment that programs a single device in a batch
+//
+// Passed:  index = index into the batch of the device to be programmed
+//          job   = The prepared job for that device
+//
+// Returns: The TCL that programs the device and reports the outcome via a RESULT_TAG line
+//
+// The device's script is wrapped in a "catch" so that a failure on one device doesn't stop the rest
+// of the batch
+//==========================================================================================================
+strvec CProvisioner::render_batch_device(int index, const job_t& job)
+{
+    strvec result;
+
+    // This is the number that will identify this device in the Vivado output
+    string id = to_string(index + 1);
+
+    // In a pipelined batch, a device that was programmed stays connected while it reboots.  One that
+    // failed isn't rebooting, so it's let go of right away rather than taking up a place in the pipeline
+    bool pipelined = m_config.pipeline_depth > 0;
+
+    // Wrap the device's script in a "catch", and report the outcome
+    result.push_back("# Device " + id + ": " + job.device.usb_ip + " -> " + job.device.static_ip);
+    result.push_back("if {[catch {");
+    for (auto& s : job.vivado_script) result.push_back("    " + s);
+    result.push_back("} msg]} {");
+    result.push_back("    puts \"" + RESULT_TAG + " " + id + " FAILED [string map [list \\n { }] $msg]\"");
+    if (pipelined) result.push_back("    smartlynq_drop");
+    result.push_back("} else {");
+    result.push_back("    puts \"" + RESULT_TAG + " " + id + " OK\"");
+    if (pipelined) result.push_back("    smartlynq_hold " + id);
+    result.push_back("}");
+
+    // Close the hardware manager so the next device starts with a clean session.  In a pipelined batch,
+    // the hardware manager stays open, and once too many devices are rebooting, the one programmed
+    // longest ago is let go of.  That's safe because the next device's script starts by connecting to
+    // its own hw_server, which becomes the current one, and the script only ever works on
+    // [current_hw_server].  So the held hw_servers are never touched again until "smartlynq_release"
+    // disconnects them, and the batch ends by releasing every one of them and closing the hardware manager
+    if (pipelined)
+        result.push_back("smartlynq_release " + to_string(m_config.pipeline_depth));
+    else
+        result.push_back("catch {close_hw_manager}");
+
+    // Hand the rendered script to the caller
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// program_batch() - Programs every SmartLynq in a list from a single Vivado session
+//
+// Passed:  devices     = The SmartLynqs to program
+//          on_reported = Handed each result as soon as Vivado reports its outcome (and, if we're
+//                        checking static IP addresses, that check is finished).  May be empty
+//          on_finished = Handed each result once its timings are complete.  May be empty
+//          p_output    = Receives the output of Vivado.  May be NULL
+//
+// Returns: The number of SmartLynqs that weren't programmed
+//
+// In a pipelined batch (see "pipeline_depth") each device moves through four stages: Vivado connects to
+// it and configures it (the "connect" and "update" phases) one device at a time, then the device reboots
+// (the "reset" stage) while Vivado moves on to the next ones, and finally, if "verify_timeout" is set, it
+// is checked at its static IP address in the background.  Vivado only waits for a reboot to finish when
+// more than "pipeline_depth" devices are rebooting, so the batch runs at the pace of the slowest stage
+// rather than the sum of them
+//==========================================================================================================
+int CProvisioner::program_batch(const vector<device_t>& devices, callback_t on_reported, callback_t on_finished,
+                                strvec* p_output)
+{
+    CProcess process;
+    strvec   result;
+    string   phase = "launch";
+    result_t reports;
+    int      failures = 0;
+
+    // Make sure that Vivado exists and is runnable
+    check_vivado();
+
+    // Create the directory where the combined script will be stored
+    string scratch = m_config.use_temp_files ? make_scratch_dir("batch") : "";
+
+    // Perform macro substitution on the Vivado command line.  If the script will be fed to Vivado's
+    // stdin, Vivado runs as a TCL interpreter instead
+    symtab_t symbols = m_symbols;
+    symbols[VIVADO]  = m_config.vivado;
+    symbols[TMP]     = scratch;
+    string commandLine = (m_config.use_temp_files ? m_command_line : m_worker_command_line).render(symbols);
+
+    // Every device's in-memory config.ini stays open until Vivado is done, so allow as many open files as we can
+    if (!m_config.use_temp_files)
+    {
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    // The combined script starts with our TCL helpers
+    strvec script = script_preamble();
+
+    // Render the script for each device and append it to the combined script.  If that fails, let go of
+    // the devices that were already rendered
+    vector<job_t> jobs(devices.size());
+    auto releaseJobs = [&]()
+    {
+        for (auto& job : jobs) if (job.config_fd >= 0) close(job.config_fd);
+        for (auto& job : jobs) job.config_fd = -1;
+    };
+    try
+    {
+        for (int i=0; i<devices.size(); ++i)
+        {
+            prepare_job(jobs[i], devices[i]);
+            strvec deviceScript = render_batch_device(i, jobs[i]);
+            script.insert(script.end(), deviceScript.begin(), deviceScript.end());
+        }
+
+        // In a pipelined batch, the last devices are still rebooting.  Let them finish
+        if (m_config.pipeline_depth > 0)
+        {
+            script.push_back("smartlynq_release 0");
+            script.push_back("catch {close_hw_manager}");
+        }
+
+        // Write the combined Vivado script to disk
+        if (m_config.use_temp_files) writeStringsToFile(script, scratch+"/script.tcl");
+    }
+    catch(const std::exception& e)
+    {
+        releaseJobs();
+        throw;
+    }
+
+    // The Vivado phases since the last device was finished, and the device whose outcome has been
+    // reported but whose reset may still be in progress
+    CTimings deviceTimings;
+    job_t*   finishing = nullptr;
+
+    // If programmed devices are checked at their static IP addresses, the checks run in the background
+    // while Vivado programs the next devices.  Their outcomes and timings are handed over as the checks
+    // finish and once Vivado is done, respectively
+    bool     verifying = m_config.verify_timeout != 0;
+
+    // The checks of this batch's devices that haven't finished yet.  Other callers may have checks of
+    // their own running on the same verifier, so we only ever wait for ours
+    mutex              checkMutex;
+    condition_variable checkDone;
+    int                checking = 0;
+    auto waitForChecks = [&]()
+    {
+        unique_lock<mutex> lock(checkMutex);
+        checkDone.wait(lock, [&]() {return checking == 0;});
+    };
+
+    // In a pipelined batch, a device's reset lasts from the end of its firmware update until Vivado lets go
+    // of it, which overlaps with the work on the devices after it, so the timings are handed over at the end
+    bool     pipelined = m_config.pipeline_depth > 0;
+    bool     deferTimings = verifying || pipelined;
+    CTimings::time_point_t resetStart;
+    vector<double> resetMs(jobs.size(), -1);
+
+    // This hands the Vivado phases to the device they belong to, and hands over its timings
+    auto finishTimings = [&]()
+    {
+        deviceTimings.end_phase();
+        if (finishing)
+        {
+            finishing->timings.merge(deviceTimings);
+            if (!deferTimings && on_finished) on_finished(*finishing);
+        }
+        deviceTimings = CTimings();
+        finishing = nullptr;
+    };
+
+    // This is true for each device that Vivado has reported on
+    vector<bool> reported(jobs.size(), false);
+
+    // Vivado is in the "launch" phase until it tells us otherwise
+    process.set_initial_timeout(phase_timeout(phase) * 1000);
+    deviceTimings.begin_phase(phase);
+
+    // If the script isn't on disk, feed it to Vivado's stdin
+    if (!m_config.use_temp_files) process.set_input(stdinScript(script));
+
+    // Run Vivado, handing over the outcome of each device as soon as Vivado reports it to us
+    int status;
+    try
+    {
+        status = process.run(commandLine, [&](const string& s)
+        {
+            // If this line announces a new phase, start enforcing the deadline for that phase
+            int timeout = check_phase(s, &phase);
+            if (timeout >= 0)
+            {
+                process.set_timeout(timeout);
+
+                // A device's reset lasts until the next device starts connecting, unless the batch is pipelined
+                if (phase == "connect" && finishing) finishTimings();
+                if (phase == "reset" && pipelined)
+                {
+                    deviceTimings.end_phase();
+                    resetStart = CTimings::now();
+                }
+                else deviceTimings.begin_phase(phase);
+                return true;
+            }
+
+            // Keep all of the output for debugging purposes
+            result.push_back(s);
+
+            // In a pipelined batch, a device's reset is over once Vivado has let go of it
+            if (s.compare(0, RELEASE_TAG.size(), RELEASE_TAG) == 0)
+            {
+                int number = atoi(s.c_str() + RELEASE_TAG.size());
+                if (number >= 1 && number <= jobs.size() && jobs[number-1].reset_start != CTimings::time_point_t())
+                {
+                    resetMs[number-1] = CTimings::since(jobs[number-1].reset_start);
+                }
+                return true;
+            }
+
+            // If this line reports on a SmartLynq or a command, it belongs to the next device outcome
+            if (check_report(s, reports)) return true;
+
+            // If this line isn't a device outcome, we're done with it
+            if (s.compare(0, RESULT_TAG.size(), RESULT_TAG) != 0) return true;
+
+            // A device outcome line looks like "<RESULT_TAG> <device_number> <OK|FAILED> [message]"
+            int    number = 0;
+            char   status[20] = "";
+            int    msgStart = 0;
+            sscanf(s.c_str() + RESULT_TAG.size(), " %d %19s %n", &number, status, &msgStart);
+
+            // Ignore any outcome for a device that we don't know about
+            if (number < 1 || number > jobs.size()) return true;
+
+            // Attach the reports since the previous device outcome to this device
+            job_t& job = jobs[number-1];
+            job.serial             = reports.serial;
+            job.firmware           = reports.firmware;
+            job.skipped_update     = reports.skipped_update;
+            job.already_configured = reports.already_configured;
+            job.commands           = reports.commands;
+            reports                = result_t();
+
+            // If the device is rebooting, its reset stage started when its firmware update finished
+            if (pipelined && phase == "reset") job.reset_start = resetStart;
+
+            // Record the outcome for this device
+            reported[number-1] = true;
+            job.rc = (strcmp(status, "OK") != 0);
+            if (job.rc) job.message = "Vivado says: " + string(s.c_str() + RESULT_TAG.size() + msgStart);
+
+            // If the device was programmed, remember its firmware version
+            if (job.rc == 0) record_firmware(job);
+
+            // And hand it over, once we know that it answers at its static IP address if we're checking
+            auto report = [&on_reported, &jobs, number]() {if (on_reported) on_reported(jobs[number-1]);};
+            if (job.rc == 0 && verifying)
+            {
+                {
+                    lock_guard<mutex> lock(checkMutex);
+                    ++checking;
+                }
+                start_verification(job, [&, report]()
+                {
+                    report();
+                    lock_guard<mutex> lock(checkMutex);
+                    if (--checking == 0) checkDone.notify_all();
+                });
+            }
+            else
+                report();
+
+            // The Vivado phases so far belong to this device.  If the previous device is still waiting for
+            // the rest of its reset, its reset can't be told apart from this device's work, so it goes without
+            if (finishing && !deferTimings && on_finished) on_finished(*finishing);
+            finishing = &job;
+            return true;
+        });
+    }
+    catch(const std::exception& e)
+    {
+        // The checks in progress refer to our jobs, so they have to finish before the jobs go away
+        waitForChecks();
+        releaseJobs();
+        throw;
+    }
+
+    // Whatever Vivado did last belongs to the last device that reported
+    finishTimings();
+
+    // Wait for the last devices to answer at their static IP addresses, then hand over any timings we held back
+    waitForChecks();
+    releaseJobs();
+    for (int i=0; i<jobs.size(); ++i) if (resetMs[i] >= 0) jobs[i].timings.add("reset", resetMs[i]);
+    if (deferTimings && on_finished) for (int i=0; i<jobs.size(); ++i) if (reported[i]) on_finished(jobs[i]);
+
+    // If the shell couldn't find Vivado or the output is very short, it means Vivado couldn't be found.  A
+    // Vivado that the watchdog killed while it was launching says just as little, but it was found
+    if (status == 127 || (result.size() < 2 && !process.timed_out())) throw runtime_error("Vivado not found");
+
+    // If Vivado took too long, tell the user which phase it got stuck in
+    string watchdog = process.timed_out() ? watchdog_message(phase) : "";
+    if (!watchdog.empty()) result.push_back(watchdog);
+
+    // Save the Vivado output to a file just for debugging purposes, and hand it to the caller
+    if (m_config.use_temp_files) writeStringsToFile(result, scratch+"/script.result");
+    if (p_output) *p_output = result;
+
+    // Count the failures, and hand over any device that Vivado never told us about.  The devices are
+    // programmed in order, so if the watchdog killed Vivado, the first of them is the one it was stuck on
+    for (int i=0; i<jobs.size(); ++i)
+    {
+        if (!reported[i])
+        {
+            jobs[i].rc = 1;
+            jobs[i].message = watchdog.empty() ? "Vivado didn't report a result" : watchdog;
+            watchdog.clear();
+            if (on_reported) on_reported(jobs[i]);
+            if (on_finished) on_finished(jobs[i]);
+        }
+        failures += jobs[i].rc;
+    }
+
+    // Tell the caller how many devices weren't programmed
+    return failures;
+}
+//==========================================================================================================
@@ -0,0 +1,354 @@
+//==========================================================================================================
+// provisioner.h - Defines the engine that programs static IP addresses into SmartLynqs
+//
+// This is the public interface of libsmartlynq.  The smartlynq_static_ip command line tool is a thin
+// wrapper around it, and other programs can link against it to program SmartLynqs in-process
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "manifest.h"
+#include "template.h"
+#include "timings.h"
+#include "verifier.h"
+#include "vivado_worker.h"
+
+//----------------------------------------------------------------------------------------------------------
+// command_result_t - The outcome of a single command of the Vivado script, as reported by Vivado
+//----------------------------------------------------------------------------------------------------------
+struct command_result_t
+{
+    // The number of the command (1 = the first command in the "vivado_script" template)
+    int         index;
+
+    // The TCL return code of the command (0 = OK, 1 = error) and how many milliseconds it took
+    int         rc, ms;
+
+    // If the command failed, the error message
+    std::string message;
+
+    // The command as it appears in the "vivado_script" template, on a single line
+    std::string command;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// CProvisioner - Programs static IP addresses into SmartLynqs by running Vivado
+//
+// Call "configure()" once, then program SmartLynqs in any of these ways:
+//
+//    program()         - Programs one SmartLynq with a Vivado process of its own.  Any number of threads
+//                        may call this at the same time
+//
+//    program_batch()   - Programs many SmartLynqs from a single Vivado process
+//
+//    program_session() - Programs one SmartLynq with a Vivado that stays running between calls.  Calls
+//                        from different threads take turns
+//
+// If "verify_timeout" is set in the configuration, a SmartLynq isn't finished until it answers at its
+// static IP address.  Those checks run in the background, so the callback-based calls can return before
+// the SmartLynq is finished.  Nothing here ever exits the program: errors are thrown as runtime_error,
+// or reported in the result of the SmartLynq they belong to
+//----------------------------------------------------------------------------------------------------------
+class CProvisioner
+{
+public:
+
+    // The settings that come from the configuration file.  Each is named after its key in the file
+    struct config_t
+    {
+        // The fully qualified path to the Vivado executable
+        std::string vivado;
+
+        // Name of a directory where we can store temporary files
+        std::string tmp;
+
+        // The Vivado command line, and the command line that starts Vivado as a persistent TCL interpreter
+        std::string command_line;
+        std::string worker_command_line = "%vivado% 2>&1 -nojournal -nolog -mode tcl";
+
+        // If this is false, nothing is written to "tmp".  The Vivado script is fed to Vivado's stdin and
+        // ini is stored in an anonymous in-memory file
+        bool        use_temp_files = true;
+
+        // The number of seconds that Vivado is allowed to spend in each phase of programming.  0 = no limit
+        int32_t     launch_timeout  = 120;
+        int32_t     connect_timeout =  60;
+        int32_t     update_timeout  = 600;
+        int32_t     reset_timeout   = 120;
+
+        // The firmware version bundled with our Vivado.  A SmartLynq that already runs it won't be updated
+        std::string firmware_version;
+
+        // TCL that fetches the firmware version and serial number of the SmartLynq on hw_server "$server"
+        std::string firmware_query = "get_property FIRMWARE_VERSION $server";
+        std::string serial_query   = "get_property SERIAL_NUMBER $server";
+
+        // TCL that fetches the current configuration of the SmartLynq on hw_server "$server" as a list of
+        // "<key> <value>" pairs.  Empty means "don't check, always program the SmartLynq"
+        std::string config_query;
+
+        // The ini and Vivado script templates, and the "<name> <value>" lines of user-defined symbols
+        std::vector<std::string> config_ini, vivado_script, symbols;
+
+        // If this isn't empty, the timings of every job are appended to this file as one line of JSON each
+        std::string timings_file;
+
+        // The TCP port that hw_server listens on
+        int32_t     hw_server_port = 3121;
+
+        // The network interfaces that "--discover" searches (separated by spaces), and how many
+        // milliseconds it waits for hw_server to answer.  No interfaces means "every interface on the USB bus"
+        std::string discover_interfaces;
+        int32_t     discover_timeout_ms = 250;
+
+        // In station mode, the number of milliseconds between searches for SmartLynqs when nothing is
+        // plugged in or unplugged
+        int32_t     station_rescan_ms = 2000;
+
+        // The number of seconds a freshly programmed SmartLynq has to answer at its static IP address.
+        // 0 = don't check
+        int32_t     verify_timeout = 0;
+
+        // In a batch, the number of SmartLynqs that may be rebooting while Vivado programs the next ones.
+        // 0 = wait for each SmartLynq to finish rebooting before starting on the next
+        int32_t     pipeline_depth = 0;
+    };
+
+    // The outcome of programming a single SmartLynq
+    struct result_t
+    {
+        // The SmartLynq that was programmed
+        device_t    device;
+
+        // 0 = The SmartLynq was programmed, 1 = it wasn't
+        int         rc = 0;
+
+        // If the SmartLynq wasn't programmed, a single line that says why
+        std::string message;
+
+        // The serial number and (pre-programming) firmware version that the SmartLynq reported
+        std::string serial, firmware;
+
+        // True if the firmware update was skipped because the firmware was already current
+        bool        skipped_update = false;
+
+        // True if programming was skipped because the SmartLynq already had the configuration in config.ini
+        bool        already_configured = false;
+
+        // True if the SmartLynq was programmed, but hw_server never answered at the static IP address
+        bool        unreachable = false;
+
+        // How many milliseconds it took hw_server to answer at the static IP address after programming.
+        // Negative if that wasn't checked
+        double      verify_ms = -1;
+
+        // The outcome of each command of the Vivado script that Vivado ran
+        std::vector<command_result_t> commands;
+
+        // The output of Vivado.  In a batch, this is empty: the output of the whole batch is returned instead
+        std::vector<std::string> output;
+
+        // How long each phase of programming took.  The time spent verifying is in "verify_ms"
+        CTimings    timings;
+    };
+
+    // The type of function that is handed the result of a SmartLynq
+    typedef std::function<void(const result_t&)> callback_t;
+
+    // Call this to read in the configuration file.  "symbols" override the user-defined symbols in it.
+    // This must be called before anything else, and not while SmartLynqs are being programmed
+    // Can throw exception runtime_error
+    void    configure(const std::string& filename, const symtab_t& symbols = symtab_t());
+
+    // Returns the settings from the configuration file
+    const config_t& config() const {return m_config;}
+
+    // Returns the timings of the work that is shared by every SmartLynq, such as reading the configuration
+    CTimings timings();
+
+    // Call this to make sure that Vivado exists and is runnable.  Thread-safe
+    // Can throw exception runtime_error
+    void    check_vivado();
+
+    // Programs a SmartLynq with a Vivado process of its own, and returns the result once it's finished.
+    // Thread-safe
+    result_t program(const device_t& device);
+
+    // Same as above, but returns once Vivado is done, and "on_done" is handed the result once the
+    // SmartLynq is finished.  That may be on a background thread, after this returns.  Thread-safe
+    void    program(const device_t& device, callback_t on_done);
+
+    // Programs every SmartLynq in "devices" from a single Vivado process, and returns once Vivado and
+    // every check of a static IP address are done.  "on_reported" is handed each result as soon as its
+    // outcome is known, and "on_finished" once its timings are complete.  Both can be called on a
+    // background thread, so must be thread-safe.  The output of Vivado is stored in p_output
+    //
+    // Returns: The number of SmartLynqs that weren't programmed
+    // Can throw exception runtime_error
+    int     program_batch(const std::vector<device_t>& devices, callback_t on_reported, callback_t on_finished,
+                          std::vector<std::string>* p_output);
+
+    // Call this to start the Vivado that "program_session()" and "identify()" use, so that it's warmed up
+    // by the time the first SmartLynq arrives.  Does nothing if it's already running
+    // Can throw exception runtime_error
+    void    start_session();
+
+    // Programs a SmartLynq with the Vivado that stays running, and returns once Vivado is done.
+    // "on_done" is handed the result once the SmartLynq is finished, which may be on a background thread,
+    // after this returns.  Thread-safe
+    void    program_session(const device_t& device, callback_t on_done);
+
+    // Fetches the serial number and firmware version of the SmartLynq at "usb_ip" with the Vivado that
+    // stays running.  Returns 'true' if the serial number was fetched.  Thread-safe
+    // Can throw exception runtime_error
+    bool    identify(const std::string& usb_ip, result_t* p_result);
+
+    // Call this to wait until every check of a static IP address that is in progress has finished
+    void    wait() {m_verifier.wait();}
+
+    // Adds "name" (without the '%' delimiters) to a symbol table
+    // Can throw exception runtime_error if the name isn't a valid symbol name
+    static void define_symbol(symtab_t& symbols, const std::string& name, const std::string& value);
+
+protected:
+
+    // A top-level command of the Vivado script, as it appears in the "vivado_script" template
+    struct script_command_t
+    {
+        // The index of the first line of the command, and the number of lines it spans
+        size_t      first, count;
+
+        // The text of the command on a single line, for the benefit of humans
+        std::string text;
+    };
+
+    // A SmartLynq that is being programmed, along with everything needed to program it
+    struct job_t : result_t
+    {
+        // The symbol table that we'll use for text substitutions
+        symtab_t    symbol_table;
+
+        // The directory where this job stores its temporary files.  Empty if we don't use temporary files
+        std::string scratch;
+
+        // If config.ini is stored in memory instead of on disk, this is its file descriptor.  Otherwise -1
+        int         config_fd = -1;
+
+        // The Vivado command line we'll execute
+        std::string command_line;
+
+        // The contents of the config.ini file that we use during IP address programming
+        std::vector<std::string> config_ini;
+
+        // The vivado script that we'll run to program the IP address
+        std::vector<std::string> vivado_script;
+
+        // The phase of programming that Vivado is in (see "check_phase()")
+        std::string phase;
+
+        // In a pipelined batch, when the SmartLynq started rebooting
+        CTimings::time_point_t reset_start;
+    };
+
+    // Performs macro substitution for a single device and writes its files to disk
+    void    prepare_job(job_t& job, const device_t& device);
+
+    // Creates a directory under "tmp" where a single job can store its temporary files
+    std::string make_scratch_dir(const std::string& name);
+
+    // Runs Vivado to program a job's SmartLynq.  Returns job.rc
+    int     run_vivado(job_t& job);
+
+    // Runs a job's Vivado script with the Vivado that stays running.  Returns job.rc
+    int     run_session(job_t& job);
+
+    // Finishes a job that Vivado is done with, and hands it to "on_done" once the SmartLynq is finished
+    void    finish_job(job_t& job, callback_t on_done);
+
+    // Starts checking that hw_server answers at the static IP address of a job that was just programmed
+    void    start_verification(job_t& job, std::function<void()> on_done);
+
+    // Renders the Vivado script fragment that programs a single device in a batch
+    std::vector<std::string> render_batch_device(int index, const job_t& job);
+
+    // Returns the complete Vivado script for a job: our TCL helpers followed by the translated script
+    std::vector<std::string> job_script(const job_t& job);
+
+    // Returns the TCL helpers that every Vivado script starts with
+    std::vector<std::string> script_preamble();
+
+    // Finds the top-level commands in a Vivado script template
+    std::vector<script_command_t> find_commands(const std::vector<std::string>& script);
+
+    // Wraps each command of a rendered Vivado script in "smartlynq_command"
+    std::vector<std::string> wrap_commands(const std::vector<std::string>& script);
+
+    // Checks to see if a line of Vivado output announces the start of a new phase
+    int     check_phase(const std::string& line, std::string* p_phase);
+
+    // Returns the number of seconds that Vivado is allowed to spend in a phase (0 = no limit)
+    int     phase_timeout(const std::string& phase) const;
+
+    // Checks to see if a line of Vivado output is one of our reports about the SmartLynq
+    bool    check_report(const std::string& line, result_t& result);
+
+    // Reads, consults and updates the firmware cache
+    void    load_firmware();
+    std::string current_firmware();
+    void    record_firmware(const result_t& result);
+
+    // Messages that explain why a SmartLynq wasn't programmed
+    std::string command_failure(const command_result_t& command);
+    std::string watchdog_message(const std::string& phase);
+    std::string unreachable_message(const result_t& result);
+
+    // The settings from the configuration file
+    config_t    m_config;
+
+    // The number of jobs that have been prepared, which makes the name of each job's scratch directory unique
+    std::atomic<int> m_job_count{0};
+
+    // The compiled Vivado command lines, config.ini template and Vivado script template
+    CTemplate   m_command_line, m_worker_command_line;
+    std::vector<CTemplate> m_config_ini, m_vivado_script;
+
+    // The commands in the Vivado script template
+    std::vector<script_command_t> m_commands;
+
+    // The user-defined symbols
+    symtab_t    m_symbols;
+
+    // The number of seconds that Vivado is allowed to spend in each phase of programming, by phase name.
+    // Only "configure()" changes this; everything else reads it through "phase_timeout()"
+    std::map<std::string, int> m_phase_timeout;
+
+    // The timings of the work that is shared by every SmartLynq
+    CTimings    m_timings;
+
+    // Protects m_timings and the cached Vivado check
+    std::mutex  m_mutex;
+
+    // True once Vivado is known to be runnable, and the version string it reports about itself
+    bool        m_vivado_ok = false;
+    std::string m_vivado_version;
+
+    // The firmware version that each SmartLynq we've programmed is known to be running, by serial number,
+    // and the mutex that protects it and the firmware cache file
+    std::map<std::string, std::string> m_firmware;
+    std::mutex  m_firmware_mutex;
+
+    // The Vivado that stays running, and the mutex that makes callers take turns with it
+    CVivadoWorker m_session;
+    std::mutex  m_session_mutex;
+
+    // Checks that freshly programmed SmartLynqs answer at their static IP addresses
+    CVerifier   m_verifier;
+};
+//----------------------------------------------------------------------------------------------------------
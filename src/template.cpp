@@ -0,0 +1,135 @@
+//==========================================================================================================
+// template.cpp - Implements a text template that is compiled once and rendered many times
+//==========================================================================================================
+#include <ctype.h>
+#include "template.h"
+
+using namespace std;
+
+
+//==========================================================================================================
+// is_symbol_char() - Returns 'true' if the character is allowed in a symbol name
+//==========================================================================================================
+static bool is_symbol_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// is_symbol_name() - Returns 'true' if "name" is a valid symbol name (without the '%' delimiters)
+//==========================================================================================================
+bool CTemplate::is_symbol_name(const string& name)
+{
+    if (name.empty()) return false;
+    for (char c : name) if (!is_symbol_char(c)) return false;
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// compile() - Splits text into a list of literal text and symbol references
+//==========================================================================================================
+void CTemplate::compile(const string& text)
+{
+    size_t start = 0, pos = 0;
+
+    // Forget any template we already had
+    m_segments.clear();
+    m_literal_size = 0;
+
+    // This appends literal text to the list of segments
+    auto add_literal = [&](size_t from, size_t to)
+    {
+        if (to <= from) return;
+        m_segments.push_back({false, text.substr(from, to - from)});
+        m_literal_size += to - from;
+    };
+
+    // Look at every '%' in the text...
+    while ((pos = text.find('%', pos)) != string::npos)
+    {
+        // Find the end of the symbol name that might follow it
+        size_t end = pos + 1;
+        while (end < text.size() && is_symbol_char(text[end])) ++end;
+
+        // If this isn't "%name%", the '%' is literal text
+        if (end == pos + 1 || end == text.size() || text[end] != '%')
+        {
+            pos = end;
+            continue;
+        }
+
+        // Save the literal text before the symbol reference, then the symbol reference itself
+        add_literal(start, pos);
+        m_segments.push_back({true, text.substr(pos, end + 1 - pos)});
+
+        // Carry on after the closing '%'
+        start = pos = end + 1;
+    }
+
+    // Save whatever literal text follows the last symbol reference
+    add_literal(start, text.size());
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// render() - Substitutes the values in a symbol table for the symbol references in the template
+//
+// Passed:  symbols = The symbol table
+//
+// Returns: The rendered text
+//==========================================================================================================
+string CTemplate::render(const symtab_t& symbols) const
+{
+    string result;
+    size_t length = m_literal_size;
+
+    // Look up the value of each symbol reference, and find out how long the result will be
+    vector<const string*> value(m_segments.size(), nullptr);
+    for (int i=0; i<m_segments.size(); ++i)
+    {
+        const segment_t& segment = m_segments[i];
+        if (!segment.is_symbol) continue;
+        auto it = symbols.find(segment.text);
+        value[i] = (it == symbols.end()) ? &segment.text : &it->second;
+        length += value[i]->size();
+    }
+
+    // Build the result in a single pass
+    result.reserve(length);
+    for (int i=0; i<m_segments.size(); ++i)
+    {
+        result += value[i] ? *value[i] : m_segments[i].text;
+    }
+
+    // Hand the rendered text to the caller
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// compile() - Compiles each string in a vector into a template
+//==========================================================================================================
+vector<CTemplate> CTemplate::compile(const vector<string>& lines)
+{
+    return vector<CTemplate>(lines.begin(), lines.end());
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// render() - Renders each template in a vector
+//==========================================================================================================
+vector<string> CTemplate::render(const vector<CTemplate>& templates, const symtab_t& symbols)
+{
+    vector<string> result;
+    result.reserve(templates.size());
+    for (auto& t : templates) result.push_back(t.render(symbols));
+    return result;
+}
+//==========================================================================================================
@@ -0,0 +1,54 @@
+//==========================================================================================================
+// template.h - Defines a text template that is compiled once and rendered many times
+//==========================================================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+
+// A symbol table maps a symbol name (including the '%' delimiters) to the text that replaces it
+typedef std::map<std::string, std::string> symtab_t;
+
+//----------------------------------------------------------------------------------------------------------
+// CTemplate - Text containing "%symbol%" references.  The text is split up front into a list of literal
+//             text and symbol references, so rendering is a single pass that never rescans the values
+//             that were substituted
+//
+// A symbol name consists of letters, digits and underscores.  A '%' that isn't part of a symbol
+// reference is literal text
+//----------------------------------------------------------------------------------------------------------
+class CTemplate
+{
+public:
+
+    // Default constructor
+    CTemplate() {m_literal_size = 0;}
+
+    // Constructs a compiled template from text
+    CTemplate(const std::string& text) {compile(text);}
+
+    // Call this to compile text into the template
+    void        compile(const std::string& text);
+
+    // Call this to render the template.  A symbol that isn't in the symbol table is left as-is
+    std::string render(const symtab_t& symbols) const;
+
+    // Convenience methods: compile and render a vector of templates
+    static std::vector<CTemplate>    compile(const std::vector<std::string>& lines);
+    static std::vector<std::string>  render(const std::vector<CTemplate>& templates, const symtab_t& symbols);
+
+    // Returns 'true' if "name" is a valid symbol name (without the '%' delimiters)
+    static bool is_symbol_name(const std::string& name);
+
+protected:
+
+    // A segment is either literal text, or the name of a symbol (including the '%' delimiters)
+    struct segment_t {bool is_symbol; std::string text;};
+
+    // The segments of the template, in order
+    std::vector<segment_t> m_segments;
+
+    // The total length of all of the literal segments
+    size_t      m_literal_size;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,121 @@
+//=========================================================================================================
+// test.cpp - Runs the unit tests
+//
+// Build and run with "make test".  The exit code is 0 if every check passed.  Pass the name of a test
+// on the command line to run only that test
+//=========================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "test.h"
+using namespace std;
+
+// A registered test
+struct test_t {const char* name; void (*fn)();};
+
+// Every registered test.  This is a function so that it exists before any registrar runs
+static vector<test_t>& tests() {static vector<test_t> list; return list;}
+
+// The number of checks that have run and failed
+static int checks, failures;
+
+// The scratch directory that tests write their files into
+static string scratch;
+
+
+//=========================================================================================================
+// CTestRegistrar() - Adds a test to the list
+//=========================================================================================================
+CTestRegistrar::CTestRegistrar(const char* name, void (*test)())
+{
+    tests().push_back({name, test});
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// check_that() - Records the outcome of a check, and reports it if it failed
+//=========================================================================================================
+void check_that(bool passed, const string& what, const char* file, int line)
+{
+    ++checks;
+    if (passed) return;
+    ++failures;
+    printf("    %s:%d: FAILED %s\n", file, line, what.c_str());
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// scratch_file() - Writes a file into the scratch directory, and returns its full path
+//=========================================================================================================
+string scratch_file(const string& name, const string& contents)
+{
+    string path = scratch_path(name);
+    ofstream(path, ios::binary | ios::trunc) << contents;
+    return path;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// scratch_path() - Returns the full path of a file in the scratch directory, without writing it
+//=========================================================================================================
+string scratch_path(const string& name)
+{
+    return scratch + "/" + name;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// source_path() - Returns the full path of a file in the src directory
+//
+// The tests run from src/obj_x86, so the src directory is the parent of the one our executable is in
+//=========================================================================================================
+string source_path(const string& name)
+{
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length < 0) return name;
+    path[length] = 0;
+    string dir = path;
+    dir = dir.substr(0, dir.rfind('/'));
+    return dir.substr(0, dir.rfind('/')) + "/" + name;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// main() - Runs every test (or just the one named on the command line) and reports the totals
+//=========================================================================================================
+int main(int argc, char** argv)
+{
+    char dir[] = "/tmp/smartlynq_test_XXXXXX";
+    if (mkdtemp(dir) == NULL) {perror("mkdtemp"); return 1;}
+    scratch = dir;
+
+    int ran = 0;
+    for (auto& test : tests())
+    {
+        if (argc > 1 && strcmp(argv[1], test.name) != 0) continue;
+        int failures_before = failures;
+        test.fn();
+        printf("%-40s %s\n", test.name, failures == failures_before ? "ok" : "FAILED");
+        ++ran;
+    }
+
+    printf("%d tests, %d checks, %d failed\n", ran, checks, failures);
+
+    // Throw away the scratch files
+    string command = "rm -rf " + scratch;
+    if (system(command.c_str()) != 0) printf("Couldn't remove %s\n", scratch.c_str());
+
+    return (failures || ran == 0) ? 1 : 0;
+}
+//=========================================================================================================
@@ -0,0 +1,59 @@
+//=========================================================================================================
+// test.h - Defines a minimal unit-test harness for the library
+//
+// A test is declared with TEST(name) { ... } in any file in this directory, and checks its results
+// with CHECK(), CHECK_EQ() and CHECK_THROWS().  A failed check is reported and the test carries on
+//=========================================================================================================
+#pragma once
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+// Records the outcome of a check, and reports it if it failed
+void check_that(bool passed, const std::string& what, const char* file, int line);
+
+// Writes a file into the scratch directory, and returns its full path
+std::string scratch_file(const std::string& name, const std::string& contents);
+
+// Returns the full path of a file in the scratch directory, without writing it
+std::string scratch_path(const std::string& name);
+
+// Returns the full path of a file in the src directory, such as "fake_vivado/vivado"
+std::string source_path(const std::string& name);
+
+//---------------------------------------------------------------------------------------------------------
+// CTestRegistrar - Adds a test to the list that main() runs.  Every TEST() declares one of these
+//---------------------------------------------------------------------------------------------------------
+class CTestRegistrar
+{
+public:
+    CTestRegistrar(const char* name, void (*test)());
+};
+//---------------------------------------------------------------------------------------------------------
+
+// check_equal() - Checks that two values are equal, and reports both of them if they aren't
+template <class A, class B>
+void check_equal(const A& actual, const B& expected, const char* text, const char* file, int line)
+{
+    if (actual == expected) {check_that(true, text, file, line); return;}
+    std::ostringstream what;
+    what << text << ": got \"" << actual << "\", expected \"" << expected << "\"";
+    check_that(false, what.str(), file, line);
+}
+
+#define TEST(name)                                                   \
+    static void name();                                              \
+    static CTestRegistrar name##_registrar(#name, name);             \
+    static void name()
+
+#define CHECK(condition) check_that((condition), #condition, __FILE__, __LINE__)
+
+#define CHECK_EQ(actual, expected) check_equal((actual), (expected), #actual, __FILE__, __LINE__)
+
+#define CHECK_THROWS(statement)                                      \
+    do                                                               \
+    {                                                                \
+        bool thrown = false;                                         \
+        try {statement;} catch (const std::runtime_error&) {thrown = true;} \
+        check_that(thrown, "throws: " #statement, __FILE__, __LINE__); \
+    } while (0)
@@ -0,0 +1,327 @@
+//=========================================================================================================
+// test_config.cpp - Tests CConfigFile and CConfigScript
+//=========================================================================================================
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../config_file.h"
+using namespace std;
+
+// A config file that uses most of the syntax
+static const char sampleConfig[] =
+    "# A comment\n"
+    "   // Another comment\n"
+    "name        = \"SmartLynq Programmer\"\n"
+    "Jobs        = 4\n"
+    "hex         = 0x1F\n"
+    "octal       = 010\n"
+    "grouped     = 1_000_000\n"
+    "negative    = -17\n"
+    "ratio       = 2.5\n"
+    "enabled     = on\n"
+    "disabled    = false\n"
+    "list        = 1, 2, 3\n"
+    "names       = alpha 'b c' \"d,e\"\n"
+    "empty       =\n"
+    "too_big     = 2147483648\n"
+    "too_small   = -2147483649\n"
+    "smallest    = -2147483648\n"
+    "unsigned    = 0xFFFFFFFF\n"
+    "not_number  = 12abc\n"
+    "duplicate   = first\n"
+    "duplicate   = second\n"
+    "\r\n"
+    "script      =\n"
+    "{\n"
+    "    open_hw_manager\n"
+    "    # comments in a script are dropped\n"
+    "    connect  -url %usb_ip%, 3121\n"
+    "\tsleep 0.25 -5 junk\n"
+    "}\n"
+    "\n"
+    "[Station]\n"
+    "jobs        = 8\n"
+    "only_here   = yes\n";
+
+
+//=========================================================================================================
+// read_sample() - Reads the sample config file into "cf"
+//=========================================================================================================
+static void read_sample(CConfigFile& cf)
+{
+    CHECK(cf.read(scratch_file("sample.conf", sampleConfig)));
+}
+//=========================================================================================================
+
+
+TEST(config_values)
+{
+    CConfigFile cf;
+    read_sample(cf);
+
+    CHECK_EQ(cf.get<string>("name"), "SmartLynq Programmer");
+    CHECK_EQ(cf.get<int32_t>("jobs"), 4);
+    CHECK_EQ(cf.get<int32_t>("JOBS"), 4);
+    CHECK_EQ(cf.get<int32_t>("hex"), 31);
+    CHECK_EQ(cf.get<int32_t>("octal"), 8);
+    CHECK_EQ(cf.get<int32_t>("grouped"), 1000000);
+    CHECK_EQ(cf.get<int32_t>("negative"), -17);
+    CHECK_EQ(cf.get<int32_t>("smallest"), INT32_MIN);
+    CHECK_EQ(cf.get<double>("ratio"), 2.5);
+    CHECK_EQ(cf.get<double>("jobs"), 4.0);
+    CHECK_EQ(cf.get<bool>("enabled"), true);
+    CHECK_EQ(cf.get<bool>("disabled"), false);
+    CHECK_EQ(cf.get<bool>("jobs"), true);
+    CHECK_EQ(cf.get<string>("duplicate"), "second");
+
+    // Every value of a key, as a vector
+    vector<int32_t> numbers;
+    vector<string>  strings;
+    CHECK(cf.get("list", &numbers));
+    CHECK(numbers == (vector<int32_t>{1, 2, 3}));
+    CHECK(cf.get("names", &strings));
+    CHECK(strings == (vector<string>{"alpha", "b c", "d,e"}));
+    CHECK(cf.get("empty", &strings));
+    CHECK(strings.empty());
+
+    // Several values of a key at once
+    int32_t a = 0, b = 0, c = 0, d = -1;
+    CHECK(cf.get("list", &a, &b, &c, &d));
+    CHECK(a == 1 && b == 2 && c == 3 && d == 0);
+}
+
+
+TEST(config_errors)
+{
+    CConfigFile cf;
+    read_sample(cf);
+
+    // Integers must fit in an int32_t
+    CHECK_THROWS(cf.get<int32_t>("too_big"));
+    CHECK_THROWS(cf.get<int32_t>("too_small"));
+    CHECK_THROWS(cf.get<int32_t>("unsigned"));
+    CHECK_THROWS(cf.get<int32_t>("not_number"));
+    CHECK_THROWS(cf.get<int32_t>("ratio"));
+    CHECK_THROWS(cf.get<double>("not_number"));
+    CHECK_THROWS(cf.get<bool>("name"));
+
+    // A typed key must have exactly one value
+    CHECK_THROWS(cf.get<int32_t>("list"));
+    CHECK_THROWS(cf.get<string>("empty"));
+
+    // Missing keys throw, unless we ask them not to
+    string s;
+    CHECK_THROWS(cf.get<string>("no_such_key"));
+    CHECK_THROWS(cf.get("no_such_key", &s));
+    cf.throw_on_fail(false);
+    CHECK(!cf.get("no_such_key", &s));
+
+    // Where there's no typed check, a number that doesn't fit converts to 0
+    int32_t value = -1;
+    CHECK(cf.get("too_big", &value));
+    CHECK_EQ(value, 0);
+
+    CHECK(!cf.read(scratch_file("sample.conf", sampleConfig) + ".missing", false));
+}
+
+
+TEST(config_sections)
+{
+    CConfigFile cf;
+    read_sample(cf);
+
+    // Keys are found in the current section first, then in the global section
+    CHECK_EQ(cf.get<int32_t>("jobs"), 4);
+    CHECK(!cf.exists("only_here"));
+    cf.set_current_section("station");
+    CHECK_EQ(cf.get<int32_t>("jobs"), 8);
+    CHECK_EQ(cf.get<string>("only_here"), "yes");
+    CHECK_EQ(cf.get<string>("name"), "SmartLynq Programmer");
+
+    // A fully scoped name looks in exactly one section
+    CHECK_EQ(cf.get<int32_t>("::jobs"), 4);
+    CHECK_EQ(cf.get<int32_t>("STATION::Jobs"), 8);
+    CHECK(!cf.exists("station::name"));
+    CHECK(!cf.exists("nowhere::jobs"));
+
+    // Looking up by ID finds the same values as looking up by name
+    CConfigFile::name_id_t jobs = cf.intern("jobs"), station = cf.intern("Station");
+    CHECK(cf.find(jobs) == cf.find("jobs"));
+    CHECK(cf.find(station, jobs) == cf.find("station::jobs"));
+    CHECK(cf.find(cf.intern("never_used")) == NULL);
+}
+
+
+TEST(config_many_keys)
+{
+    // Enough sections and keys to make every hash index grow several times
+    string text;
+    for (int s = 0; s < 20; ++s)
+    {
+        text += "[section" + to_string(s) + "]\n";
+        for (int k = 0; k < 500; ++k) text += "key" + to_string(k) + " = " + to_string(s * 1000 + k) + "\n";
+    }
+
+    CConfigFile cf;
+    CHECK(cf.read(scratch_file("many.conf", text)));
+    bool all_found = true;
+    for (int s = 0; s < 20; ++s) for (int k = 0; k < 500; k += 7)
+    {
+        string key = "section" + to_string(s) + "::key" + to_string(k);
+        if (cf.get<int32_t>(key) != s * 1000 + k) all_found = false;
+    }
+    CHECK(all_found);
+    CHECK(!cf.exists("section0::key500"));
+}
+
+
+TEST(config_long_lines)
+{
+    string huge(200000, 'v');
+    string script_line = "token " + string(100000, 's') + " 42";
+    string text = "huge = " + huge + "\nscript =\n{\n" + script_line + "\n}\nafter = 1\n";
+
+    CConfigFile cf;
+    CHECK(cf.read(scratch_file("long.conf", text)));
+    CHECK(cf.get<string>("huge") == huge);
+    CHECK_EQ(cf.get<int32_t>("after"), 1);
+
+    CConfigScript script;
+    CHECK(cf.get("script", &script));
+    CHECK_EQ(script.size(), 1);
+    CHECK(script[0].text() == script_line);
+    CHECK_EQ(script[0].token(1).size(), 100000u);
+    CHECK_EQ(script[0].get_int(2), 42);
+}
+
+
+//=========================================================================================================
+// station_jobs() - Reads a config file through its cache, and returns the value of "jobs" in [Station]
+//=========================================================================================================
+static int32_t station_jobs(const string& conf, const string& cache)
+{
+    CConfigFile cf;
+    int32_t     jobs = 0;
+    cf.set_cache_file(cache);
+    CHECK(cf.read(conf));
+    cf.set_current_section("station");
+    CHECK(cf.get("jobs", &jobs));
+    return jobs;
+}
+//=========================================================================================================
+
+
+TEST(config_cache)
+{
+    string conf  = scratch_file("cached.conf", sampleConfig);
+    string cache = conf + ".cache";
+    unlink(cache.c_str());
+
+    // The first read parses the file, and writes the cache
+    {
+        CConfigFile cf;
+        cf.set_cache_file(cache);
+        CHECK(cf.read(conf));
+        cf.write_cache();
+        CHECK(access(cache.c_str(), F_OK) == 0);
+    }
+
+    // The second read comes from the cache, and must find exactly the same things
+    {
+        CConfigFile cf;
+        string name;
+        int32_t jobs = 0;
+        vector<string> lines;
+        cf.set_cache_file(cache);
+        CHECK(cf.read(conf));
+        CHECK(cf.get("name", &name));
+        CHECK_EQ(name, "SmartLynq Programmer");
+        CHECK(cf.get_script_vector("script", &lines));
+        CHECK_EQ(lines.size(), 3u);
+        cf.set_current_section("station");
+        CHECK(cf.get("jobs", &jobs));
+        CHECK_EQ(jobs, 8);
+    }
+
+    // When the config file changes, the stale cache is ignored.  The new key is in the last section
+    scratch_file("cached.conf", string(sampleConfig) + "jobs = 6\n");
+    CHECK_EQ(station_jobs(conf, cache), 6);
+
+    // A cache file that is garbage is ignored too
+    scratch_file("cached.conf.cache", "this is not a cache file");
+    CHECK_EQ(station_jobs(conf, cache), 6);
+}
+
+
+TEST(config_script_lines)
+{
+    CConfigFile cf;
+    read_sample(cf);
+
+    // Script lines lose their leading spaces, and comment lines are dropped
+    vector<string> lines;
+    CHECK(cf.get_script_vector("script", &lines));
+    CHECK(lines == (vector<string>{"open_hw_manager", "connect  -url %usb_ip%, 3121", "\tsleep 0.25 -5 junk"}));
+
+    CConfigScript script;
+    CHECK(cf.get("script", &script));
+    CHECK_EQ(script.size(), 3);
+    CHECK_EQ(script[1].token_count(), 4);
+    CHECK(script[1].token(0) == "connect");
+    CHECK(script[1].token(2) == "%usb_ip%");
+    CHECK_EQ(script[1].get_int(3), 3121);
+    CHECK_EQ(script[2].get_float(1), 0.25);
+    CHECK_EQ(script[2].get_int(2), -5);
+    CHECK_EQ(script[2].get_int(3), 0);
+
+    // Lines and tokens that don't exist are empty
+    CHECK(script[1].token(4).empty());
+    CHECK(script[1].token(-1).empty());
+    CHECK_EQ(script[1].get_int(9), 0);
+    CHECK(script[3].text().empty());
+    CHECK_EQ(script[-1].token_count(), 0);
+
+    // Range-based iteration visits every line
+    int count = 0;
+    for (auto line : script) count += line.token_count();
+    CHECK_EQ(count, 1 + 4 + 4);
+}
+
+
+TEST(config_script_sequential)
+{
+    CConfigScript script;
+    script = vector<string>{"Set IP 10.0.0.1", "", "wait 1.5, 3"};
+
+    int    tokens;
+    string text;
+    CHECK(script.get_next_line(&tokens, &text));
+    CHECK_EQ(tokens, 3);
+    CHECK_EQ(text, "Set IP 10.0.0.1");
+    CHECK_EQ(script.get_next_token(true), "set");
+    CHECK_EQ(script.get_next_token(), "IP");
+    CHECK_EQ(script.get_next_token(), "10.0.0.1");
+    CHECK_EQ(script.get_next_token(), "");
+
+    CHECK(script.get_next_line(&tokens));
+    CHECK_EQ(tokens, 0);
+    CHECK_EQ(script.get_next_int(), 0);
+
+    CHECK(script.get_next_line());
+    CHECK_EQ(script.get_next_token(), "wait");
+    CHECK_EQ(script.get_next_float(), 1.5);
+    CHECK_EQ(script.get_next_int(), 3);
+    CHECK_EQ(script.get_next_float(), 0.0);
+    CHECK(!script.get_next_line(&tokens, &text));
+    CHECK_EQ(text, "");
+
+    // After a rewind, the same lines come back
+    script.rewind();
+    CHECK(script.get_next_line());
+    CHECK_EQ(script.get_next_token(), "Set");
+
+    script.make_empty();
+    CHECK_EQ(script.size(), 0);
+    CHECK(!script.get_next_line());
+}
@@ -0,0 +1,116 @@
+//=========================================================================================================
+// test_manifest.cpp - Tests CManifest and CSerialManifest
+//=========================================================================================================
+#include <string>
+#include "test.h"
+#include "../manifest.h"
+using namespace std;
+
+
+TEST(manifest_parse_line)
+{
+    CManifest manifest;
+    device_t  device;
+
+    CHECK(!manifest.parse("", &device));
+    CHECK(!manifest.parse("   ", &device));
+    CHECK(!manifest.parse("# 10.0.0.1 10.0.0.2", &device));
+    CHECK(!manifest.parse("  // a comment", &device));
+
+    CHECK(manifest.parse("10.0.0.1 192.168.1.5", &device));
+    CHECK_EQ(device.usb_ip, "10.0.0.1");
+    CHECK_EQ(device.static_ip, "192.168.1.5");
+
+    CHECK(manifest.parse("  10.0.0.2,\t192.168.1.6\r", &device));
+    CHECK_EQ(device.usb_ip, "10.0.0.2");
+    CHECK_EQ(device.static_ip, "192.168.1.6");
+}
+
+
+TEST(manifest_malformed_lines)
+{
+    CManifest manifest;
+    device_t  device;
+
+    CHECK_THROWS(manifest.parse("10.0.0.1", &device));
+    CHECK_THROWS(manifest.parse("10.0.0.1 10.0.0.2 10.0.0.3", &device));
+    CHECK_THROWS(manifest.parse("10.0.0.256 10.0.0.2", &device));
+    CHECK_THROWS(manifest.parse("10.0.0.1 10.0.0", &device));
+    CHECK_THROWS(manifest.parse("10.0.0.1 host.example.com", &device));
+    CHECK_THROWS(manifest.parse("10.0.0.1 10.0.0.2.", &device));
+    CHECK_THROWS(manifest.parse("::1 10.0.0.2", &device));
+}
+
+
+TEST(manifest_read)
+{
+    CManifest manifest;
+
+    string path = scratch_file("manifest.txt",
+        "# USB IP      static IP\n"
+        "10.0.0.1      192.168.1.5\n"
+        "\n"
+        "// the next one is on the bench\n"
+        "10.0.0.2,     192.168.1.6\r\n");
+    CHECK(manifest.read(path));
+    CHECK_EQ(manifest.devices().size(), 2u);
+    CHECK_EQ(manifest.devices()[1].static_ip, "192.168.1.6");
+
+    // Every device must have its own USB IP address
+    path = scratch_file("manifest_twice.txt", "10.0.0.1 192.168.1.5\n10.0.0.1 192.168.1.6\n");
+    CHECK_THROWS(manifest.read(path));
+
+    // A malformed line is reported with its line number
+    path = scratch_file("manifest_bad.txt", "10.0.0.1 192.168.1.5\n\n10.0.0.3 192.168.1\n");
+    try
+    {
+        manifest.read(path);
+        CHECK(false);
+    }
+    catch (const runtime_error& e)
+    {
+        CHECK(string(e.what()).find("line 3: 192.168.1 is malformed") != string::npos);
+    }
+
+    CHECK(!manifest.read(path + ".missing", false));
+}
+
+
+TEST(serial_manifest)
+{
+    CSerialManifest manifest;
+    string static_ip;
+
+    string path = scratch_file("serials.txt",
+        "# Serial       static IP\n"
+        "SLQ-0001       192.168.1.5\n"
+        "\n"
+        "   // comment\n"
+        "\"SLQ 0002\",   192.168.1.6\n");
+    CHECK(manifest.read(path));
+    CHECK_EQ(manifest.size(), 2u);
+    CHECK(manifest.lookup("SLQ-0001", &static_ip));
+    CHECK_EQ(static_ip, "192.168.1.5");
+    CHECK(manifest.lookup("SLQ 0002", &static_ip));
+    CHECK_EQ(static_ip, "192.168.1.6");
+    CHECK(!manifest.lookup("slq-0001", &static_ip));
+    CHECK(!manifest.lookup("SLQ-9999", &static_ip));
+
+    CHECK(!manifest.read(path + ".missing"));
+    CHECK_EQ(manifest.size(), 0u);
+}
+
+
+TEST(serial_manifest_errors)
+{
+    CSerialManifest manifest;
+
+    CHECK_THROWS(manifest.read(scratch_file("s1.txt", "SLQ-0001 192.168.1.5\nSLQ-0001 192.168.1.6\n")));
+    CHECK_THROWS(manifest.read(scratch_file("s2.txt", "SLQ-0001\n")));
+    CHECK_THROWS(manifest.read(scratch_file("s3.txt", "SLQ-0001 192.168.1.5 extra\n")));
+    CHECK_THROWS(manifest.read(scratch_file("s4.txt", "SLQ-0001 192.168.1.500\n")));
+    CHECK_THROWS(manifest.read(scratch_file("s5.txt", "SLQ-0001 1.2.3\n")));
+
+    // The same static IP address for two serial numbers is allowed
+    CHECK(manifest.read(scratch_file("s6.txt", "SLQ-0001 192.168.1.5\nSLQ-0002 192.168.1.5\n")));
+}
@@ -0,0 +1,137 @@
+//=========================================================================================================
+// test_process.cpp - Tests CProcess by running the fake Vivado
+//=========================================================================================================
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../process.h"
+using namespace std;
+
+
+//=========================================================================================================
+// fake_vivado() - Configures the fake Vivado, and returns the command line that runs a script with it
+//
+// Passed:  conf   = The contents of the fake Vivado's configuration file
+//          script = The TCL script that it runs in batch mode
+//=========================================================================================================
+static string fake_vivado(const string& conf, const string& script)
+{
+    setenv("FAKE_VIVADO_CONF", scratch_file("fake_vivado.conf", conf).c_str(), 1);
+    return source_path("fake_vivado/vivado") + " -mode batch -source " + scratch_file("script.tcl", script);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// has_exited() - Waits up to two seconds for a process that isn't our child to exit
+//
+// Returns: 'true' once it has exited.  A zombie has exited, even if nobody has reaped it yet
+//=========================================================================================================
+static bool has_exited(pid_t pid)
+{
+    for (int i = 0; i < 200; ++i)
+    {
+        ifstream stat("/proc/" + to_string(pid) + "/stat");
+        string   field, state;
+        if (!(stat >> field >> field >> state) || state == "Z") return true;
+        usleep(10000);
+    }
+    return false;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// elapsed_ms() - Returns the number of milliseconds since "start"
+//=========================================================================================================
+static long elapsed_ms(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+//=========================================================================================================
+
+
+TEST(process_exit_status)
+{
+    CProcess       process;
+    vector<string> output;
+
+    // A script that succeeds, and a line much longer than any buffer, which must arrive in one piece
+    string longLine(5000, 'x');
+    CHECK_EQ(process.run(fake_vivado("", "open_hw_manager\nputs {" + longLine + "}\n"), &output), 0);
+    bool found = false;
+    for (auto& line : output) if (line == longLine) found = true;
+    CHECK(found);
+
+    // A script that fails, and a Vivado that crashes
+    CHECK_EQ(process.run(fake_vivado("", "connect_hw_server -url 10.0.0.1\n"), &output), 1);
+    CHECK_EQ(process.run(fake_vivado("crash = launch\n", "open_hw_manager\n"), &output), 139);
+    CHECK(!process.timed_out() && !process.was_aborted());
+}
+
+
+TEST(process_timeout_kills_group)
+{
+    CProcess process;
+    pid_t    grandchild = 0;
+
+    // Vivado hangs while it starts up, in the background of a shell that reports its process ID
+    string command = fake_vivado("hang = launch\n", "open_hw_manager\n") + " & echo $!; wait";
+    process.set_initial_timeout(500);
+
+    auto start = chrono::steady_clock::now();
+    process.run(command, [&](const string& line)
+    {
+        if (grandchild == 0) grandchild = atoi(line.c_str());
+        return true;
+    });
+
+    // The deadline kills the whole process group, so the Vivado that the shell started dies too
+    CHECK(process.timed_out());
+    CHECK(!process.was_aborted());
+    CHECK(elapsed_ms(start) < 3000);
+    CHECK(grandchild > 0);
+    if (grandchild > 0) CHECK(has_exited(grandchild));
+}
+
+
+TEST(process_abort_kills_group)
+{
+    CProcess process;
+    pid_t    grandchild = 0;
+    bool     sawError = false;
+
+    // One SmartLynq fails to connect, and the script carries on to update another one, which hangs
+    // without printing anything more.  So only killing it stops it
+    string conf   = "output_lines = 0\n[10.0.0.1]\nfail = connect\n[10.0.0.2]\nhang = update\n";
+    string script = "open_hw_manager\n"
+                    "connect_hw_server -url 10.0.0.2\n"
+                    "if {[catch {\n"
+                    "connect_hw_server -url 10.0.0.1\n"
+                    "} msg]} {\n"
+                    "}\n"
+                    "update_hw_firmware [current_hw_server]\n";
+    process.set_initial_timeout(10000);
+
+    // Abort on the first error, rather than waiting for the deadline
+    auto start = chrono::steady_clock::now();
+    process.run(fake_vivado(conf, script) + " & echo $!; wait", [&](const string& line)
+    {
+        if (grandchild == 0) grandchild = atoi(line.c_str());
+        if (line.compare(0, 6, "ERROR:") != 0) return true;
+        sawError = true;
+        return false;
+    });
+
+    CHECK(sawError);
+    CHECK(process.was_aborted());
+    CHECK(!process.timed_out());
+    CHECK(elapsed_ms(start) < 3000);
+    CHECK(grandchild > 0);
+    if (grandchild > 0) CHECK(has_exited(grandchild));
+}
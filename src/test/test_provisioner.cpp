@@ -0,0 +1,136 @@
+//=========================================================================================================
+// test_provisioner.cpp - Tests CProvisioner by programming SmartLynqs that the fake Vivado simulates
+//=========================================================================================================
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../provisioner.h"
+using namespace std;
+
+
+//=========================================================================================================
+// configure() - Configures a provisioner to run the fake Vivado
+//
+// Passed:  provisioner = The provisioner to configure
+//          settings    = Lines that override the settings in the default smartlynq_static_ip.conf
+//          fake        = The contents of the fake Vivado's configuration file
+//=========================================================================================================
+static void configure(CProvisioner& provisioner, const string& settings, const string& fake)
+{
+    // Start from the conf file that we ship.  When a key appears twice, the last one wins
+    ostringstream conf;
+    conf << ifstream(source_path("smartlynq_static_ip.conf")).rdbuf();
+
+    string tmp = scratch_path("tmp");
+    mkdir(tmp.c_str(), 0755);
+    conf << "\nvivado = \"" << source_path("fake_vivado/vivado") << "\"\n"
+         << "tmp = \"" << tmp << "\"\n"
+         << settings;
+
+    setenv("FAKE_VIVADO_CONF", scratch_file("fake_vivado.conf", fake).c_str(), 1);
+    provisioner.configure(scratch_file("smartlynq_static_ip.conf", conf.str()));
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// elapsed_ms() - Returns the number of milliseconds since "start"
+//=========================================================================================================
+static long elapsed_ms(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+//=========================================================================================================
+
+
+// Every phase gets a one-second deadline
+static const char phaseTimeouts[] =
+    "launch_timeout  = 1\n"
+    "connect_timeout = 1\n"
+    "update_timeout  = 1\n"
+    "reset_timeout   = 1\n";
+
+
+TEST(provisioner_watchdog_kills_hung_phase)
+{
+    const device_t device = {"10.0.0.1", "192.168.1.10"};
+
+    for (string phase : {"launch", "connect", "update", "reset"})
+    {
+        CProvisioner provisioner;
+        configure(provisioner, phaseTimeouts, "hang = " + phase + "\n");
+
+        // The watchdog kills Vivado once it has spent a second in the phase it hangs in, and says which
+        auto start = chrono::steady_clock::now();
+        CProvisioner::result_t result = provisioner.program(device);
+        CHECK_EQ(result.rc, 1);
+        CHECK_EQ(result.message, "Watchdog: Vivado killed after spending more than 1 seconds in the \""
+                                 + phase + "\" phase");
+        CHECK(elapsed_ms(start) < 3000);
+    }
+}
+
+
+TEST(provisioner_deadline_is_per_phase)
+{
+    CProvisioner provisioner;
+
+    // Each phase takes most of its deadline, so the whole job takes far longer than any one deadline
+    configure(provisioner, phaseTimeouts, "launch_ms  = 700\n"
+                                          "connect_ms = 700\n"
+                                          "update_ms  = 700\n"
+                                          "reset_ms   = 700\n");
+
+    auto start = chrono::steady_clock::now();
+    CProvisioner::result_t result = provisioner.program({"10.0.0.1", "192.168.1.10"});
+    CHECK_EQ(result.rc, 0);
+    CHECK_EQ(result.message, "");
+    CHECK(elapsed_ms(start) > 2000);
+}
+
+
+TEST(provisioner_pipelined_batch)
+{
+    CProvisioner provisioner;
+
+    // Every SmartLynq takes a second to reboot, and the third one fails, so it never reboots
+    configure(provisioner, "pipeline_depth = 2\n", "reset_ms = 1000\n"
+                                                   "[10.0.0.3]\n"
+                                                   "fail = update\n");
+
+    vector<device_t> devices;
+    for (int i = 1; i <= 5; ++i) devices.push_back({"10.0.0." + to_string(i), "192.168.1." + to_string(i)});
+
+    string         reported;
+    vector<string> output;
+    auto start = chrono::steady_clock::now();
+    int failures = provisioner.program_batch(devices, [&](const CProvisioner::result_t& result)
+    {
+        reported += result.device.usb_ip + (result.rc ? " failed\n" : " ok\n");
+    }, nullptr, &output);
+
+    // The outcomes are handed over in the order of the devices
+    CHECK_EQ(failures, 1);
+    CHECK_EQ(reported, "10.0.0.1 ok\n10.0.0.2 ok\n10.0.0.3 failed\n10.0.0.4 ok\n10.0.0.5 ok\n");
+
+    // A device is let go of once more than two are rebooting, the one that failed is never held on to,
+    // and the batch ends by letting go of the rest
+    string order;
+    for (auto& line : output)
+    {
+        istringstream words(line);
+        string        tag, id, status;
+        words >> tag >> id >> status;
+        if (tag == "SMARTLYNQ_RESULT")   order += id + " " + status + ", ";
+        if (tag == "SMARTLYNQ_RELEASED") order += "released " + id + ", ";
+    }
+    CHECK_EQ(order, "1 OK, 2 OK, 3 FAILED, 4 OK, released 1, 5 OK, released 2, released 4, released 5, ");
+
+    // The reboots overlap, so the batch takes far less than the four seconds they'd take one after another
+    CHECK(elapsed_ms(start) < 3000);
+}
@@ -0,0 +1,78 @@
+//=========================================================================================================
+// test_template.cpp - Tests CTemplate
+//=========================================================================================================
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../template.h"
+using namespace std;
+
+
+TEST(template_substitution)
+{
+    symtab_t symbols = {{"%usb_ip%", "10.0.0.1"}, {"%static_ip%", "192.168.1.5"}, {"%empty%", ""}};
+
+    CHECK_EQ(CTemplate("").render(symbols), "");
+    CHECK_EQ(CTemplate("no symbols").render(symbols), "no symbols");
+    CHECK_EQ(CTemplate("%usb_ip%").render(symbols), "10.0.0.1");
+    CHECK_EQ(CTemplate("connect %usb_ip% as %static_ip%.").render(symbols), "connect 10.0.0.1 as 192.168.1.5.");
+    CHECK_EQ(CTemplate("%usb_ip%%static_ip%").render(symbols), "10.0.0.1192.168.1.5");
+    CHECK_EQ(CTemplate("[%empty%]").render(symbols), "[]");
+}
+
+
+TEST(template_edge_cases)
+{
+    symtab_t symbols = {{"%a%", "A"}, {"%b_2%", "B"}};
+
+    // A symbol that isn't in the table is left as-is
+    CHECK_EQ(CTemplate("x %missing% y").render(symbols), "x %missing% y");
+
+    // A '%' that doesn't start a "%name%" is literal text
+    CHECK_EQ(CTemplate("100%").render(symbols), "100%");
+    CHECK_EQ(CTemplate("%%").render(symbols), "%%");
+    CHECK_EQ(CTemplate("50% of %a%").render(symbols), "50% of A");
+    CHECK_EQ(CTemplate("%not a symbol% %a%").render(symbols), "%not a symbol% A");
+    CHECK_EQ(CTemplate("%a").render(symbols), "%a");
+    CHECK_EQ(CTemplate("%%a%%").render(symbols), "%A%");
+    CHECK_EQ(CTemplate("%b_2%").render(symbols), "B");
+
+    // Symbols are matched exactly, including case
+    CHECK_EQ(CTemplate("%A%").render(symbols), "%A%");
+}
+
+
+TEST(template_values_are_not_rescanned)
+{
+    // A value that looks like a symbol reference is inserted literally
+    symtab_t symbols = {{"%a%", "%b%"}, {"%b%", "B"}};
+    CHECK_EQ(CTemplate("%a% %b%").render(symbols), "%b% B");
+}
+
+
+TEST(template_recompile)
+{
+    symtab_t symbols = {{"%a%", "A"}};
+    CTemplate t("first %a%");
+    t.compile("second");
+    CHECK_EQ(t.render(symbols), "second");
+    CHECK_EQ(CTemplate().render(symbols), "");
+}
+
+
+TEST(template_vectors)
+{
+    symtab_t symbols = {{"%ip%", "1.2.3.4"}};
+    auto templates = CTemplate::compile(vector<string>{"a %ip%", "", "%ip% b"});
+    CHECK(CTemplate::render(templates, symbols) == (vector<string>{"a 1.2.3.4", "", "1.2.3.4 b"}));
+}
+
+
+TEST(template_symbol_names)
+{
+    CHECK(CTemplate::is_symbol_name("static_ip"));
+    CHECK(CTemplate::is_symbol_name("X1"));
+    CHECK(!CTemplate::is_symbol_name(""));
+    CHECK(!CTemplate::is_symbol_name("static-ip"));
+    CHECK(!CTemplate::is_symbol_name("%static_ip%"));
+}
@@ -0,0 +1,124 @@
+//=========================================================================================================
+// test_tokenizer.cpp - Tests CTokenizer, including the 8-bytes-at-a-time scan
+//=========================================================================================================
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../tokenizer.h"
+using namespace std;
+
+
+//=========================================================================================================
+// reference_parse() - Tokenizes a line one character at a time, the obvious way.  The tokenizer must
+//                     always agree with this
+//=========================================================================================================
+static vector<string> reference_parse(const string& input)
+{
+    vector<string> result;
+    size_t i = 0, n = input.size();
+    auto eol = [&](size_t j) {return j >= n || input[j] == 0 || input[j] == '\n' || input[j] == '\r';};
+    auto ws  = [&](size_t j) {return j < n && (input[j] == ' ' || input[j] == '\t');};
+
+    while (!eol(i))
+    {
+        while (ws(i)) ++i;
+        if (eol(i)) break;
+
+        string token;
+        if (input[i] == '"' || input[i] == '\'')
+        {
+            char quote = input[i++];
+            while (!eol(i) && input[i] != quote) token += input[i++];
+            if (i < n && input[i] == quote) ++i;
+        }
+        else
+        {
+            while (!eol(i) && !ws(i) && input[i] != ',') token += input[i++];
+        }
+        result.push_back(token);
+
+        while (ws(i)) ++i;
+        if (i < n && input[i] == ',') ++i;
+    }
+    return result;
+}
+//=========================================================================================================
+
+
+TEST(tokenizer_basic)
+{
+    CTokenizer tokenizer;
+    CHECK(tokenizer.parse("") == vector<string>{});
+    CHECK(tokenizer.parse("   \t ") == vector<string>{});
+    CHECK(tokenizer.parse("a b\tc") == (vector<string>{"a", "b", "c"}));
+    CHECK(tokenizer.parse("a, b ,c,") == (vector<string>{"a", "b", "c"}));
+    CHECK(tokenizer.parse("a,,b") == (vector<string>{"a", "", "b"}));
+    CHECK(tokenizer.parse("\"x y, z\" 'it''s'") == (vector<string>{"x y, z", "it", "s"}));
+    CHECK(tokenizer.parse("\"\"") == vector<string>{""});
+    CHECK(tokenizer.parse("\"unterminated quote") == vector<string>{"unterminated quote"});
+}
+
+
+TEST(tokenizer_stops_at_end_of_line)
+{
+    CTokenizer tokenizer;
+    CHECK(tokenizer.parse("a b\r\nc d") == (vector<string>{"a", "b"}));
+    CHECK(tokenizer.parse("a b\nc d")   == (vector<string>{"a", "b"}));
+    CHECK(tokenizer.parse(string("a b\0c d", 7)) == (vector<string>{"a", "b"}));
+    CHECK(tokenizer.parse("\"quoted\nnext line\"") == vector<string>{"quoted"});
+}
+
+
+TEST(tokenizer_tokens_are_slices)
+{
+    CTokenizer tokenizer;
+    string input = "first   \"second\"";
+    vector<string_view> tokens;
+    tokenizer.parse(input, &tokens);
+    CHECK_EQ(tokens.size(), 2u);
+    CHECK(tokens[0].data() == input.data());
+    CHECK(tokens[1].data() == input.data() + 9);
+}
+
+
+TEST(tokenizer_long_lines)
+{
+    CTokenizer tokenizer;
+
+    // A token much longer than a scan word, and delimiters at every offset within a word
+    string huge(100000, 'x');
+    CHECK(tokenizer.parse(huge + " y") == (vector<string>{huge, "y"}));
+    for (size_t length = 1; length <= 24; ++length)
+    {
+        string token(length, 'a' + length % 26);
+        string line = token + "," + token + " '" + token + " " + token + "'\r" + token;
+        CHECK(tokenizer.parse(line) == reference_parse(line));
+    }
+}
+
+
+TEST(tokenizer_matches_reference)
+{
+    CTokenizer tokenizer;
+    static const char alphabet[] = {'a', 'b', ' ', '\t', ',', '"', '\'', '\r', '\n', '\0', '\x80', '\xff'};
+
+    // Random lines of every length up to a few scan words.  The common characters are weighted so
+    // that most lines have several tokens before they end
+    srand(12345);
+    for (int trial = 0; trial < 20000; ++trial)
+    {
+        string line(rand() % 40, 'a');
+        for (char& c : line)
+        {
+            int r = rand() % 100;
+            c = (r < 60) ? alphabet[r % 2] : alphabet[2 + r % (sizeof alphabet - 2)];
+        }
+        if (tokenizer.parse(line) != reference_parse(line))
+        {
+            check_that(false, "random line #" + to_string(trial), __FILE__, __LINE__);
+            return;
+        }
+    }
+    CHECK(true);
+}
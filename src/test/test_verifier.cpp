@@ -0,0 +1,133 @@
+//=========================================================================================================
+// test_verifier.cpp - Tests CVerifier against ports on the loopback interface and the fake hw_server
+//=========================================================================================================
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include "test.h"
+#include "../verifier.h"
+#include "../process.h"
+using namespace std;
+
+
+//=========================================================================================================
+// closed_port() - Returns a loopback TCP port that nothing is listening on
+//=========================================================================================================
+static int closed_port()
+{
+    sockaddr_in addr = {};
+    socklen_t   size = sizeof addr;
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Let the kernel pick a free port, then stop using it
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    bind(sd, (sockaddr*)&addr, sizeof addr);
+    getsockname(sd, (sockaddr*)&addr, &size);
+    close(sd);
+    return ntohs(addr.sin_port);
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// start_hw_server() - Starts the fake hw_server, and waits until it's listening
+//
+// Passed:  port     = The port that it listens on
+//          manifest = The "<USB_IP> <STATIC_IP>" lines of the SmartLynqs that it simulates
+//          conf     = The contents of its configuration file
+//
+// Returns: Its process ID, or -1 if it didn't start
+//=========================================================================================================
+static pid_t start_hw_server(int port, const string& manifest, const string& conf)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    // "exec" makes the shell's process ID that of the fake hw_server
+    string command = "exec " + source_path("fake_hw_server/fake_hw_server") + " -port " + to_string(port)
+                   + " -conf " + scratch_file("fake_hw_server.conf", conf)
+                   + " " + scratch_file("manifest.txt", manifest);
+    pid_t pid = CProcess::spawn(command, -1, fds[1]);
+    close(fds[1]);
+
+    // It says so once every SmartLynq is up
+    char c;
+    while (read(fds[0], &c, 1) == 1 && c != '\n');
+    close(fds[0]);
+    return pid;
+}
+//=========================================================================================================
+
+
+//=========================================================================================================
+// stop_hw_server() - Stops the fake hw_server that "start_hw_server()" started
+//=========================================================================================================
+static void stop_hw_server(pid_t pid)
+{
+    if (pid <= 0) return;
+    kill(-pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    CProcess::unregister_child(pid);
+}
+//=========================================================================================================
+
+
+TEST(verifier_backs_off)
+{
+    CVerifier               verifier;
+    CVerifier::result_t     rebooted = {}, silent = {};
+    int                     port = closed_port();
+
+    // One SmartLynq answers at its static IP address once it has rebooted, and the other one never does
+    pid_t pid = start_hw_server(port, "127.0.9.2 127.0.9.3\n127.0.9.4 127.0.9.5\n",
+                                "reboot_ms = 1200\n"
+                                "[127.0.9.4]\n"
+                                "static_ip_up = never\n");
+    CHECK(pid > 0);
+
+    // Reset them both, and start checking while they reboot
+    kill(pid, SIGUSR1);
+    verifier.add("127.0.9.3", port, 10000, [&](const CVerifier::result_t& result) {rebooted = result;});
+    verifier.add("127.0.9.5", port,  3000, [&](const CVerifier::result_t& result) {silent = result;});
+    verifier.wait();
+    stop_hw_server(pid);
+
+    // Attempts start 0, 250, 750 and 1750 milliseconds in, so the fourth one finds it up
+    CHECK(rebooted.ready);
+    CHECK_EQ(rebooted.attempts, 4);
+    CHECK(rebooted.ms > 1200 && rebooted.ms < 2500);
+
+    // The fifth attempt would start 3750 milliseconds in, after the deadline
+    CHECK(!silent.ready);
+    CHECK_EQ(silent.attempts, 4);
+    CHECK(silent.ms >= 3000 && silent.ms < 3500);
+}
+
+
+TEST(verifier_stop_fails_outstanding)
+{
+    CVerifier   verifier;
+    atomic<int> calls(0), ready(0);
+    int         port = closed_port();
+
+    // Nothing will ever answer on this port, so these would run for a minute
+    for (int i = 0; i < 3; ++i)
+    {
+        verifier.add("127.0.0.1", port, 60000, [&](const CVerifier::result_t& result)
+        {
+            ++calls;
+            if (result.ready) ++ready;
+        });
+    }
+    usleep(100000);
+
+    // Stopping must hand every one of them to its callback as having failed
+    verifier.stop();
+    CHECK_EQ(calls.load(), 3);
+    CHECK_EQ(ready.load(), 0);
+}
@@ -0,0 +1,124 @@
+//==========================================================================================================
+// timings.cpp - Implements a recorder for the high-resolution timings of the phases of a job
+//==========================================================================================================
+#include <stdio.h>
+#include "timings.h"
+
+using namespace std;
+using namespace std::chrono;
+
+
+//==========================================================================================================
+// CSpan() - Starts timing a span of work
+//==========================================================================================================
+CTimings::CSpan::CSpan(CTimings& timings, const string& name) : m_timings(timings), m_name(name)
+{
+    m_start   = now();
+    m_running = true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stop() - Stops timing a span of work, and adds the time to the phase
+//==========================================================================================================
+void CTimings::CSpan::stop()
+{
+    if (!m_running) return;
+    m_timings.add(m_name, since(m_start));
+    m_running = false;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// since() - Returns the number of milliseconds elapsed since a point in time
+//==========================================================================================================
+double CTimings::since(time_point_t start)
+{
+    return duration<double, milli>(now() - start).count();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// add() - Adds a number of milliseconds to the named phase
+//==========================================================================================================
+void CTimings::add(const string& name, double ms)
+{
+    for (auto& phase : m_phases)
+    {
+        if (phase.first == name)
+        {
+            phase.second += ms;
+            return;
+        }
+    }
+
+    m_phases.push_back({name, ms});
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// begin_phase() - Ends the sequential phase in progress (if any) and starts a new one
+//==========================================================================================================
+void CTimings::begin_phase(const string& name)
+{
+    end_phase();
+    m_current       = name;
+    m_current_start = now();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// end_phase() - Ends the sequential phase in progress, if any
+//==========================================================================================================
+void CTimings::end_phase()
+{
+    if (m_current.empty()) return;
+    add(m_current, since(m_current_start));
+    m_current.clear();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// merge() - Adds every phase of another set of timings to this one
+//==========================================================================================================
+void CTimings::merge(const CTimings& other)
+{
+    for (auto& phase : other.m_phases) add(phase.first, phase.second);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// get() - Returns the number of milliseconds spent in the named phase
+//==========================================================================================================
+double CTimings::get(const string& name) const
+{
+    for (auto& phase : m_phases) if (phase.first == name) return phase.second;
+    return 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// json() - Returns the timings as a JSON object.  Phase names are identifiers, so they need no escaping
+//==========================================================================================================
+string CTimings::json() const
+{
+    string result = "{";
+    char   buffer[64];
+
+    for (size_t i=0; i<m_phases.size(); ++i)
+    {
+        snprintf(buffer, sizeof buffer, "%.3f", m_phases[i].second);
+        result += (i ? ", \"" : "\"") + m_phases[i].first + "\": " + buffer;
+    }
+
+    return result + "}";
+}
+//==========================================================================================================
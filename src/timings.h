@@ -0,0 +1,79 @@
+//==========================================================================================================
+// timings.h - Defines a recorder for the high-resolution timings of the phases of a job
+//==========================================================================================================
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+
+//----------------------------------------------------------------------------------------------------------
+// CTimings - Accumulates the time spent in each named phase of a job, in milliseconds
+//
+// Time is added to a phase either by a CTimings::CSpan that lives for the duration of the work, or by
+// "begin_phase()" for phases that follow one after another (such as the phases that Vivado announces),
+// where the start of one phase is the end of the previous one.  A phase that is timed more than once
+// accumulates the total
+//----------------------------------------------------------------------------------------------------------
+class CTimings
+{
+public:
+
+    typedef std::chrono::steady_clock::time_point time_point_t;
+
+    //------------------------------------------------------------------------------------------------------
+    // CSpan - Times the work done between its construction and "stop()" (or its destruction)
+    //------------------------------------------------------------------------------------------------------
+    class CSpan
+    {
+    public:
+        CSpan(CTimings& timings, const std::string& name);
+        ~CSpan() {stop();}
+
+        // Call this to stop timing before the span goes out of scope
+        void stop();
+
+    protected:
+        CTimings&    m_timings;
+        std::string  m_name;
+        time_point_t m_start;
+        bool         m_running;
+    };
+    //------------------------------------------------------------------------------------------------------
+
+    // Default constructor
+    CTimings() {m_current_start = {};}
+
+    // Call this to add a number of milliseconds to a phase
+    void        add(const std::string& name, double ms);
+
+    // Call this when a sequential phase starts.  The phase that was in progress, if any, ends
+    void        begin_phase(const std::string& name);
+
+    // Call this to end the sequential phase that's in progress, if any
+    void        end_phase();
+
+    // Call this to add every phase of another set of timings to this one
+    void        merge(const CTimings& other);
+
+    // Fetches the number of milliseconds spent in a phase, or 0 if the phase was never timed
+    double      get(const std::string& name) const;
+
+    // Returns the timings as a JSON object of "name": milliseconds, in the order phases were first timed
+    std::string json() const;
+
+    // Returns the number of milliseconds elapsed since a point in time
+    static double since(time_point_t start);
+
+    // Returns the current time
+    static time_point_t now() {return std::chrono::steady_clock::now();}
+
+protected:
+
+    // Every phase that has been timed so far, and its total
+    std::vector<std::pair<std::string, double>> m_phases;
+
+    // The sequential phase in progress, and when it began
+    std::string  m_current;
+    time_point_t m_current_start;
+};
+//----------------------------------------------------------------------------------------------------------
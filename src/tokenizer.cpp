@@ -1,7 +1,8 @@
-
 //=========================================================================================================
 // tokenizer.cpp - Implements a class that tokenizes strings
 //=========================================================================================================
+#include <string.h>
+#include <stdint.h>
 #include "tokenizer.h"
 using namespace std;
 
@@ -11,72 +12,135 @@ static bool is_eol(char c) {return c == 0 || c == 10 || c == 13;}
 // is_ws() - Checks for a whitespace character (space or tab)
 static bool is_ws(char c) {return c == 32 || c == 9;}
 
+// This is 0x01 in every byte of a 64-bit word
+static const uint64_t ONES = 0x0101010101010101ULL;
 
+// This is 0x80 in every byte of a 64-bit word
+static const uint64_t HIGHS = 0x8080808080808080ULL;
 
-//==========================================================================================================
-// parse() - Parses an input string into a vector of tokens
-//==========================================================================================================
-vector<string> CTokenizer::parse(const string& input)
+
+//=========================================================================================================
+// matches() - Returns a word with the high bit set in each byte of "word" that is equal to "c"
+//
+// Bytes above the first match may also be flagged, but the lowest flagged byte is always the first
+// real match.  That's all that scan_to() needs
+//=========================================================================================================
+static inline uint64_t matches(uint64_t word, char c)
 {
-    vector<string> result;
-    char           token[512];
+    uint64_t x = word ^ (ONES * (uint8_t)c);
+    return (x - ONES) & ~x & HIGHS;
+}
+//=========================================================================================================
 
-    // Fetch a const char* to the input string
-    const char* in = input.c_str();
 
-    // So long as there are input characters still to be processed...
-    while (!is_eol(*in))
+//=========================================================================================================
+// scan_to() - Finds the first character in a range that is an end-of-line character or is in "stops"
+//
+// Passed:  in    = The first character to examine
+//          end   = One past the last character to examine
+//          stops = The characters (other than end-of-line characters) that end the scan
+//
+// Returns: A pointer to the character that ended the scan, or "end"
+//
+// This examines 8 characters at a time
+//=========================================================================================================
+template <size_t N>
+static const char* scan_to(const char* in, const char* end, const char (&stops)[N])
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - in >= 8)
     {
-        // Point to the output buffer 
-        char* out = token;
+        uint64_t word;
+        memcpy(&word, in, 8);
 
-        // Skip over any leading spaces on the input
-        while (is_ws(*in)) in++;
+        // Flag every byte that is an end-of-line character or one of the stop characters
+        uint64_t found = matches(word, 0) | matches(word, 10) | matches(word, 13);
+        for (size_t i=0; i<N; ++i) found |= matches(word, stops[i]);
 
-        // If we hit end-of-line, there are no more tokens to parse
-        if (is_eol(*in)) break;
+        // If we found one, the lowest flagged byte is the first of them
+        if (found) return in + (__builtin_ctzll(found) >> 3);
+
+        // Otherwise, move on to the next 8 characters
+        in += 8;
+    }
+#endif
+
+    // Examine whatever is left one character at a time
+    while (in < end)
+    {
+        if (is_eol(*in)) return in;
+        for (size_t i=0; i<N; ++i) if (*in == stops[i]) return in;
+        ++in;
+    }
+
+    // If we get here, we ran off the end of the input
+    return end;
+}
+//=========================================================================================================
 
-        // Assume for the moment that we're not starting a quoted string
-        char in_quotes = 0;
 
-        // If this is a single or double quote-mark, remember it and skip past it
-        if (*in == '"' || *in == '\'') in_quotes = *in++;
+//=========================================================================================================
+// parse() - Parses an input string into a vector of tokens that are slices of the input
+//=========================================================================================================
+void CTokenizer::parse(string_view input, vector<string_view>* p_result)
+{
+    const char* in  = input.data();
+    const char* end = in + input.size();
+
+    // These characters end an unquoted token
+    static const char unquoted_stops[] = {' ', '\t', ','};
+
+    // Start with an empty result
+    p_result->clear();
+
+    // So long as there are input characters still to be processed...
+    while (in < end && !is_eol(*in))
+    {
+        // Skip over any leading spaces on the input
+        while (in < end && is_ws(*in)) in++;
 
-        // Loop until we've parsed this entire token...
-        while (!is_eol(*in))
+        // If we hit end-of-line, there are no more tokens to parse
+        if (in == end || is_eol(*in)) break;
+
+        // If this is a single or double quote-mark, the token runs to the matching quote-mark
+        if (*in == '"' || *in == '\'')
         {
-            // If we're parsing a quoted string...
-            if (in_quotes)
-            {
-                // If we've hit the ending quote-mark, we're done parsing this token
-                if (*in == in_quotes)
-                {
-                    ++in;
-                    break;
-                }
-            }
-
-            // Otherwise, we're not parsing a quoted string. A space or comma ends the token
-            else if (is_ws(*in) || *in == ',') break;
-
-            // Append this character to the token buffer
-            *out++ = *in++;
+            const char stops[] = {*in++};
+            const char* token = in;
+            in = scan_to(in, end, stops);
+            p_result->emplace_back(token, in - token);
+            if (in < end && *in == stops[0]) ++in;
         }
 
-        // nul-terminate the token string
-        *out = 0;
-
-        // Add the token to our result list
-        result.push_back(token);
+        // Otherwise, a space or comma ends the token
+        else
+        {
+            const char* token = in;
+            in = scan_to(in, end, unquoted_stops);
+            p_result->emplace_back(token, in - token);
+        }
 
         // Skip over any trailing spaces in the input
-        while (is_ws(*in)) ++in;
+        while (in < end && is_ws(*in)) ++in;
 
         // If there is a trailing comma, throw it away
-        if (*in == ',') ++in;
+        if (in < end && *in == ',') ++in;
     }
+}
+//=========================================================================================================
+
+
+//==========================================================================================================
+// parse() - Parses an input string into a vector of tokens
+//==========================================================================================================
+vector<string> CTokenizer::parse(const string& input)
+{
+    vector<string_view> tokens;
+
+    // Break the input into slices
+    parse(input, &tokens);
 
-    // Hand the caller a vector of tokens
-    return result;
+    // Hand the caller a copy of each slice
+    return vector<string>(tokens.begin(), tokens.end());
 }
 //==========================================================================================================
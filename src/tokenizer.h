@@ -3,11 +3,26 @@
 //=========================================================================================================
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
-
+//---------------------------------------------------------------------------------------------------------
+// CTokenizer - Splits a line into tokens separated by spaces, tabs or commas.  A token may be enclosed in
+//              single or double quotes, in which case it may contain spaces and commas.  The line ends at
+//              a carriage-return, a linefeed, a nul, or the end of the input
+//
+// Every token is a contiguous slice of the input, so tokens can be handed out as string_views without
+// copying anything.  Tokens may be of any length
+//---------------------------------------------------------------------------------------------------------
 class CTokenizer
 {
 public:
+
+    // Parses a line into a vector of tokens that are slices of the input.  The tokens are only valid
+    // for as long as the input is
+    void parse(std::string_view input, std::vector<std::string_view>* p_result);
+
+    // Parses a line into a vector of strings
     std::vector<std::string> parse(const std::string& input);
-};
\ No newline at end of file
+};
+//---------------------------------------------------------------------------------------------------------
@@ -0,0 +1,305 @@
+//==========================================================================================================
+// verifier.cpp - Implements a checker that waits for freshly programmed SmartLynqs to answer at their
+//                new address
+//==========================================================================================================
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <stdexcept>
+#include "verifier.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// After the first failed connection attempt we wait this many milliseconds before the next one.  The wait
+// doubles after every failed attempt, up to MAX_BACKOFF_MS
+static const int FIRST_BACKOFF_MS = 250;
+static const int MAX_BACKOFF_MS   = 5000;
+
+// A connection attempt that hasn't succeeded or failed after this many milliseconds has failed
+static const int ATTEMPT_TIMEOUT_MS = 1000;
+
+
+//==========================================================================================================
+// CVerifier() - Default constructor
+//==========================================================================================================
+CVerifier::CVerifier()
+{
+    m_epfd        = -1;
+    m_wakefd      = -1;
+    m_outstanding = 0;
+    m_stopping    = false;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// add() - Starts verifying that hw_server answers at an IP address
+//
+// Passed:  ip         = The IP address to verify
+//          port       = The TCP port that hw_server listens on
+//          timeout_ms = The number of milliseconds hw_server has to answer
+//          on_done    = Called on the background thread when the verification finishes
+//==========================================================================================================
+void CVerifier::add(const string& ip, int port, int timeout_ms, callback_t on_done)
+{
+    target_t target = {};
+
+    // Fill in the target
+    if (inet_pton(AF_INET, ip.c_str(), &target.ip) != 1) throw runtime_error(ip + " is malformed");
+    target.port     = port;
+    target.sd       = -1;
+    target.backoff  = FIRST_BACKOFF_MS;
+    target.start    = steady_clock::now();
+    target.deadline = target.start + milliseconds(timeout_ms);
+    target.next     = target.start;
+    target.on_done  = on_done;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    // If the background thread isn't running, start it
+    if (!m_thread.joinable())
+    {
+        m_epfd   = epoll_create1(EPOLL_CLOEXEC);
+        m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_epfd < 0 || m_wakefd < 0) throw runtime_error("Can't create the verifier's event loop");
+
+        // The eventfd is the one thing in the epoll set that isn't a target
+        epoll_event event = {};
+        event.events   = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakefd, &event);
+
+        m_stopping = false;
+        m_thread   = thread(&CVerifier::run, this);
+    }
+
+    // Hand the target to the background thread, and wake it up
+    m_incoming.push_back(target);
+    ++m_outstanding;
+    uint64_t one = 1;
+    if (write(m_wakefd, &one, sizeof one) < 0) {}
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// wait() - Waits until every verification has finished
+//==========================================================================================================
+void CVerifier::wait()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_finished.wait(lock, [&]() {return m_outstanding == 0;});
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stop() - Stops the background thread
+//
+// Before the background thread exits, it hands every verification that hasn't finished to its callback
+// as having failed, so that nobody is left waiting for one
+//==========================================================================================================
+void CVerifier::stop()
+{
+    // If the background thread isn't running, there's nothing to do
+    if (!m_thread.joinable()) return;
+
+    // Tell the background thread to exit, and wait for it to do so
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+        uint64_t one = 1;
+        if (write(m_wakefd, &one, sizeof one) < 0) {}
+    }
+    m_thread.join();
+
+    // Clean up
+    close(m_epfd);
+    close(m_wakefd);
+    m_epfd   = -1;
+    m_wakefd = -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// attempt() - Starts a non-blocking connection attempt
+//
+// Returns: 'true' if hw_server answered on the spot.  Otherwise either the attempt is in progress, or it
+//          failed and the next one is scheduled
+//==========================================================================================================
+bool CVerifier::attempt(target_t& target)
+{
+    auto now = steady_clock::now();
+    ++target.attempts;
+
+    // Create a socket and start connecting
+    sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(target.port);
+    addr.sin_addr.s_addr = target.ip;
+
+    int sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int rc = (sd < 0) ? -1 : connect(sd, (sockaddr*)&addr, sizeof addr);
+
+    // If the connection was made on the spot, we're done
+    if (rc == 0)
+    {
+        close(sd);
+        target.answered    = true;
+        target.answered_at = now;
+        return true;
+    }
+
+    // If the connection attempt is in progress, wait for the socket to become writable
+    if (sd >= 0 && errno == EINPROGRESS)
+    {
+        epoll_event event = {};
+        event.events   = EPOLLOUT;
+        event.data.ptr = &target;
+        epoll_ctl(m_epfd, EPOLL_CTL_ADD, sd, &event);
+        target.sd   = sd;
+        target.next = now + milliseconds(ATTEMPT_TIMEOUT_MS);
+        return false;
+    }
+
+    // Otherwise, the attempt failed on the spot
+    if (sd >= 0) close(sd);
+    retry(target);
+    return false;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// retry() - Ends a failed connection attempt and schedules the next one
+//==========================================================================================================
+void CVerifier::retry(target_t& target)
+{
+    if (target.sd >= 0) close(target.sd);
+    target.sd      = -1;
+    target.next    = steady_clock::now() + milliseconds(target.backoff);
+    target.backoff = min(target.backoff * 2, MAX_BACKOFF_MS);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// finish() - Hands the outcome of a verification to its callback, and counts it as finished
+//
+// A verification that hasn't seen hw_server answer has failed
+//==========================================================================================================
+void CVerifier::finish(target_t& target)
+{
+    auto now = steady_clock::now();
+
+    // We're done with the connection attempt in progress, if there is one
+    if (target.sd >= 0) close(target.sd);
+    target.sd = -1;
+
+    // Tell the caller how the verification turned out
+    result_t result;
+    result.ready    = target.answered;
+    result.ms       = duration<double, milli>((target.answered ? target.answered_at : now) - target.start).count();
+    result.attempts = target.attempts;
+    if (target.on_done) target.on_done(result);
+
+    lock_guard<mutex> lock(m_mutex);
+    --m_outstanding;
+    m_finished.notify_all();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run() - The background thread's event loop
+//==========================================================================================================
+void CVerifier::run()
+{
+    list<target_t> targets;
+    epoll_event    events[64];
+
+    while (true)
+    {
+        // Sleep until the next attempt is due, an attempt times out, or a deadline passes
+        int wait = -1;
+        auto now = steady_clock::now();
+        for (auto& target : targets)
+        {
+            auto when = min(target.next, target.deadline);
+            int  ms   = max<long>(duration_cast<milliseconds>(when - now).count(), 0) + 1;
+            if (wait < 0 || ms < wait) wait = ms;
+        }
+        int count = epoll_wait(m_epfd, events, 64, wait);
+
+        for (int i=0; i<count; ++i)
+        {
+            target_t* target = (target_t*)events[i].data.ptr;
+
+            // If we were woken up, pick up the new targets, unless it's time to exit
+            if (target == nullptr)
+            {
+                uint64_t value;
+                bool     stopping;
+                if (read(m_wakefd, &value, sizeof value) < 0) {}
+                {
+                    lock_guard<mutex> lock(m_mutex);
+                    stopping = m_stopping;
+                    targets.splice(targets.end(), m_incoming);
+                }
+
+                // If it's time to exit, every verification that hasn't finished has failed
+                if (stopping)
+                {
+                    for (auto& t : targets) finish(t);
+                    return;
+                }
+                continue;
+            }
+
+            // Otherwise, a connection attempt has either succeeded or failed
+            int       error = 0;
+            socklen_t size  = sizeof error;
+            getsockopt(target->sd, SOL_SOCKET, SO_ERROR, &error, &size);
+            if (error == 0)
+            {
+                close(target->sd);
+                target->sd          = -1;
+                target->answered    = true;
+                target->answered_at = steady_clock::now();
+            }
+            else retry(*target);
+        }
+
+        // Start the attempts that are due, fail the ones that took too long, and finish the targets that
+        // are done
+        now = steady_clock::now();
+        for (auto it = targets.begin(); it != targets.end(); )
+        {
+            target_t& target = *it;
+
+            if (!target.answered && now < target.deadline && now >= target.next)
+            {
+                if (target.sd >= 0) retry(target); else attempt(target);
+            }
+
+            // If this target isn't done, move on to the next one
+            if (!target.answered && now < target.deadline)
+            {
+                ++it;
+                continue;
+            }
+
+            // The target is done
+            finish(target);
+            it = targets.erase(it);
+        }
+    }
+}
+//==========================================================================================================
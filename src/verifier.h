@@ -0,0 +1,115 @@
+//==========================================================================================================
+// verifier.h - Defines a checker that waits for freshly programmed SmartLynqs to answer at their new address
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+//----------------------------------------------------------------------------------------------------------
+// CVerifier - Repeatedly tries to connect to hw_server at an IP address until it answers or a deadline
+//             passes, for any number of addresses at once
+//
+// Every verification is handled by a single background thread running one epoll loop.  Connection
+// attempts are non-blocking, and after each failed attempt the wait before the next one doubles, up to
+// a limit.  When a verification finishes, its callback is called on the background thread
+//----------------------------------------------------------------------------------------------------------
+class CVerifier
+{
+public:
+
+    // The outcome of a verification
+    struct result_t
+    {
+        // True if hw_server answered before the deadline
+        bool    ready;
+
+        // The number of milliseconds from the start of the verification until hw_server answered (or
+        // until we gave up)
+        double  ms;
+
+        // The number of connection attempts that were made
+        int     attempts;
+    };
+
+    // The type of function that is called when a verification finishes
+    typedef std::function<void(const result_t&)> callback_t;
+
+    // Default constructor
+    CVerifier();
+
+    // Destructor stops the background thread.  Verifications that haven't finished have failed
+    ~CVerifier() {stop();}
+
+    // Call this to start verifying that hw_server answers at "ip":"port" within "timeout_ms" milliseconds.
+    // "on_done" is called on the background thread when the verification finishes.  Thread-safe
+    // Can throw exception runtime_error
+    void    add(const std::string& ip, int port, int timeout_ms, callback_t on_done);
+
+    // Call this to wait until every verification that has been added has finished, and its callback
+    // has returned
+    void    wait();
+
+    // Call this to stop the background thread.  Every verification that hasn't finished is handed to its
+    // callback as having failed before this returns
+    void    stop();
+
+protected:
+
+    typedef std::chrono::steady_clock::time_point time_point_t;
+
+    // A single verification that is in progress
+    struct target_t
+    {
+        uint32_t     ip;            // In network byte order
+        int          port;
+        int          sd;            // The socket of the attempt in progress, or -1 if we're waiting
+        int          attempts;
+        int          backoff;       // Milliseconds to wait after the next failed attempt
+        bool         answered;      // True once hw_server has accepted a connection
+        time_point_t start;         // When the verification started
+        time_point_t deadline;      // When we give up
+        time_point_t next;          // When the attempt in progress times out, or the next one starts
+        time_point_t answered_at;   // When hw_server accepted a connection
+        callback_t   on_done;
+    };
+
+    // The background thread's event loop
+    void    run();
+
+    // Starts a connection attempt.  Returns 'true' if hw_server answered on the spot
+    bool    attempt(target_t& target);
+
+    // Ends a failed connection attempt and schedules the next one
+    void    retry(target_t& target);
+
+    // Hands the outcome of a verification to its callback, and counts it as finished
+    void    finish(target_t& target);
+
+    // The background thread
+    std::thread m_thread;
+
+    // The epoll instance, and the eventfd that wakes the background thread up
+    int     m_epfd, m_wakefd;
+
+    // Protects everything below
+    std::mutex  m_mutex;
+
+    // Signalled whenever a verification finishes
+    std::condition_variable m_finished;
+
+    // Verifications that have been added but that the background thread hasn't picked up yet
+    std::list<target_t> m_incoming;
+
+    // The number of verifications that have been added but haven't finished
+    int     m_outstanding;
+
+    // True when the background thread should exit
+    bool    m_stopping;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,263 @@
+//==========================================================================================================
+// vivado_worker.cpp - Implements a long-lived Vivado TCL interpreter that runs scripts on demand
+//==========================================================================================================
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <stdexcept>
+#include "vivado_worker.h"
+
+using namespace std;
+
+// When a script completes, Vivado prints a line that starts with this, followed by "<sequence> OK|FAILED"
+static const string SENTINEL = "SMARTLYNQ_RESULT";
+
+
+//==========================================================================================================
+// start() - Starts Vivado in TCL mode with its stdin, stdout and stderr connected to pipes
+//==========================================================================================================
+void CVivadoWorker::start()
+{
+    int to_child[2], from_child[2];
+
+    // If Vivado is already running, there's nothing to do
+    if (m_pid) return;
+
+    // Create the pipes that will connect us to Vivado
+    if (pipe2(to_child, O_CLOEXEC) < 0) throw runtime_error("Can't create pipe to Vivado");
+    if (pipe2(from_child, O_CLOEXEC) < 0)
+    {
+        close(to_child[0]);
+        close(to_child[1]);
+        throw runtime_error("Can't create pipe from Vivado");
+    }
+
+    // Start Vivado in a process group of its own, so that if Vivado must be killed, everything it
+    // started dies along with it.  If we're interrupted by a signal, Vivado dies too
+    m_pid = CProcess::spawn(m_command_line, to_child[0], from_child[1]);
+
+    // The child's ends of the pipes belong to the child
+    close(to_child[0]);
+    close(from_child[1]);
+
+    // If Vivado couldn't be started, clean up and complain
+    if (m_pid < 0)
+    {
+        m_pid = 0;
+        close(to_child[1]);
+        close(from_child[0]);
+        throw runtime_error("Can't start Vivado");
+    }
+
+    // Keep track of our ends of the pipes
+    m_to_vivado   = fdopen(to_child[1], "w");
+    m_from_vivado = from_child[0];
+    m_reader.attach(m_from_vivado);
+
+    // Make sure that everything the scripts print reaches us as soon as it's printed.  If Vivado has
+    // already died, writing to its stdin must report an error rather than kill us
+    CSigpipeBlocker blocker;
+    fprintf(m_to_vivado, "fconfigure stdout -buffering line\n");
+    fflush(m_to_vivado);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stop() - Shuts down the Vivado child process
+//==========================================================================================================
+void CVivadoWorker::stop()
+{
+    // If Vivado isn't running, there's nothing to do
+    if (m_pid == 0) return;
+
+    // Ask Vivado to exit, then close our ends of the pipes.  Vivado may already be dead
+    CSigpipeBlocker blocker;
+    fprintf(m_to_vivado, "exit\n");
+    fclose(m_to_vivado);
+    close(m_from_vivado);
+    m_to_vivado   = NULL;
+    m_from_vivado = -1;
+
+    // Wait for Vivado to exit
+    waitpid(m_pid, NULL, 0);
+    CProcess::unregister_child(m_pid);
+    m_pid = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// forget_vivado() - Cleans up after a Vivado child process that has already exited and been reaped
+//==========================================================================================================
+void CVivadoWorker::forget_vivado()
+{
+    fclose(m_to_vivado);
+    close(m_from_vivado);
+    m_to_vivado   = NULL;
+    m_from_vivado = -1;
+    CProcess::unregister_child(m_pid);
+    m_pid = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// kill_vivado() - Kills Vivado and everything it started, then cleans up
+//==========================================================================================================
+void CVivadoWorker::kill_vivado()
+{
+    if (m_pid) kill(-m_pid, SIGKILL);
+    stop();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_script() - Has Vivado source a TCL script and waits for it to finish
+//
+// Passed:  filename = The name of the TCL script to run
+//          p_output = Where to store the output of Vivado while it runs the script
+//          on_line  = If not NULL, called with each line of output as it arrives
+//
+// Returns: 'true' if the script ran without error
+//==========================================================================================================
+bool CVivadoWorker::run_script(string filename, vector<string>* p_output, CProcess::line_handler_t on_line)
+{
+    return run_tcl("source {" + filename + "}", p_output, on_line);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_script() - Sends a TCL script to Vivado and waits for it to finish
+//
+// Passed:  script   = The lines of the TCL script to run
+//          p_output = Where to store the output of Vivado while it runs the script
+//          on_line  = If not NULL, called with each line of output as it arrives
+//
+// Returns: 'true' if the script ran without error
+//==========================================================================================================
+bool CVivadoWorker::run_script(const vector<string>& script, vector<string>* p_output, CProcess::line_handler_t on_line)
+{
+    string tcl = "\n";
+    for (auto& s : script) tcl += s + "\n";
+    return run_tcl(tcl, p_output, on_line);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_tcl() - Has Vivado run some TCL and waits for it to finish
+//
+// Passed:  tcl      = The TCL to run
+//          p_output = Where to store the output of Vivado while it runs the TCL
+//          on_line  = If not NULL, called with each line of output as it arrives
+//
+// Returns: 'true' if the TCL ran without error
+//
+// If Vivado has died since the last script, it is restarted first.  If Vivado dies before it prints
+// anything at all, it can't have started on the TCL, so the TCL is tried once more with a fresh Vivado
+//==========================================================================================================
+bool CVivadoWorker::run_tcl(const string& tcl, vector<string>* p_output, CProcess::line_handler_t on_line)
+{
+    bool started = false, ok = false;
+
+    for (int attempt = 0; attempt < 2 && !started; ++attempt)
+    {
+        ok = run_once(tcl, p_output, on_line, &started);
+        if (ok || m_timed_out) break;
+    }
+
+    return ok;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run_once() - Has Vivado run some TCL and waits for it to finish
+//
+// Passed:  tcl       = The TCL to run
+//          p_output  = Where to store the output of Vivado while it runs the TCL
+//          on_line   = If not NULL, called with each line of output as it arrives
+//          p_started = Where to store 'true' if Vivado printed anything at all
+//
+// Returns: 'true' if the TCL ran without error
+//
+// The TCL is run inside of a "catch", after which Vivado prints a sentinel line that tells us the
+// script has completed and whether or not it succeeded.  If Vivado dies while running the script, the
+// script is considered to have failed, and Vivado will be restarted on the next call.  If the deadline
+// passes before the script completes, Vivado is killed, the script has failed, and Vivado will be
+// restarted on the next call
+//==========================================================================================================
+bool CVivadoWorker::run_once(const string& tcl, vector<string>* p_output, CProcess::line_handler_t on_line,
+                             bool* p_started)
+{
+    string line;
+    int    rc = CLineReader::END_OF_FILE, status;
+
+    // Clear the caller's output
+    p_output->clear();
+
+    // We haven't timed out (yet!)
+    m_timed_out = false;
+
+    // If Vivado has exited since the last script, reap it so that it's restarted below
+    if (m_pid && waitpid(m_pid, &status, WNOHANG) == m_pid) forget_vivado();
+
+    // If Vivado isn't running (or has died), start it
+    start();
+
+    // This is the sentinel that Vivado will print when it's done with this script
+    string sentinel = SENTINEL + " " + to_string(++m_sequence) + " ";
+
+    // Tell Vivado to run the TCL, then close the hardware manager and report the outcome.  The first
+    // thing it does is end the line, so that the TCL prompt isn't in front of the script's first report.
+    // If Vivado dies, writing to its stdin must report an error rather than kill us
+    CSigpipeBlocker blocker;
+    fprintf(m_to_vivado,
+            "puts {}; set rc [catch {%s} msg]; catch {close_hw_manager}; "
+            "if {$rc} {puts \"%sFAILED [string map [list \\n { }] $msg]\"} else {puts \"%sOK\"}\n",
+            tcl.c_str(), sentinel.c_str(), sentinel.c_str());
+
+    // The script starts out with the initial deadline
+    m_reader.set_timeout(m_timeout);
+
+    // Fetch Vivado output until we see our sentinel
+    while (fflush(m_to_vivado) == 0 && (rc = m_reader.read_line(line)) == CLineReader::LINE)
+    {
+        // Vivado is alive and working on the TCL
+        *p_started = true;
+
+        // Is our sentinel somewhere in this line?  (It may be preceded by a TCL prompt)
+        size_t pos = line.find(sentinel);
+
+        // If it's not, this is ordinary output
+        if (pos == string::npos)
+        {
+            p_output->push_back(line);
+            if (on_line) on_line(line);
+            continue;
+        }
+
+        // Fetch the outcome of the script
+        string outcome = line.substr(pos + sentinel.size());
+
+        // If the script succeeded, tell the caller
+        if (outcome == "OK") return true;
+
+        // Otherwise, tell the caller why it failed
+        p_output->push_back(outcome);
+        return false;
+    }
+
+    // If we get here, Vivado either died or took too long.  It will be restarted on the next call
+    m_timed_out = (rc == CLineReader::TIMEOUT);
+    p_output->push_back(m_timed_out ? "FAILED Vivado took too long" : "FAILED Vivado exited unexpectedly");
+    kill_vivado();
+    return false;
+}
+//==========================================================================================================
@@ -0,0 +1,97 @@
+//==========================================================================================================
+// vivado_worker.h - Defines a long-lived Vivado TCL interpreter that runs scripts on demand
+//==========================================================================================================
+#pragma once
+#include <stdio.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "process.h"
+
+//----------------------------------------------------------------------------------------------------------
+// CVivadoWorker - Keeps a "vivado -mode tcl" child process alive on a pair of pipes so that scripts can
+//                 be run without paying the Vivado startup cost every time
+//----------------------------------------------------------------------------------------------------------
+class CVivadoWorker
+{
+public:
+
+    // Default constructor
+    CVivadoWorker() {m_pid = 0; m_to_vivado = NULL; m_from_vivado = -1; m_sequence = 0; m_timeout = 0; m_timed_out = false;}
+
+    // Destructor shuts down the Vivado child process
+    ~CVivadoWorker() {stop();}
+
+    // Call this to set the shell command that starts Vivado in TCL mode
+    void    set_command_line(std::string command) {m_command_line = command;}
+
+    // Call this to start Vivado.  Does nothing if Vivado is already running.
+    // Can throw exception runtime_error
+    void    start();
+
+    // Call this to shut down the Vivado child process
+    void    stop();
+
+    // Tells the caller whether the Vivado child process is running
+    bool    is_running() {return m_pid != 0;}
+
+    // Call this to set the deadline in milliseconds that each script starts out with.  0 = no deadline
+    void    set_initial_timeout(int milliseconds) {m_timeout = milliseconds;}
+
+    // A line handler can call this to set a new deadline this many milliseconds from now
+    void    set_timeout(int milliseconds) {m_reader.set_timeout(milliseconds);}
+
+    // Call this to run a TCL script.  Restarts Vivado if it has died.  Returns 'true' if the script
+    // ran without error.  The output of Vivado while running the script is stored in p_output, and
+    // each line is also handed to "on_line" as it arrives.  If the deadline passes, Vivado is killed
+    // Can throw exception runtime_error
+    bool    run_script(std::string filename, std::vector<std::string>* p_output,
+                       CProcess::line_handler_t on_line = nullptr);
+
+    // Same as above, but the script is sent to Vivado directly instead of being read from a file
+    // Can throw exception runtime_error
+    bool    run_script(const std::vector<std::string>& script, std::vector<std::string>* p_output,
+                       CProcess::line_handler_t on_line = nullptr);
+
+    // Tells the caller whether the most recent script failed because a deadline passed
+    bool    timed_out() {return m_timed_out;}
+
+protected:
+
+    // Kills Vivado and everything it started, then cleans up
+    void    kill_vivado();
+
+    // Cleans up after a Vivado that has already exited and been reaped
+    void    forget_vivado();
+
+    // Runs a TCL command inside a "catch" and waits for it to finish, retrying once if Vivado dies
+    // before printing anything
+    bool    run_tcl(const std::string& tcl, std::vector<std::string>* p_output, CProcess::line_handler_t on_line);
+
+    // Runs a TCL command inside a "catch" once, and waits for it to finish
+    bool    run_once(const std::string& tcl, std::vector<std::string>* p_output, CProcess::line_handler_t on_line,
+                     bool* p_started);
+
+    // Reads the output of Vivado
+    CLineReader m_reader;
+
+    // The shell command that starts Vivado in TCL mode
+    std::string m_command_line;
+
+    // The process ID of the Vivado child process, or 0 if it isn't running
+    pid_t   m_pid;
+
+    // The pipes connected to Vivado's stdin and stdout/stderr
+    FILE    *m_to_vivado;
+    int     m_from_vivado;
+
+    // The deadline in milliseconds that each script starts out with
+    int     m_timeout;
+
+    // True if the most recent script failed because a deadline passed
+    bool    m_timed_out;
+
+    // This is incremented for each script, so that every completion sentinel is unique
+    int     m_sequence;
+};
+//----------------------------------------------------------------------------------------------------------